@@ -0,0 +1,413 @@
+/*
+ * bench_layout.c
+ * Microbenchmark cho layout của bảng movie, tách khỏi phần đọc / parse của problem1:
+ * - aos:   struct 16 bytes {movieID, sum_ratings, count, is_used} như bản gốc
+ * - soa32: mảng sum[] / count[] riêng, cùng kiểu int (chỉ khác layout)
+ * - soa:   mảng sum[] / count[] riêng kiểu Counter 64-bit như problem1 hiện tại
+ * Cùng kiểu cập nhật đồng thời như MODE_LOCKFREE: T thread, mỗi thread cộng N rating
+ * vào slab riêng (movie chọn ngẫu nhiên, dãy index sinh sẵn trước khi đo), rồi merge
+ * các slab vào bảng chính và quét bảng chính (đếm movie có rating, tính average)
+ * Mỗi pha lấy thời gian nhỏ nhất qua -r lần chạy
+ */
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_THREADS 4
+#define DEFAULT_UPDATES 20000000
+#define DEFAULT_MOVIES 262144      // 4MB ở aos: lớn hơn L2, cỡ LLC
+#define DEFAULT_REPEAT 3
+#define DEFAULT_SEED 42
+#define CACHE_LINE 64
+
+typedef enum {
+    LAYOUT_AOS = 0,
+    LAYOUT_SOA32,
+    LAYOUT_SOA,
+    NUM_LAYOUTS
+} Layout;
+
+static const char *layout_names[NUM_LAYOUTS] = {"aos", "soa32", "soa"};
+
+// Layout gốc: 1 movie = 16 bytes, 4 movie / cache line
+typedef struct {
+    int movieID;
+    int sum_ratings;
+    int count;
+    int is_used;
+} MovieData;
+
+typedef int64_t Counter;
+
+// 1 bộ bảng (bảng chính hoặc slab của 1 thread), chỉ 1 trong 3 dạng được dùng
+typedef struct {
+    MovieData *movies;         // LAYOUT_AOS
+    int *sum32;                // LAYOUT_SOA32
+    int *count32;
+    Counter *sum;              // LAYOUT_SOA
+    Counter *count;
+} Table;
+
+// Tham số của 1 thread cập nhật
+typedef struct {
+    Layout layout;
+    Table *slab;
+    const uint32_t *index;     // index[k]: movie của rating thứ k
+    const uint8_t *rating;     // rating[k]: 1..5
+    long long n;
+    pthread_barrier_t *barrier;
+} Worker;
+
+/*
+ * Hàm: next_random
+ * Mục đích: xorshift64* (giống gen_ratings)
+ */
+static inline uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/*
+ * Hàm: alloc_zero
+ * Mục đích: Mảng căn 64 bytes, đã xóa 0 (2 slab không bao giờ chung cache line)
+ */
+static void *alloc_zero(size_t bytes) {
+    size_t rounded = (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    void *p = aligned_alloc(CACHE_LINE, rounded);
+    if (p == NULL) {
+        fprintf(stderr, "ERROR: Cannot allocate %zu bytes\n", rounded);
+        exit(1);
+    }
+    memset(p, 0, rounded);
+    return p;
+}
+
+static void table_alloc(Table *t, Layout layout, int movies) {
+    memset(t, 0, sizeof(*t));
+    if (layout == LAYOUT_AOS) {
+        t->movies = alloc_zero((size_t)movies * sizeof(MovieData));
+    } else if (layout == LAYOUT_SOA32) {
+        t->sum32 = alloc_zero((size_t)movies * sizeof(int));
+        t->count32 = alloc_zero((size_t)movies * sizeof(int));
+    } else {
+        t->sum = alloc_zero((size_t)movies * sizeof(Counter));
+        t->count = alloc_zero((size_t)movies * sizeof(Counter));
+    }
+}
+
+static void table_free(Table *t) {
+    free(t->movies);
+    free(t->sum32);
+    free(t->count32);
+    free(t->sum);
+    free(t->count);
+}
+
+/*
+ * Hàm: update_thread
+ * Mục đích: Pha cập nhật của 1 thread vào slab riêng, cùng logic với bản gốc
+ * (aos: lần đầu gặp movie thì ghi movieID / is_used)
+ */
+static void *update_thread(void *arg) {
+    Worker *w = arg;
+    Table *t = w->slab;
+    pthread_barrier_wait(w->barrier);
+
+    if (w->layout == LAYOUT_AOS) {
+        MovieData *movies = t->movies;
+        for (long long k = 0; k < w->n; k++) {
+            MovieData *m = &movies[w->index[k]];
+            if (m->is_used == 0) {
+                m->movieID = (int)w->index[k] + 1;
+                m->is_used = 1;
+            }
+            m->sum_ratings += w->rating[k];
+            m->count++;
+        }
+    } else if (w->layout == LAYOUT_SOA32) {
+        for (long long k = 0; k < w->n; k++) {
+            uint32_t i = w->index[k];
+            t->sum32[i] += w->rating[k];
+            t->count32[i]++;
+        }
+    } else {
+        for (long long k = 0; k < w->n; k++) {
+            uint32_t i = w->index[k];
+            t->sum[i] += w->rating[k];
+            t->count[i]++;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Hàm: merge_slab
+ * Mục đích: Cộng 1 slab vào bảng chính (tuần tự theo movie, như merge_table_set)
+ */
+static void merge_slab(Layout layout, Table *main_table, const Table *slab, int movies) {
+    if (layout == LAYOUT_AOS) {
+        for (int i = 0; i < movies; i++) {
+            const MovieData *s = &slab->movies[i];
+            if (s->is_used) {
+                MovieData *m = &main_table->movies[i];
+                m->movieID = s->movieID;
+                m->is_used = 1;
+                m->sum_ratings += s->sum_ratings;
+                m->count += s->count;
+            }
+        }
+    } else if (layout == LAYOUT_SOA32) {
+        for (int i = 0; i < movies; i++) {
+            main_table->sum32[i] += slab->sum32[i];
+            main_table->count32[i] += slab->count32[i];
+        }
+    } else {
+        for (int i = 0; i < movies; i++) {
+            main_table->sum[i] += slab->sum[i];
+            main_table->count[i] += slab->count[i];
+        }
+    }
+}
+
+/*
+ * Hàm: scan_table
+ * Mục đích: Pha đọc kết quả: đếm movie có rating và cộng average (như output / top)
+ * Trả về tổng average để compiler không bỏ vòng lặp
+ */
+static double scan_table(Layout layout, const Table *t, int movies, long long *used) {
+    double total = 0;
+    *used = 0;
+    for (int i = 0; i < movies; i++) {
+        long long sum, count;
+        if (layout == LAYOUT_AOS) {
+            if (!t->movies[i].is_used) {
+                continue;
+            }
+            sum = t->movies[i].sum_ratings;
+            count = t->movies[i].count;
+        } else if (layout == LAYOUT_SOA32) {
+            sum = t->sum32[i];
+            count = t->count32[i];
+        } else {
+            sum = t->sum[i];
+            count = t->count[i];
+        }
+        if (count > 0) {
+            (*used)++;
+            total += (double)sum / count;
+        }
+    }
+    return total;
+}
+
+/*
+ * Hàm: run_layout
+ * Mục đích: Chạy 3 pha cho 1 layout, in thời gian nhỏ nhất của mỗi pha
+ */
+static void run_layout(Layout layout, int threads, long long n, int movies, int repeat,
+                       uint32_t **index, uint8_t **rating) {
+    double best_update = 0, best_merge = 0, best_scan = 0, checksum = 0;
+    long long used = 0;
+
+    for (int r = 0; r < repeat; r++) {
+        Table main_table;
+        Table *slabs = malloc((size_t)threads * sizeof(Table));
+        Worker *workers = malloc((size_t)threads * sizeof(Worker));
+        pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+        pthread_barrier_t barrier;
+        if (slabs == NULL || workers == NULL || tids == NULL) {
+            fprintf(stderr, "ERROR: Out of memory\n");
+            exit(1);
+        }
+
+        table_alloc(&main_table, layout, movies);
+        pthread_barrier_init(&barrier, NULL, (unsigned)threads + 1);
+        for (int w = 0; w < threads; w++) {
+            table_alloc(&slabs[w], layout, movies);
+            workers[w] = (Worker){layout, &slabs[w], index[w], rating[w], n, &barrier};
+            if (pthread_create(&tids[w], NULL, update_thread, &workers[w]) != 0) {
+                fprintf(stderr, "ERROR: pthread_create failed\n");
+                exit(1);
+            }
+        }
+
+        pthread_barrier_wait(&barrier);
+        double t0 = now_ms();
+        for (int w = 0; w < threads; w++) {
+            pthread_join(tids[w], NULL);
+        }
+        double t1 = now_ms();
+        for (int w = 0; w < threads; w++) {
+            merge_slab(layout, &main_table, &slabs[w], movies);
+        }
+        double t2 = now_ms();
+        checksum = scan_table(layout, &main_table, movies, &used);
+        double t3 = now_ms();
+
+        if (r == 0 || t1 - t0 < best_update) {
+            best_update = t1 - t0;
+        }
+        if (r == 0 || t2 - t1 < best_merge) {
+            best_merge = t2 - t1;
+        }
+        if (r == 0 || t3 - t2 < best_scan) {
+            best_scan = t3 - t2;
+        }
+
+        pthread_barrier_destroy(&barrier);
+        for (int w = 0; w < threads; w++) {
+            table_free(&slabs[w]);
+        }
+        table_free(&main_table);
+        free(slabs);
+        free(workers);
+        free(tids);
+    }
+
+    printf("%-6s %11.2f %9.2f %11.2f %9.2f %9.2f   %lld movies, checksum %.3f\n",
+           layout_names[layout], best_update, best_update * 1e6 / ((double)n * threads),
+           best_merge, best_scan, best_update + best_merge + best_scan, used, checksum);
+}
+
+/*
+ * Hàm: print_usage
+ * Mục đích: In hướng dẫn sử dụng
+ */
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options]\n", prog);
+    fprintf(stderr, "  -t, --threads N      Updater threads, each with its own slab (default %d)\n",
+            DEFAULT_THREADS);
+    fprintf(stderr, "  -n, --updates N      Ratings per thread (default %d)\n", DEFAULT_UPDATES);
+    fprintf(stderr, "  -m, --movies N       Table size (default %d)\n", DEFAULT_MOVIES);
+    fprintf(stderr, "  -r, --repeat N       Runs per layout, best time is reported (default %d)\n",
+            DEFAULT_REPEAT);
+    fprintf(stderr, "  -s, --seed N         Random seed (default %d)\n", DEFAULT_SEED);
+    fprintf(stderr, "  -l, --layout L       aos | soa32 | soa | all (default all)\n");
+    fprintf(stderr, "Layouts: aos = original 16-byte MovieData, soa32 = separate int sum[] / count[],\n");
+    fprintf(stderr, "         soa = separate 64-bit sum[] / count[] (current problem1)\n");
+}
+
+int main(int argc, char *argv[]) {
+    int threads = DEFAULT_THREADS;
+    long long n = DEFAULT_UPDATES;
+    int movies = DEFAULT_MOVIES;
+    int repeat = DEFAULT_REPEAT;
+    uint64_t seed = DEFAULT_SEED;
+    int only = -1;  // -1 = mọi layout
+
+    static const struct option long_options[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"updates", required_argument, NULL, 'n'},
+        {"movies", required_argument, NULL, 'm'},
+        {"repeat", required_argument, NULL, 'r'},
+        {"seed", required_argument, NULL, 's'},
+        {"layout", required_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:n:m:r:s:l:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'n':
+            n = atoll(optarg);
+            break;
+        case 'm':
+            movies = atoi(optarg);
+            break;
+        case 'r':
+            repeat = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'l':
+            if (strcmp(optarg, "all") == 0) {
+                only = -1;
+                break;
+            }
+            only = NUM_LAYOUTS;
+            for (int l = 0; l < NUM_LAYOUTS; l++) {
+                if (strcmp(optarg, layout_names[l]) == 0) {
+                    only = l;
+                }
+            }
+            if (only == NUM_LAYOUTS) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (threads < 1 || n < 1 || movies < 1 || repeat < 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Dãy rating sinh trước -> vòng đo chỉ có phần cập nhật bảng
+    uint32_t **index = malloc((size_t)threads * sizeof(uint32_t *));
+    uint8_t **rating = malloc((size_t)threads * sizeof(uint8_t *));
+    if (index == NULL || rating == NULL) {
+        fprintf(stderr, "ERROR: Out of memory\n");
+        return 1;
+    }
+    for (int w = 0; w < threads; w++) {
+        uint64_t state = seed * 0x9E3779B97F4A7C15ULL + (uint64_t)w + 1;
+        index[w] = malloc((size_t)n * sizeof(uint32_t));
+        rating[w] = malloc((size_t)n);
+        if (index[w] == NULL || rating[w] == NULL) {
+            fprintf(stderr, "ERROR: Out of memory\n");
+            return 1;
+        }
+        for (long long k = 0; k < n; k++) {
+            uint64_t x = next_random(&state);
+            index[w][k] = (uint32_t)((x >> 32) % (uint64_t)movies);
+            rating[w][k] = (uint8_t)(1 + (x & 0xffff) % 5);
+        }
+    }
+
+    printf("Table layout: %d threads x %lld ratings, %d movies, best of %d\n",
+           threads, n, movies, repeat);
+    printf("%-6s %11s %9s %11s %9s %9s\n", "layout", "update(ms)", "ns/rating",
+           "merge(ms)", "scan(ms)", "total(ms)");
+    for (int l = 0; l < NUM_LAYOUTS; l++) {
+        if (only < 0 || only == l) {
+            run_layout((Layout)l, threads, n, movies, repeat, index, rating);
+        }
+    }
+
+    for (int w = 0; w < threads; w++) {
+        free(index[w]);
+        free(rating[w]);
+    }
+    free(index);
+    free(rating);
+    return 0;
+}
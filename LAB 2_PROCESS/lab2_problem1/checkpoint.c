@@ -0,0 +1,223 @@
+/*
+ * checkpoint.c
+ * Checkpoint bảng chính ra file map bằng mmap: lưu = 1 lần memcpy bảng,
+ * khôi phục = map file rồi copy ngược vào shared memory
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+// Làm tròn lên bội số của 64 (bảng bắt đầu ở đầu cache line)
+static uint64_t align64(uint64_t x) {
+    return (x + 63) & ~(uint64_t)63;
+}
+
+/*
+ * Hàm: checkpoint_layout
+ * Mục đích: Tính data_offset cho num_files input, trả về tổng size file
+ */
+static uint64_t checkpoint_layout(CheckpointHeader *h) {
+    h->data_offset = align64(sizeof(CheckpointHeader) +
+                             (uint64_t)h->num_files * sizeof(CheckpointFile));
+    return h->data_offset + h->table_ints * sizeof(int64_t);
+}
+
+/*
+ * Hàm: read_tail
+ * Mục đích: Đọc tối đa CKPT_TAIL_BYTES bytes ngay trước consumed của fd vào buf
+ * Trả về số bytes đã đọc, -1 nếu file ngắn hơn consumed / lỗi
+ */
+static ssize_t read_tail(int fd, int64_t consumed, char *buf) {
+    int64_t start = (consumed > CKPT_TAIL_BYTES) ? consumed - CKPT_TAIL_BYTES : 0;
+    size_t want = (size_t)(consumed - start);
+    size_t have = 0;
+
+    while (have < want) {
+        ssize_t n = pread(fd, buf + have, want - have, start + (off_t)have);
+        if (n <= 0) {
+            return -1;
+        }
+        have += n;
+    }
+    return (ssize_t)have;
+}
+
+// FNV-1a 64-bit
+static uint64_t hash_bytes(const char *data, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+int checkpoint_fingerprint(const char *name, int columnar, int64_t consumed,
+                           CheckpointFile *file) {
+    struct stat st;
+    char tail[CKPT_TAIL_BYTES];
+
+    memset(file, 0, sizeof(*file));
+    strncpy(file->name, name, CKPT_NAME_MAX - 1);
+    file->consumed = consumed;
+
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    int result = -1;
+    if (fstat(fd, &st) == 0) {
+        file->device = (uint64_t)st.st_dev;
+        file->inode = (uint64_t)st.st_ino;
+        file->size = (int64_t)st.st_size;
+        file->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        result = 0;
+        if (!columnar) {
+            ssize_t n = read_tail(fd, consumed, tail);
+            if (n < 0) {
+                result = -1;
+            } else {
+                file->tail_hash = hash_bytes(tail, n);
+            }
+        }
+    }
+    close(fd);
+    return result;
+}
+
+int checkpoint_file_matches(const CheckpointFile *saved, int columnar) {
+    CheckpointFile now;
+    char last;
+
+    if (saved->consumed < 0 ||
+        checkpoint_fingerprint(saved->name, columnar, saved->consumed, &now) == -1) {
+        return 0;
+    }
+    if (now.device != saved->device || now.inode != saved->inode || now.size < saved->size ||
+        (now.size == saved->size && now.mtime_ns != saved->mtime_ns)) {
+        return 0;
+    }
+    if (columnar) {
+        return now.size == saved->size;
+    }
+    if (now.tail_hash != saved->tail_hash) {
+        return 0;
+    }
+    if (now.size > saved->size && saved->consumed > 0) {
+        // Đã ghi thêm: phần chưa đọc phải bắt đầu ở đầu dòng
+        int fd = open(saved->name, O_RDONLY | O_CLOEXEC);
+        ssize_t n = (fd < 0) ? -1 : pread(fd, &last, 1, saved->consumed - 1);
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (n != 1 || last != '\n') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int checkpoint_load(const char *path, Checkpoint *ck) {
+    CheckpointHeader h;
+
+    memset(ck, 0, sizeof(*ck));
+    if (map_file(path, &ck->map) == -1) {
+        return -1;
+    }
+    if (ck->map.data == NULL || ck->map.size < sizeof(CheckpointHeader)) {
+        checkpoint_close(ck);
+        return -1;
+    }
+    memcpy(&h, ck->map.data, sizeof(h));
+    if (memcmp(h.magic, CKPT_MAGIC, 4) != 0 || h.version != CKPT_VERSION ||
+        h.num_movies < 1 || h.num_users < 1 || h.num_files < 1 || h.num_time_buckets < 0 ||
+        h.movie_stride < h.num_movies || h.user_stride < h.num_users) {
+        checkpoint_close(ck);
+        return -1;
+    }
+
+    // Bảng phải nằm trọn trong file và khớp với offset tính lại từ header
+    CheckpointHeader expect = h;
+    uint64_t size = checkpoint_layout(&expect);
+    if (expect.data_offset != h.data_offset || size > ck->map.size) {
+        checkpoint_close(ck);
+        return -1;
+    }
+
+    ck->header = (const CheckpointHeader *)ck->map.data;
+    ck->files = (const CheckpointFile *)(ck->map.data + sizeof(CheckpointHeader));
+    ck->table = (const int64_t *)(ck->map.data + h.data_offset);
+    return 0;
+}
+
+void checkpoint_close(Checkpoint *ck) {
+    unmap_file(&ck->map);
+    ck->header = NULL;
+    ck->files = NULL;
+    ck->table = NULL;
+}
+
+/*
+ * Hàm: checkpoint_save
+ * Mục đích: Ghi bảng + vị trí đã đọc vào file tạm đã map, msync, rồi rename đè
+ * lên checkpoint cũ. rename là atomic -> crash giữa chừng vẫn còn checkpoint cũ
+ */
+int checkpoint_save(const char *path, const CheckpointHeader *layout,
+                    const CheckpointFile *files, const int64_t *table) {
+    CheckpointHeader h = *layout;
+    memcpy(h.magic, CKPT_MAGIC, 4);
+    h.version = CKPT_VERSION;
+    uint64_t file_size = checkpoint_layout(&h);
+
+    size_t tmp_len = strlen(path) + 5;
+    char *tmp_path = malloc(tmp_len);
+    if (tmp_path == NULL) {
+        return -1;
+    }
+    snprintf(tmp_path, tmp_len, "%s.tmp", path);
+
+    int result = -1;
+    char *out = MAP_FAILED;
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, file_size) == -1) {
+        perror("Cannot create checkpoint file");
+        goto cleanup;
+    }
+    out = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (out == MAP_FAILED) {
+        perror("mmap checkpoint failed");
+        goto cleanup;
+    }
+
+    memcpy(out + sizeof(CheckpointHeader), files, (size_t)h.num_files * sizeof(CheckpointFile));
+    memcpy(out + h.data_offset, table, h.table_ints * sizeof(int64_t));
+    memcpy(out, &h, sizeof(h));
+
+    // Dữ liệu phải xuống đĩa TRƯỚC khi rename thay checkpoint cũ
+    if (msync(out, file_size, MS_SYNC) == -1 || rename(tmp_path, path) == -1) {
+        perror("Cannot write checkpoint");
+        goto cleanup;
+    }
+    result = 0;
+
+cleanup:
+    if (out != MAP_FAILED) {
+        munmap(out, file_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (result != 0) {
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+    return result;
+}
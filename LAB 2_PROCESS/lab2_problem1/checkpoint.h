@@ -0,0 +1,86 @@
+// checkpoint.h
+// Lưu / khôi phục bảng chính (bộ bảng 0 trong shared memory) ra file
+// để chạy lại sau khi crash không phải đọc lại toàn bộ input
+//
+// Layout file (byte order theo máy ghi):
+//   [CheckpointHeader 128 bytes]
+//   [CheckpointFile x num_files]     vị trí đã đọc xong + dấu vết của từng input
+//   [table : int64 x table_ints]     bắt đầu ở data_offset (chia hết cho 64),
+//                                    cùng layout SoA với shared memory
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "rating_parser.h"
+
+#define CKPT_MAGIC "P1CK"
+#define CKPT_VERSION 5          // v5: dấu vết từng input (inode, size, mtime, hash đoạn cuối)
+#define CKPT_NAME_MAX 240
+#define CKPT_TAIL_BYTES 4096    // File text: hash tối đa 4KB ngay trước vị trí đã đọc
+
+typedef struct {
+    char magic[4];              // "P1CK"
+    uint32_t version;           // CKPT_VERSION
+    int32_t num_movies;         // Kích thước bảng lúc lưu
+    int32_t num_users;
+    int32_t movie_stride;
+    int32_t user_stride;
+    int32_t num_files;
+    int32_t bucket_kind;        // BucketKind lúc lưu (0 = không chia theo thời gian)
+    uint64_t table_ints;        // Số phần tử int64 của bảng
+    uint64_t data_offset;       // Offset (bytes) của bảng tính từ đầu file
+    int64_t bucket_base;        // Số thứ tự tuyệt đối của bucket 0
+    int32_t num_time_buckets;
+    int32_t hll_bits;           // --distinct: 2^hll_bits register / movie (0 = không có)
+    int64_t since;              // Khoảng timestamp đã lọc (--since / --until)
+    int64_t until;
+    uint8_t reserved[48];       // Đệm cho đủ 128 bytes
+} CheckpointHeader;
+
+// 1 file input trong checkpoint
+// Dấu vết lúc lưu: file bị ghi lại với cùng tên không được resume lên bảng cũ
+typedef struct {
+    char name[CKPT_NAME_MAX];   // Tên file như trên command line
+    int64_t consumed;           // Đã đọc xong: bytes (file text) hoặc số dòng (.rcol)
+    uint64_t device;            // st_dev, st_ino
+    uint64_t inode;
+    int64_t size;               // Size và mtime (ns) lúc lưu
+    int64_t mtime_ns;
+    uint64_t tail_hash;         // File text: FNV-1a của các byte [consumed - 4KB, consumed)
+} CheckpointFile;
+
+// Checkpoint đã map read-only
+typedef struct {
+    MappedFile map;
+    const CheckpointHeader *header;
+    const CheckpointFile *files;
+    const int64_t *table;
+} Checkpoint;
+
+// Map và kiểm tra file checkpoint. Trả về 0 nếu hợp lệ, -1 nếu không có / lỗi
+int checkpoint_load(const char *path, Checkpoint *ck);
+
+// Unmap checkpoint đã load
+void checkpoint_close(Checkpoint *ck);
+
+// Điền tên, consumed và dấu vết hiện tại của file name
+// Trả về -1 nếu không stat / đọc được tới consumed
+int checkpoint_fingerprint(const char *name, int columnar, int64_t consumed,
+                           CheckpointFile *file);
+
+// File trên disk vẫn là file saved (hoặc chỉ được ghi thêm vào cuối)?
+// - Cùng device + inode, size không nhỏ đi
+// - Size không đổi: mtime cũng không đổi
+// - File text: cùng hash đoạn trước consumed; đã ghi thêm thì byte consumed - 1 phải là
+//   '\n' (phần mới bắt đầu ở đầu dòng). File .rcol: không được ghi thêm
+int checkpoint_file_matches(const CheckpointFile *saved, int columnar);
+
+// Ghi checkpoint mới (ghi vào path.tmp rồi rename -> không bao giờ để lại file dở dang)
+// layout: các trường kích thước bảng (magic, version, offset do hàm tự điền)
+// files: header.num_files dấu vết input (checkpoint_fingerprint)
+// Trả về 0 nếu thành công, -1 nếu lỗi
+int checkpoint_save(const char *path, const CheckpointHeader *layout,
+                    const CheckpointFile *files, const int64_t *table);
+
+#endif
@@ -0,0 +1,387 @@
+/*
+ * compressed_input.c
+ * Giải nén gzip / zstd theo khối cho parser (xem compressed_input.h)
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compressed_input.h"
+
+#define ZSTD_MAGIC 0xFD2FB528u
+#define ZSTD_SKIPPABLE_MAGIC 0x184D2A50u  // 16 giá trị 0x184D2A50..5F
+#define ZSTD_SKIPPABLE_MASK 0xFFFFFFF0u
+
+// Bộ giải nén của 1 lần compressed_read_lines (mỗi worker 1 bộ riêng)
+typedef struct {
+    CompressKind kind;
+    const unsigned char *data;
+    size_t pos;                   // Bytes nén đã đưa vào bộ giải nén
+    int frame_done;               // Đang ở biên frame / member (không còn dữ liệu dở)
+#ifdef HAVE_ZLIB
+    z_stream gz;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DCtx *zstd;
+#endif
+} Decoder;
+
+CompressKind compress_detect(const MappedFile *mf) {
+    const unsigned char *p = (const unsigned char *)mf->data;
+
+    if (mf->size >= 2 && p[0] == 0x1f && p[1] == 0x8b) {
+        return COMPRESS_GZIP;
+    }
+    if (mf->size >= 4) {
+        uint32_t magic = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+        if (magic == ZSTD_MAGIC || (magic & ZSTD_SKIPPABLE_MASK) == ZSTD_SKIPPABLE_MAGIC) {
+            return COMPRESS_ZSTD;
+        }
+    }
+    return COMPRESS_NONE;
+}
+
+const char *compress_name(CompressKind kind) {
+    switch (kind) {
+        case COMPRESS_GZIP: return "gzip";
+        case COMPRESS_ZSTD: return "zstd";
+        default:            return "text";
+    }
+}
+
+/*
+ * Hàm: add_frame
+ * Mục đích: Thêm frame ở offset nén start (offset đã giải nén text) vào danh sách
+ */
+static int add_frame(CompressedInput *ci, long long *capacity, off_t start, long long text) {
+    if (ci->num_frames + 1 >= *capacity) {
+        long long grown = *capacity * 2;
+        off_t *starts = realloc(ci->start, grown * sizeof(off_t));
+        if (starts == NULL) {
+            return -1;
+        }
+        ci->start = starts;
+        long long *texts = realloc(ci->text, grown * sizeof(long long));
+        if (texts == NULL) {
+            return -1;
+        }
+        ci->text = texts;
+        *capacity = grown;
+    }
+    ci->start[ci->num_frames] = start;
+    ci->text[ci->num_frames] = text;
+    ci->num_frames++;
+    return 0;
+}
+
+#ifdef HAVE_ZSTD
+/*
+ * Hàm: zstd_list_frames
+ * Mục đích: Duyệt header các frame (chỉ đọc header block, không giải nén) để lấy
+ * offset nén và offset đã giải nén (content size trong header) của từng frame
+ */
+static int zstd_list_frames(const MappedFile *mf, CompressedInput *ci, long long *capacity) {
+    size_t pos = 0;
+    long long text = 0;
+
+    while (pos < mf->size) {
+        const char *frame = mf->data + pos;
+        size_t compressed = ZSTD_findFrameCompressedSize(frame, mf->size - pos);
+        if (ZSTD_isError(compressed)) {
+            fprintf(stderr, "zstd frame at byte %zu: %s\n", pos, ZSTD_getErrorName(compressed));
+            return -1;
+        }
+        if (add_frame(ci, capacity, (off_t)pos, text) == -1) {
+            perror("malloc frame list failed");
+            return -1;
+        }
+        // Frame skippable: content size = 0. Không ghi content size -> không biết offset
+        // các frame sau (chỉ ảnh hưởng vị trí ghi trong file quarantine)
+        unsigned long long content = ZSTD_getFrameContentSize(frame, mf->size - pos);
+        if (content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR) {
+            text = -1;
+        } else if (text >= 0) {
+            text += (long long)content;
+        }
+        pos += compressed;
+    }
+    return 0;
+}
+#endif
+
+int compressed_open(const MappedFile *mf, CompressedInput *ci) {
+    long long capacity = 16;
+
+    memset(ci, 0, sizeof(*ci));
+    ci->kind = compress_detect(mf);
+    if (ci->kind == COMPRESS_NONE) {
+        return 0;
+    }
+#ifndef HAVE_ZLIB
+    if (ci->kind == COMPRESS_GZIP) {
+        fprintf(stderr, "gzip input needs a build with zlib "
+                "(install its headers or make ZLIB_PREFIX=DIR)\n");
+        return -1;
+    }
+#endif
+#ifndef HAVE_ZSTD
+    if (ci->kind == COMPRESS_ZSTD) {
+        fprintf(stderr, "zstd input needs a build with libzstd "
+                "(install its headers or make ZSTD_PREFIX=DIR)\n");
+        return -1;
+    }
+#endif
+
+    ci->start = malloc(capacity * sizeof(off_t));
+    ci->text = malloc(capacity * sizeof(long long));
+    if (ci->start == NULL || ci->text == NULL) {
+        perror("malloc frame list failed");
+        compressed_close(ci);
+        return -1;
+    }
+    int result = 0;
+#ifdef HAVE_ZSTD
+    if (ci->kind == COMPRESS_ZSTD) {
+        result = zstd_list_frames(mf, ci, &capacity);
+    }
+#endif
+    if (ci->kind == COMPRESS_GZIP) {
+        // Member gzip không ghi kích thước nén -> không tách được, cả file là 1 frame
+        result = add_frame(ci, &capacity, 0, 0);
+    }
+    if (result == -1) {
+        compressed_close(ci);
+        return -1;
+    }
+    ci->start[ci->num_frames] = (off_t)mf->size;
+    return 0;
+}
+
+void compressed_close(CompressedInput *ci) {
+    free(ci->start);
+    free(ci->text);
+    memset(ci, 0, sizeof(*ci));
+}
+
+long long compressed_group_end(const CompressedInput *ci, long long first, long long bytes) {
+    long long last = first;
+    long long total = 0;
+
+    while (last < ci->num_frames && (last == first || total < bytes)) {
+        long long text_next = (last + 1 < ci->num_frames) ? ci->text[last + 1] : -1;
+        if (ci->text[last] >= 0 && text_next >= 0) {
+            total += text_next - ci->text[last];
+        } else {
+            total += ci->start[last + 1] - ci->start[last];
+        }
+        last++;
+    }
+    return last;
+}
+
+/*
+ * Hàm: decoder_open
+ * Mục đích: Bộ giải nén bắt đầu tại offset (đầu 1 frame) của file nén
+ */
+static int decoder_open(Decoder *d, CompressKind kind, const MappedFile *mf, off_t offset) {
+    memset(d, 0, sizeof(*d));
+    d->kind = kind;
+    d->data = (const unsigned char *)mf->data;
+    d->pos = offset;
+    d->frame_done = 1;
+#ifdef HAVE_ZLIB
+    if (kind == COMPRESS_GZIP) {
+        // 15 + 32: cửa sổ tối đa, tự nhận header gzip / zlib
+        if (inflateInit2(&d->gz, 15 + 32) != Z_OK) {
+            fprintf(stderr, "inflateInit2 failed\n");
+            return -1;
+        }
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (kind == COMPRESS_ZSTD) {
+        d->zstd = ZSTD_createDCtx();
+        if (d->zstd == NULL) {
+            fprintf(stderr, "ZSTD_createDCtx failed\n");
+            return -1;
+        }
+    }
+#endif
+    return 0;
+}
+
+static void decoder_close(Decoder *d) {
+#ifdef HAVE_ZLIB
+    if (d->kind == COMPRESS_GZIP) {
+        inflateEnd(&d->gz);
+    }
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_freeDCtx(d->zstd);
+#endif
+    memset(d, 0, sizeof(*d));
+}
+
+/*
+ * Hàm: decoder_read
+ * Mục đích: Giải nén tối đa cap bytes, chỉ dùng dữ liệu nén trước offset limit
+ * (biên frame). Trả về số bytes, 0 nếu đã hết [pos, limit) và frame cuối đã xong,
+ * -1 nếu dữ liệu hỏng hoặc frame bị cắt ở limit
+ */
+static ssize_t decoder_read(Decoder *d, char *out, size_t cap, off_t limit) {
+    size_t produced = 0;
+
+#ifdef HAVE_ZLIB
+    if (d->kind == COMPRESS_GZIP) {
+        d->gz.next_out = (unsigned char *)out;
+        d->gz.avail_out = cap;
+        while (d->gz.avail_out > 0 && !(d->pos == (size_t)limit && d->frame_done)) {
+            d->gz.next_in = (unsigned char *)d->data + d->pos;
+            d->gz.avail_in = limit - d->pos;
+            int ret = inflate(&d->gz, Z_NO_FLUSH);
+            d->pos = (const unsigned char *)d->gz.next_in - d->data;
+            if (ret == Z_STREAM_END) {
+                // Nhiều member nối nhau (cat a.gz b.gz): member sau bắt đầu lại từ header
+                d->frame_done = 1;
+                inflateReset(&d->gz);
+            } else if (ret == Z_OK) {
+                d->frame_done = 0;
+            } else {
+                // Z_BUF_ERROR: hết input trước khi hết member
+                fprintf(stderr, "gzip data at byte %zu: %s\n", d->pos,
+                        (ret == Z_BUF_ERROR) ? "truncated" : (d->gz.msg ? d->gz.msg : "error"));
+                return -1;
+            }
+        }
+        produced = cap - d->gz.avail_out;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (d->kind == COMPRESS_ZSTD) {
+        ZSTD_outBuffer output = {out, cap, 0};
+        ZSTD_inBuffer input = {d->data, (size_t)limit, d->pos};
+        while (output.pos < output.size && !(input.pos == input.size && d->frame_done)) {
+            size_t before = output.pos;
+            size_t ret = ZSTD_decompressStream(d->zstd, &output, &input);
+            if (ZSTD_isError(ret)) {
+                fprintf(stderr, "zstd data at byte %zu: %s\n", input.pos, ZSTD_getErrorName(ret));
+                return -1;
+            }
+            d->frame_done = (ret == 0);
+            if (!d->frame_done && input.pos == input.size && output.pos == before) {
+                fprintf(stderr, "zstd data at byte %zu: truncated frame\n", input.pos);
+                return -1;
+            }
+        }
+        d->pos = input.pos;
+        produced = output.pos;
+    }
+#endif
+    (void)d;
+    (void)out;
+    (void)cap;
+    (void)limit;
+    return (ssize_t)produced;
+}
+
+int compressed_read_lines(const MappedFile *mf, const CompressedInput *ci, long long first,
+                          long long last, LineBlockFn fn, void *ctx) {
+    Decoder d;
+    size_t capacity = COMPRESS_BLOCK;
+    size_t len = 0;                          // Bytes chưa giao trong buffer
+    off_t limit = ci->start[last];
+    int skipping = (first > 0);              // Chưa qua '\n' đầu tiên của nhóm
+    int extending = 0;                       // Đã hết nhóm, đang đọc nốt dòng cuối
+    long long position = ci->text[first];    // Offset đã giải nén của buffer[0]
+    int result = 0;
+
+    char *buffer = malloc(capacity);
+    if (buffer == NULL) {
+        perror("malloc decompression buffer failed");
+        return -1;
+    }
+    if (decoder_open(&d, ci->kind, mf, ci->start[first]) == -1) {
+        free(buffer);
+        return -1;
+    }
+
+    for (;;) {
+        if (len == capacity) {
+            // 1 dòng dài hơn cả buffer (input rác): nới buffer, dòng sẽ bị parser loại
+            char *grown = realloc(buffer, capacity * 2);
+            if (grown == NULL) {
+                perror("realloc decompression buffer failed");
+                result = -1;
+                break;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+        size_t want = capacity - len;
+        if (extending && want > COMPRESS_PEEK) {
+            want = COMPRESS_PEEK;
+        }
+        ssize_t n = decoder_read(&d, buffer + len, want, limit);
+        if (n < 0) {
+            result = -1;
+            break;
+        }
+        if (n == 0) {
+            if (skipping) {
+                break;  // Nhóm không có '\n' nào: không dòng nào thuộc về nhóm
+            }
+            if (!extending && last < ci->num_frames) {
+                extending = 1;
+                limit = ci->start[ci->num_frames];
+                continue;
+            }
+            if (len > 0) {
+                fn(ctx, buffer, len, position);  // Dòng cuối file không có '\n'
+            }
+            break;
+        }
+
+        char *fresh = buffer + len;
+        len += n;
+        if (skipping) {
+            char *nl = memchr(fresh, '\n', n);
+            size_t drop = (nl == NULL) ? len : (size_t)(nl + 1 - buffer);
+            memmove(buffer, buffer + drop, len - drop);
+            len -= drop;
+            position = (position >= 0) ? position + (long long)drop : -1;
+            skipping = (nl == NULL);
+            fresh = buffer;
+        }
+        if (extending) {
+            char *nl = memchr(fresh, '\n', buffer + len - fresh);
+            if (nl != NULL) {
+                fn(ctx, buffer, nl + 1 - buffer, position);
+                break;
+            }
+            continue;
+        }
+        char *last_nl = (len > 0) ? memrchr(fresh, '\n', buffer + len - fresh) : NULL;
+        if (last_nl != NULL) {
+            size_t whole = last_nl + 1 - buffer;
+            fn(ctx, buffer, whole, position);
+            memmove(buffer, buffer + whole, len - whole);
+            len -= whole;
+            position = (position >= 0) ? position + (long long)whole : -1;
+        }
+    }
+
+    decoder_close(&d);
+    free(buffer);
+    return result;
+}
@@ -0,0 +1,64 @@
+// compressed_input.h
+// Đọc thẳng file ratings nén gzip / zstd (nhận dạng theo magic bytes, không theo đuôi file)
+// - File nén được map read-only như file text; worker giải nén từng khối COMPRESS_BLOCK
+//   vào buffer riêng và đưa các dòng trọn vẹn cho parser -> không ghi bản giải nén ra
+//   disk, mỗi worker chỉ giữ ~1 khối + 1 dòng
+// - zstd nhiều frame (pzstd, nhiều file .zst nối nhau, split --filter=zstd): mỗi frame
+//   giải nén độc lập -> 1 chunk của work queue = nhóm frame liền nhau, các worker giải
+//   nén song song. gzip và zstd 1 frame không tách được: cả file là 1 nhóm
+// - Dòng vắt qua biên frame: giống biên chunk của file text, 1 dòng thuộc về nhóm chứa
+//   '\n' ngay TRƯỚC nó (dòng đầu file thuộc nhóm đầu) -> nhóm bỏ phần trước '\n' đầu tiên
+//   và giải nén tiếp đầu nhóm sau tới hết dòng cuối của mình
+// Build: -DHAVE_ZLIB (gzip) / -DHAVE_ZSTD (zstd), Makefile tự bật khi tìm thấy header
+#ifndef COMPRESSED_INPUT_H
+#define COMPRESSED_INPUT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "rating_parser.h"
+
+#define COMPRESS_BLOCK (4 << 20)          // Mỗi lần giải nén tối đa 4MB
+#define COMPRESS_PEEK 4096                // Đọc tiếp dòng cuối sang nhóm sau theo bước nhỏ
+
+typedef enum {
+    COMPRESS_NONE,
+    COMPRESS_GZIP,
+    COMPRESS_ZSTD
+} CompressKind;
+
+// Các frame của 1 file nén (gzip: cả file là 1 frame)
+typedef struct {
+    CompressKind kind;
+    long long num_frames;
+    off_t *start;             // start[i]: offset frame i trong file nén, start[num_frames] = size
+    long long *text;          // text[i]: offset đã giải nén của frame i, -1 nếu không biết
+                              // (frame trước đó không ghi content size trong header)
+} CompressedInput;
+
+// Khối các dòng trọn vẹn đã giải nén (dòng cuối file có thể thiếu '\n')
+// position: offset của data[0] trong dữ liệu đã giải nén, -1 nếu không biết
+typedef void (*LineBlockFn)(void *ctx, const char *data, size_t len, long long position);
+
+// Loại nén theo magic bytes đầu file
+CompressKind compress_detect(const MappedFile *mf);
+
+// "gzip", "zstd" ("text" với COMPRESS_NONE)
+const char *compress_name(CompressKind kind);
+
+// Nhận dạng và (zstd) tìm biên các frame. File không nén: kind = COMPRESS_NONE, trả về 0
+// Trả về -1 nếu file hỏng hoặc bản build không hỗ trợ loại nén đó (đã in lỗi)
+int compressed_open(const MappedFile *mf, CompressedInput *ci);
+
+void compressed_close(CompressedInput *ci);
+
+// Nhóm frame [first, last) tới khi đủ ~bytes dữ liệu đã giải nén (frame không ghi
+// content size: tính theo bytes nén). Trả về last (luôn > first)
+long long compressed_group_end(const CompressedInput *ci, long long first, long long bytes);
+
+// Giải nén nhóm frame [first, last) và gọi fn với các khối dòng thuộc nhóm (quy tắc biên
+// ở trên). Trả về 0, -1 nếu dữ liệu hỏng / hết bộ nhớ (đã in lỗi)
+int compressed_read_lines(const MappedFile *mf, const CompressedInput *ci, long long first,
+                          long long last, LineBlockFn fn, void *ctx);
+
+#endif
@@ -0,0 +1,257 @@
+/*
+ * gen_ratings.c
+ * Sinh file ratings giả lập theo format MovieLens (userID \t movieID \t rating \t timestamp)
+ * để benchmark problem1 với kích thước và độ lệch (skew) tùy chỉnh:
+ * - Độ phổ biến của movie theo phân phối Zipf (exponent s, s = 0 -> đều)
+ *   Movie "hot" được xáo trộn ngẫu nhiên trong dải ID, không dồn ở ID nhỏ
+ * - User chọn đều, timestamp tăng dần (giống log ghi thêm) trong khoảng cho trước
+ * - Mỗi movie có 1 "chất lượng" riêng -> average khác nhau giữa các movie
+ * Cùng seed -> cùng file (so sánh được giữa các lần chạy)
+ */
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ROWS 1000000
+#define DEFAULT_USERS 100000
+#define DEFAULT_MOVIES 20000
+#define DEFAULT_ZIPF 1.0
+#define DEFAULT_SEED 42
+#define DEFAULT_TS_START 946684800LL   //  2000-01-01
+#define DEFAULT_TS_END 1577836800LL     //  2020-01-01
+#define WRITE_BUFFER_SIZE (1 << 20)
+
+// Tham số sinh dữ liệu (đọc từ command line)
+typedef struct {
+    long long rows;
+    int users;
+    int movies;
+    double zipf;           // Exponent Zipf của độ phổ biến movie
+    uint64_t seed;
+    long long ts_start;
+    long long ts_end;
+    int half_stars;        // 1: rating bước 0.5 (MovieLens 10M+), 0: số nguyên 1..5
+    const char *output;
+} GenOptions;
+
+/*
+ * Hàm: next_random
+ * Mục đích: xorshift64* - nhanh, đủ tốt cho dữ liệu benchmark, không phụ thuộc libc
+ */
+static inline uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Số thực đều trong [0, 1)
+static inline double next_unit(uint64_t *state) {
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * Hàm: build_zipf_cdf
+ * Mục đích: cdf[k] = P(rank <= k) với P(rank = k) tỉ lệ 1 / (k + 1)^s
+ */
+static double *build_zipf_cdf(int n, double s) {
+    double *cdf = malloc((size_t)n * sizeof(double));
+    if (cdf == NULL) {
+        return NULL;
+    }
+    double total = 0;
+    for (int k = 0; k < n; k++) {
+        total += 1.0 / pow(k + 1, s);
+        cdf[k] = total;
+    }
+    for (int k = 0; k < n; k++) {
+        cdf[k] /= total;
+    }
+    cdf[n - 1] = 1.0;
+    return cdf;
+}
+
+/*
+ * Hàm: sample_rank
+ * Mục đích: Rank đầu tiên có cdf >= u (tìm nhị phân, O(log n))
+ */
+static inline int sample_rank(const double *cdf, int n, double u) {
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (cdf[mid] < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Hàm: generate
+ * Mục đích: Ghi opts->rows dòng vào out. Trả về 0 nếu thành công
+ */
+static int generate(const GenOptions *opts, FILE *out) {
+    uint64_t state = opts->seed ? opts->seed : 1;
+    double *cdf = build_zipf_cdf(opts->movies, opts->zipf);
+    int *movie_of_rank = malloc((size_t)opts->movies * sizeof(int));
+    double *quality = malloc((size_t)opts->movies * sizeof(double));
+    if (cdf == NULL || movie_of_rank == NULL || quality == NULL) {
+        perror("malloc failed");
+        free(cdf);
+        free(movie_of_rank);
+        free(quality);
+        return -1;
+    }
+
+    // Rank -> movieID: hoán vị ngẫu nhiên (Fisher-Yates); chất lượng movie trong [2.0, 4.5]
+    for (int k = 0; k < opts->movies; k++) {
+        movie_of_rank[k] = k + 1;
+        quality[k] = 2.0 + 2.5 * next_unit(&state);
+    }
+    for (int k = opts->movies - 1; k > 0; k--) {
+        int j = (int)(next_random(&state) % (uint64_t)(k + 1));
+        int tmp = movie_of_rank[k];
+        movie_of_rank[k] = movie_of_rank[j];
+        movie_of_rank[j] = tmp;
+    }
+
+    double step = (double)(opts->ts_end - opts->ts_start) / (double)opts->rows;
+    for (long long i = 0; i < opts->rows; i++) {
+        int movie = movie_of_rank[sample_rank(cdf, opts->movies, next_unit(&state))];
+        int user = 1 + (int)(next_random(&state) % (uint64_t)opts->users);
+        long long ts = opts->ts_start + (long long)(step * i + step * next_unit(&state));
+
+        // Rating = chất lượng movie + nhiễu [-1.5, 1.5], làm tròn theo bước 1 hoặc 0.5
+        double r = quality[movie - 1] + 3.0 * next_unit(&state) - 1.5;
+        int scale = opts->half_stars ? 2 : 1;
+        int units = (int)floor(r * scale + 0.5);
+        if (units < 1) {
+            units = 1;
+        }
+        if (units > 5 * scale) {
+            units = 5 * scale;
+        }
+
+        if (opts->half_stars) {
+            fprintf(out, "%d\t%d\t%d.%d\t%lld\n", user, movie, units / 2, (units % 2) * 5, ts);
+        } else {
+            fprintf(out, "%d\t%d\t%d\t%lld\n", user, movie, units, ts);
+        }
+    }
+
+    free(cdf);
+    free(movie_of_rank);
+    free(quality);
+    return ferror(out) ? -1 : 0;
+}
+
+/*
+ * Hàm: print_usage
+ * Mục đích: In hướng dẫn sử dụng
+ */
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] -o <output.txt>\n", prog);
+    fprintf(stderr, "  -n, --rows N         Number of ratings (default %d)\n", DEFAULT_ROWS);
+    fprintf(stderr, "  -u, --users N        Number of users (default %d)\n", DEFAULT_USERS);
+    fprintf(stderr, "  -m, --movies N       Number of movies (default %d)\n", DEFAULT_MOVIES);
+    fprintf(stderr, "  -z, --zipf S         Zipf exponent of movie popularity, 0 = uniform (default %.1f)\n",
+            DEFAULT_ZIPF);
+    fprintf(stderr, "  -s, --seed N         Random seed (default %d)\n", DEFAULT_SEED);
+    fprintf(stderr, "      --ts-start T     First timestamp (default %lld)\n", DEFAULT_TS_START);
+    fprintf(stderr, "      --ts-end T       Last timestamp (default %lld)\n", DEFAULT_TS_END);
+    fprintf(stderr, "      --half-stars     Ratings in 0.5 steps instead of whole stars\n");
+    fprintf(stderr, "  -o, --output FILE    Output file (- for stdout)\n");
+}
+
+int main(int argc, char *argv[]) {
+    GenOptions opts = {DEFAULT_ROWS, DEFAULT_USERS, DEFAULT_MOVIES, DEFAULT_ZIPF, DEFAULT_SEED,
+                       DEFAULT_TS_START, DEFAULT_TS_END, 0, NULL};
+
+    static const struct option long_options[] = {
+        {"rows", required_argument, NULL, 'n'},
+        {"users", required_argument, NULL, 'u'},
+        {"movies", required_argument, NULL, 'm'},
+        {"zipf", required_argument, NULL, 'z'},
+        {"seed", required_argument, NULL, 's'},
+        {"ts-start", required_argument, NULL, 'A'},
+        {"ts-end", required_argument, NULL, 'B'},
+        {"half-stars", no_argument, NULL, 'H'},
+        {"output", required_argument, NULL, 'o'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:u:m:z:s:o:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            opts.rows = atoll(optarg);
+            break;
+        case 'u':
+            opts.users = atoi(optarg);
+            break;
+        case 'm':
+            opts.movies = atoi(optarg);
+            break;
+        case 'z':
+            opts.zipf = atof(optarg);
+            break;
+        case 's':
+            opts.seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'A':
+            opts.ts_start = atoll(optarg);
+            break;
+        case 'B':
+            opts.ts_end = atoll(optarg);
+            break;
+        case 'H':
+            opts.half_stars = 1;
+            break;
+        case 'o':
+            opts.output = optarg;
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (opts.output == NULL || opts.rows < 1 || opts.users < 1 || opts.movies < 1 ||
+        opts.zipf < 0 || opts.ts_end < opts.ts_start) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    FILE *out = strcmp(opts.output, "-") == 0 ? stdout : fopen(opts.output, "w");
+    if (out == NULL) {
+        perror("Cannot create output file");
+        return 1;
+    }
+    setvbuf(out, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+
+    int result = generate(&opts, out);
+    if (out != stdout && fclose(out) != 0) {
+        result = -1;
+    }
+    if (result != 0) {
+        fprintf(stderr, "ERROR: Failed to write %s\n", opts.output);
+        return 1;
+    }
+    fprintf(stderr, "✓ Generated %lld ratings (%d users, %d movies, zipf %.2f) to %s\n",
+            opts.rows, opts.users, opts.movies, opts.zipf, opts.output);
+    return 0;
+}
@@ -0,0 +1,62 @@
+// hll.h
+// HyperLogLog: ước lượng số user KHÁC NHAU của mỗi movie (--distinct) với bộ nhớ cố định
+// 2^bits register (1 byte) / movie, không phụ thuộc số ratings. Sai số chuẩn ~1.04 / sqrt(2^bits)
+// - Hash 64-bit của userID: bits cao chọn register, phần còn lại cho rank = vị trí bit 1 đầu tiên
+// - register = max(register, rank) -> cùng user cập nhật lại không đổi gì
+// - Gộp 2 sketch = max từng register (table_max_u8) -> merge slab / thread như bộ đếm
+#ifndef HLL_H
+#define HLL_H
+
+#include <math.h>
+#include <stdint.h>
+
+#define HLL_MIN_BITS 4             // 16 register / movie (~26% sai số)
+#define HLL_MAX_BITS 14            // 16KB / movie (~0.8% sai số)
+#define HLL_DEFAULT_BITS 8         // 256 bytes / movie (~6.5% sai số)
+
+/*
+ * Hàm: hll_hash
+ * Mục đích: Trộn bit userID (splitmix64 finalizer) -> mọi bit phân bố đều
+ */
+static inline uint64_t hll_hash(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Register của hash: bits bit cao nhất
+static inline int hll_register(uint64_t hash, int bits) {
+    return (int)(hash >> (64 - bits));
+}
+
+// Rank: số bit 0 đứng đầu của phần còn lại + 1 (chặn ở 64 - bits + 1 nếu toàn 0)
+static inline uint8_t hll_rank(uint64_t hash, int bits) {
+    uint64_t rest = hash << bits;
+    return (uint8_t)(rest == 0 ? 64 - bits + 1 : __builtin_clzll(rest) + 1);
+}
+
+/*
+ * Hàm: hll_estimate
+ * Mục đích: Số phần tử khác nhau ước lượng từ 2^bits register
+ * Ít phần tử (còn register = 0 và ước lượng <= 2.5m) -> linear counting chính xác hơn
+ */
+static inline double hll_estimate(const uint8_t *regs, int bits) {
+    int m = 1 << bits;
+    double alpha = (m == 16) ? 0.673 : (m == 32) ? 0.697 : (m == 64) ? 0.709
+                                     : 0.7213 / (1.0 + 1.079 / m);
+    double inv_sum = 0;
+    int zeros = 0;
+
+    for (int r = 0; r < m; r++) {
+        inv_sum += ldexp(1.0, -regs[r]);
+        zeros += (regs[r] == 0);
+    }
+    double estimate = alpha * m * m / inv_sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log((double)m / zeros);
+    }
+    return estimate;
+}
+
+#endif
@@ -0,0 +1,125 @@
+// hot_keys.h
+// Phát hiện movie "hot" của 1 worker (-m hot). Độ phổ biến movie theo Zipf nên vài trăm
+// movie nhận phần lớn ratings -> mọi worker cùng ghi vài cache line đó của bảng chung
+// - Chunk đầu tiên: lấy mẫu 1 / HOT_SAMPLE_EVERY movieID (mẫu nằm trong bộ nhớ riêng)
+// - Hết chunk đầu: tối đa HOT_MAX_KEYS movie nhiều mẫu nhất, mỗi movie chiếm
+//   >= 1 / HOT_MIN_SHARE số mẫu, được đưa vào bảng băm nhỏ (movieID -> slot)
+// - Sau đó worker tra slot cho mỗi rating: có slot -> cộng vào bộ đếm riêng
+// Mỗi worker tự chọn tập hot của mình -> không cần đồng bộ giữa các worker
+#ifndef HOT_KEYS_H
+#define HOT_KEYS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "topk.h"
+
+#define HOT_MAX_KEYS 256           // Số movie hot tối đa của 1 worker
+#define HOT_TABLE_BITS 10          // Bảng băm 1024 ô (load <= 25% -> thường 1 lần dò)
+#define HOT_TABLE_SIZE (1 << HOT_TABLE_BITS)
+#define HOT_SAMPLE_EVERY 4         // Lấy mẫu 1 / 4 rating của chunk đầu
+#define HOT_MAX_SAMPLES 32768      // Số mẫu tối đa (đủ cho chunk 4MB ~ 170k dòng)
+#define HOT_MIN_SHARE 1024         // Hot nếu chiếm >= 1 / 1024 số mẫu
+#define HOT_MIN_SAMPLES 2          // ... và có ít nhất 2 mẫu (bỏ nhiễu khi ít mẫu)
+
+typedef struct {
+    int sampling;                  // 1: đang lấy mẫu (chunk đầu), 0: đã chọn tập hot
+    int tick;                      // Đếm rating giữa 2 lần lấy mẫu
+    int num_samples;
+    int num_hot;                   // Số movie hot (slot 0..num_hot-1)
+    int key[HOT_TABLE_SIZE];       // movieID của ô băm (0 = trống)
+    int slot[HOT_TABLE_SIZE];      // Slot của movie ở ô đó
+    int hot_id[HOT_MAX_KEYS];      // hot_id[s]: movieID của slot s
+    int samples[HOT_MAX_SAMPLES];
+} HotKeys;
+
+// Ô băm đầu tiên của movieID (Fibonacci hashing)
+static inline unsigned int hot_hash(int movie_id) {
+    return ((uint32_t)movie_id * 2654435761u) >> (32 - HOT_TABLE_BITS);
+}
+
+/*
+ * Hàm: hot_keys_init
+ * Mục đích: Tập hot rỗng, bắt đầu lấy mẫu
+ */
+static inline void hot_keys_init(HotKeys *hot) {
+    memset(hot, 0, sizeof(*hot));
+    hot->sampling = 1;
+}
+
+/*
+ * Hàm: hot_keys_sample
+ * Mục đích: Ghi nhận 1 rating của movie_id trong lúc lấy mẫu
+ */
+static inline void hot_keys_sample(HotKeys *hot, int movie_id) {
+    if (++hot->tick == HOT_SAMPLE_EVERY) {
+        hot->tick = 0;
+        if (hot->num_samples < HOT_MAX_SAMPLES) {
+            hot->samples[hot->num_samples++] = movie_id;
+        }
+    }
+}
+
+/*
+ * Hàm: hot_keys_slot
+ * Mục đích: Slot của movie_id, -1 nếu không hot (dò tuyến tính tới ô trống)
+ */
+static inline int hot_keys_slot(const HotKeys *hot, int movie_id) {
+    if (hot->num_hot == 0) {
+        return -1;
+    }
+    for (unsigned int h = hot_hash(movie_id);; h = (h + 1) & (HOT_TABLE_SIZE - 1)) {
+        if (hot->key[h] == movie_id) {
+            return hot->slot[h];
+        }
+        if (hot->key[h] == 0) {
+            return -1;
+        }
+    }
+}
+
+static int hot_compare_ids(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Hàm: hot_keys_select
+ * Mục đích: Kết thúc lấy mẫu: sắp xếp mẫu, đếm theo movie, giữ top HOT_MAX_KEYS
+ * (min-heap của topk.h) qua ngưỡng HOT_MIN_SHARE rồi đưa vào bảng băm
+ * Trả về số movie hot
+ */
+static inline int hot_keys_select(HotKeys *hot) {
+    TopEntry heap[HOT_MAX_KEYS];
+    int size = 0;
+
+    hot->sampling = 0;
+    qsort(hot->samples, hot->num_samples, sizeof(int), hot_compare_ids);
+    for (int i = 0; i < hot->num_samples;) {
+        int j = i;
+        while (j < hot->num_samples && hot->samples[j] == hot->samples[i]) {
+            j++;
+        }
+        long long count = j - i;
+        if (count >= HOT_MIN_SAMPLES && count * HOT_MIN_SHARE >= hot->num_samples) {
+            TopEntry item = {hot->samples[i], count, 0.0, (double)count};
+            topk_push(heap, &size, HOT_MAX_KEYS, &item);
+        }
+        i = j;
+    }
+
+    for (int s = 0; s < size; s++) {
+        unsigned int h = hot_hash(heap[s].id);
+        while (hot->key[h] != 0) {
+            h = (h + 1) & (HOT_TABLE_SIZE - 1);
+        }
+        hot->key[h] = heap[s].id;
+        hot->slot[h] = s;
+        hot->hot_id[s] = heap[s].id;
+    }
+    hot->num_hot = size;
+    return size;
+}
+
+#endif
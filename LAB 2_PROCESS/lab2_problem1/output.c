@@ -0,0 +1,202 @@
+/*
+ * output.c
+ * Formatter cho bảng kết quả: không parse format string như printf,
+ * số nguyên đổi sang chữ số 2 chữ số / lần bằng bảng tra
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+
+// "00" "01" ... "99": mỗi lần chia cho 100 ghi được 2 chữ số
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const int64_t pow10_table[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+void out_init(OutBuf *out, size_t initial) {
+    out->data = malloc(initial > 0 ? initial : 1);
+    out->len = 0;
+    out->cap = (out->data != NULL) ? (initial > 0 ? initial : 1) : 0;
+    out->failed = (out->data == NULL);
+}
+
+void out_free(OutBuf *out) {
+    free(out->data);
+    out->data = NULL;
+    out->len = 0;
+    out->cap = 0;
+}
+
+int out_reserve(OutBuf *out, size_t n) {
+    if (out->failed) {
+        return -1;
+    }
+    if (out->len + n <= out->cap) {
+        return 0;
+    }
+    size_t cap = out->cap * 2;
+    if (cap < out->len + n) {
+        cap = out->len + n;
+    }
+    char *data = realloc(out->data, cap);
+    if (data == NULL) {
+        out->failed = 1;
+        return -1;
+    }
+    out->data = data;
+    out->cap = cap;
+    return 0;
+}
+
+void out_mem(OutBuf *out, const char *s, size_t n) {
+    if (out_reserve(out, n) == 0) {
+        memcpy(out->data + out->len, s, n);
+        out->len += n;
+    }
+}
+
+void out_str(OutBuf *out, const char *s) {
+    out_mem(out, s, strlen(s));
+}
+
+/*
+ * Hàm: format_u64
+ * Mục đích: Ghi chữ số của value vào CUỐI buf (từ phải sang trái)
+ * Trả về vị trí chữ số đầu tiên
+ */
+static char *format_u64(char *buf_end, uint64_t value) {
+    char *p = buf_end;
+    while (value >= 100) {
+        unsigned int pair = (unsigned int)(value % 100) * 2;
+        value /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        unsigned int pair = (unsigned int)value * 2;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    } else {
+        *--p = (char)('0' + value);
+    }
+    return p;
+}
+
+/*
+ * Hàm: format_i64
+ * Mục đích: Như format_u64 nhưng có dấu (không tràn với INT64_MIN)
+ */
+static char *format_i64(char *buf_end, int64_t value) {
+    if (value >= 0) {
+        return format_u64(buf_end, (uint64_t)value);
+    }
+    char *p = format_u64(buf_end, 0 - (uint64_t)value);
+    *--p = '-';
+    return p;
+}
+
+void out_i64(OutBuf *out, int64_t value) {
+    char buf[24];
+    char *p = format_i64(buf + sizeof(buf), value);
+    out_mem(out, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+void out_i64_right(OutBuf *out, int64_t value, int width) {
+    char buf[24];
+    char *p = format_i64(buf + sizeof(buf), value);
+    int len = (int)(buf + sizeof(buf) - p);
+    for (int i = len; i < width; i++) {
+        out_char(out, ' ');
+    }
+    out_mem(out, p, (size_t)len);
+}
+
+/*
+ * Hàm: out_fixed
+ * Mục đích: Ghi whole.frac với frac có đúng decimals chữ số (thêm 0 ở đầu)
+ */
+static void out_fixed(OutBuf *out, uint64_t whole, uint64_t frac, int decimals) {
+    char buf[24];
+    char *p = format_u64(buf + sizeof(buf), whole);
+    out_mem(out, p, (size_t)(buf + sizeof(buf) - p));
+    if (decimals <= 0) {
+        return;
+    }
+    out_char(out, '.');
+    p = format_u64(buf + sizeof(buf), frac);
+    for (int i = (int)(buf + sizeof(buf) - p); i < decimals; i++) {
+        out_char(out, '0');
+    }
+    out_mem(out, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+void out_ratio(OutBuf *out, int64_t num, int64_t den, int decimals) {
+    uint64_t scale = (uint64_t)pow10_table[decimals];
+    uint64_t whole = (uint64_t)(num / den);
+    uint64_t rem = (uint64_t)(num % den);
+
+    // rem < den nên rem * scale không tràn khi den < 2^64 / 10^decimals
+    uint64_t scaled = rem * scale;
+    uint64_t frac = scaled / (uint64_t)den;
+    uint64_t left = scaled % (uint64_t)den;
+
+    // Làm tròn nửa về chẵn trên giá trị CHÍNH XÁC num / den. printf làm tròn bản
+    // xấp xỉ double nên có thể lệch 1 ở chữ số cuối khi giá trị đúng bằng ...5
+    if (left * 2 > (uint64_t)den || (left * 2 == (uint64_t)den && (frac & 1))) {
+        frac++;
+        if (frac == scale) {
+            frac = 0;
+            whole++;
+        }
+    }
+    out_fixed(out, whole, frac, decimals);
+}
+
+void out_double(OutBuf *out, double value, int decimals) {
+    uint64_t scale = (uint64_t)pow10_table[decimals];
+    uint64_t scaled = (uint64_t)(value * (double)scale + 0.5);
+    out_fixed(out, scaled / scale, scaled % scale, decimals);
+}
+
+void out_pad(OutBuf *out, size_t field_start, int width) {
+    while (out->len < field_start + (size_t)width) {
+        out_char(out, ' ');
+        if (out->failed) {
+            return;
+        }
+    }
+}
+
+int out_write(OutBuf *out, int fd) {
+    size_t done = 0;
+    int result = out->failed ? -1 : 0;
+
+    while (result == 0 && done < out->len) {
+        ssize_t n = write(fd, out->data + done, out->len - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result = -1;
+        } else {
+            done += (size_t)n;
+        }
+    }
+    out->len = 0;
+    return result;
+}
@@ -0,0 +1,56 @@
+// output.h
+// Ghi kết quả vào 1 buffer lớn bằng formatter số nguyên / fixed-point viết tay,
+// cuối cùng ghi ra fd bằng 1 lần write() (thay cho 1 printf mỗi dòng)
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;            // 1 nếu realloc lỗi (nội dung sau đó bị bỏ)
+} OutBuf;
+
+// Khởi tạo buffer với dung lượng ban đầu (tự lớn lên khi cần)
+void out_init(OutBuf *out, size_t initial);
+
+// Giải phóng buffer
+void out_free(OutBuf *out);
+
+// Đảm bảo còn chỗ cho thêm n bytes. Trả về 0 nếu được, -1 nếu hết bộ nhớ
+int out_reserve(OutBuf *out, size_t n);
+
+// Thêm chuỗi / n bytes
+void out_str(OutBuf *out, const char *s);
+void out_mem(OutBuf *out, const char *s, size_t n);
+
+// Số nguyên có dấu
+void out_i64(OutBuf *out, int64_t value);
+
+// Số nguyên căn phải trong độ rộng width (giống "%*lld")
+void out_i64_right(OutBuf *out, int64_t value, int width);
+
+// num / den (num >= 0, den > 0) làm tròn tới decimals chữ số thập phân (giống "%.*f"),
+// tính hoàn toàn bằng số nguyên
+void out_ratio(OutBuf *out, int64_t num, int64_t den, int decimals);
+
+// Số thực >= 0 với decimals chữ số thập phân (decimals <= 9)
+void out_double(OutBuf *out, double value, int decimals);
+
+// Thêm dấu cách cho tới khi trường bắt đầu tại field_start đủ width ký tự (căn trái)
+void out_pad(OutBuf *out, size_t field_start, int width);
+
+// Ghi toàn bộ buffer ra fd (1 lần write, lặp lại nếu bị ghi thiếu) rồi làm rỗng buffer
+// Trả về 0 nếu thành công, -1 nếu lỗi
+int out_write(OutBuf *out, int fd);
+
+static inline void out_char(OutBuf *out, char c) {
+    if (out->len < out->cap || out_reserve(out, 1) == 0) {
+        out->data[out->len++] = c;
+    }
+}
+
+#endif
@@ -1,47 +1,475 @@
 /*
  * Lab 2 - Problem 1: Movie Rating with Shared Memory
- * Tính average rating CHO TỪNG MOVIE từ 2 files bằng 2 child processes
+ * Tính average rating CHO TỪNG MOVIE từ 1 hoặc nhiều files bằng N child processes
+ * Mỗi file được chia thành các chunk (mặc định 4MB, căn theo dòng) trong 1 work queue
+ * ở shared memory; worker lấy chunk từ queue của mình, hết thì lấy (steal) của worker khác
  * Sử dụng Shared Memory để chia sẻ dữ liệu
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 
-// Số lượng movies tối đa (theo đề: 1682 movies)
-#define MAX_MOVIES 1682
-#define SHM_KEY 0x1234
-#define TOP_N 30           //  Số lượng top movies muốn hiển thị
-#define MIN_RATINGS 50     //  Số ratings tối thiểu để được xét
+#include "rating_parser.h"
+#include "rating_columnar.h"
+#include "checkpoint.h"
+#include "table_merge.h"
+#include "output.h"
+#include "shm_segment.h"
+#include "time_bucket.h"
+#include "topk.h"
+#include "hot_keys.h"
+#include "hll.h"
+#include "similarity.h"
+#include "spill.h"
+#include "worker_profile.h"
+#include "quarantine.h"
+#include "compressed_input.h"
+#include "query_server.h"
+
+// movieID lớn nhất chấp nhận được. Kích thước bảng thực tế = movieID lớn nhất
+// tìm được ở pass quét đầu tiên (100k: 1682, MovieLens-25M: ~209k)
+#define MAX_MOVIE_ID 10000000
+#define MAX_USER_ID 100000000
+#define SHM_KEY 0x1234           //  Key của backend SysV
+#define SHM_FOLLOW_NAME "/problem1"  //  Tên POSIX mặc định của --follow (--query tìm tên này)
+#define TOP_N 30           //  Số lượng top movies hiển thị mặc định (--top)
+#define MIN_RATINGS 50     //  Số ratings tối thiểu mặc định để được xét (--min-ratings)
 #define DISPLAY_FIRST_N 1682     //  Số movies hiển thị ở đầu
+#define DISPLAY_FIRST_USERS 50   //  Số users hiển thị ở đầu
+#define NUM_STARS 5        //  Rating từ 0.5 đến 5 sao (số cột histogram khi hiển thị)
+#define NUM_BUCKETS (NUM_STARS * RATING_SCALE)  //  Histogram theo nửa sao: 0.5, 1.0, ..., 5.0
+#define DEFAULT_WORKERS 2  //  Số child processes mặc định (-j)
+#define MAX_WORKERS 256    //  Giới hạn số child processes
+#define DEFAULT_POLL_MS 500      //  Chu kỳ kiểm tra file mới ghi thêm (--follow)
+#define FOLLOW_BUFFER_SIZE (1 << 20)  //  Mỗi lần pread tối đa 1MB phần ghi thêm
+#define FOLLOW_ID_HEADROOM 2     //  --follow: bảng lớn gấp 2 ID lớn nhất đã quét
+#define CHECKPOINT_INTERVAL_MS 5000   //  --follow: ghi checkpoint tối đa 1 lần / 5s
+#define DEFAULT_CHUNK_SIZE (4 << 20)  //  Kích thước 1 chunk trong work queue (bytes)
+#define MIN_CHUNK_SIZE 4096
+// 1 dòng .rcol = user_id + movie_id + timestamp (uint32) + rating (uint8)
+#define RCOL_ROW_BYTES (3 * sizeof(uint32_t) + sizeof(uint8_t))
+#define MAX_TIME_BUCKETS 20000   //  Giới hạn số bucket thời gian (--bucket day: ~55 năm)
+#define DISPLAY_LAST_BUCKETS 12  //  Số bucket gần nhất hiển thị trong bảng
+#define SERVE_MAX_RETRIES 1000   //  --serve: số lần đọc lại tối đa khi writer đang ghi
+#define SEQ_SPIN_MAX 100000      //  Số lần yield tối đa chờ writer ghi xong (seq lẻ)
+#ifndef BUILD_FLAGS
+#define BUILD_FLAGS "unknown"    //  Cờ tối ưu của bản build (Makefile truyền vào), cột build của CSV
+#endif
+#define SPILL_OUT_FLUSH (1 << 20)  //  --spill: ghi kết quả ra fd mỗi khi buffer đạt 1MB
+
+// Chế độ cập nhật shared memory của các child
+typedef enum {
+    MODE_LOCK,             // Tất cả child ghi chung 1 bảng, lock mỗi rating
+    MODE_LOCKFREE,         // Mỗi child ghi vào slab riêng, parent merge sau
+    MODE_HOT,              // Bảng chung bằng atomic add, movie hot đếm riêng từng worker
+    MODE_CSR,              // Pass 2 của --similar: chỉ ghi rating vào CSR theo user
+    MODE_SPILL             // --spill: ghi rating vào run file theo partition, không có bảng
+} AggregateMode;
+
+// Cách chạy các worker
+typedef enum {
+    ENGINE_PROCESS,        // fork N child, dùng chung bảng qua shared memory (mặc định)
+    ENGINE_THREAD          // N pthread trong cùng process, mỗi thread ghim 1 core
+} Engine;
+
+// Cách xếp hạng top movies
+typedef enum {
+    RANK_MEAN,             // Theo average (mặc định)
+    RANK_BAYES             // Theo Bayesian average (kéo movie ít ratings về mean chung)
+} RankMode;
+
+// Tham số của display_top_movies (đọc từ command line)
+typedef struct {
+    int top_k;             // Số movies hiển thị
+    int min_ratings;       // Số ratings tối thiểu để được xét
+    RankMode rank;
+    int prior;             // Trọng số prior của RANK_BAYES (số "rating ảo" bằng mean)
+    int window;            // --window: top movies trong N bucket gần nhất (0 = không)
+} TopOptions;
+
+// Cách đọc file input
+typedef enum {
+    PARSER_STDIO,          // stdio: getline + parse_rating_line (đọc qua buffer của FILE)
+    PARSER_MMAP,           // mmap + parser viết tay (mặc định)
+    PARSER_FSCANF          // fscanf("%d\t%d\t%lf\t%d") như bản gốc, chỉ để benchmark
+} ParserKind;
+
+static const char *parser_name(ParserKind parser) {
+    return parser == PARSER_MMAP ? "mmap" : parser == PARSER_STDIO ? "stdio" : "fscanf";
+}
+
+// Format kết quả (--format)
+typedef enum {
+    FORMAT_TABLE,          // Bảng cho người đọc (mặc định)
+    FORMAT_CSV,            // 1 dòng / movie cho công cụ khác đọc
+    FORMAT_JSON            // movies, users, top
+} OutputFormat;
+
+// --quiet: child không in Started / Progress / Completed
+static int quiet = 0;
+
+// Các bảng tổng hợp dạng struct-of-arrays, tất cả được điền trong CÙNG 1 lần đọc:
+// - Theo movie (index = movieID - 1): sum, count, histogram nửa sao 0.5..5.0
+// - Theo user  (index = userID - 1):  sum, count
+// Không lưu ID (suy ra từ index) và is_used (count > 0)
+// Vòng lặp cập nhật/merge chỉ chạm vào đúng mảng cần -> ít cache line hơn
+// Sum tính theo đơn vị nửa sao (RATING_SCALE) -> cộng số nguyên, không mất 0.5
+// Mọi bộ đếm 64-bit: không tràn với hàng tỉ ratings
+// --bucket: thêm sum, count theo (bucket thời gian, movie) -> query cửa sổ thời gian
+// chỉ cộng vài bucket, không phải đọc lại input
+// --distinct: thêm 1 sketch HyperLogLog (2^hll_bits byte) mỗi movie -> số user khác nhau
+typedef int64_t Counter;
 
-// Cấu trúc lưu thông tin rating của TỪNG MOVIE
 typedef struct {
-    int movieID;           // ID của movie (1 - 1682)
-    int sum_ratings;    // TỔNG các ratings của movie này
-    int count;             // SỐ LƯỢNG ratings của movie này
-    int is_used;           // Flag đánh dấu movie này có data không
-} MovieData;
+    Counter *sum;              // sum[i]: TỔNG ratings (nửa sao) của movie i+1
+    Counter *count;            // count[i]: SỐ LƯỢNG ratings của movie i+1
+    Counter *hist[NUM_BUCKETS]; // hist[b][i]: số rating (b+1) nửa sao của movie i+1
+    Counter *user_sum;         // user_sum[u]: TỔNG ratings (nửa sao) của user u+1
+    Counter *user_count;       // user_count[u]: SỐ LƯỢNG ratings của user u+1
+    Counter *bucket_sum;       // bucket_sum[t * movie_stride + i]: TỔNG ratings của movie i+1
+    Counter *bucket_count;     // trong bucket thời gian thứ t (NULL nếu không --bucket)
+    uint8_t *hll;              // hll[(i << hll_bits) + r]: register r của movie i+1 (NULL nếu không --distinct)
+} AggTables;
 
-// Cấu trúc của shared memory - chứa DATA CỦA TẤT CẢ MOVIES
+// Cấu trúc của shared memory - chứa DATA CỦA TẤT CẢ MOVIES/USERS
+// Kích thước bảng chỉ biết lúc chạy nên các mảng nằm liên tiếp trong data[].
+// Mỗi bộ bảng (AggTables) chiếm table_ints phần tử Counter:
+//   [sum][count][hist 0.5..5.0]  mỗi mảng movie_stride phần tử
+//   [user_sum][user_count]   mỗi mảng user_stride phần tử
+//   [bucket_sum][bucket_count]  mỗi mảng num_time_buckets * movie_stride phần tử
+//   [hll]  movie_stride * 2^hll_bits byte (movie_stride chia hết cho 8 -> vẫn căn 64 bytes)
+// Phần Counter merge bằng phép cộng, phần hll bằng max (merge_table_set)
+// Bộ 0 là bảng chính, bộ i + 1 là slab riêng của child i (MODE_LOCKFREE).
+// Mọi mảng đều căn 64 bytes -> 2 child không bao giờ ghi chung cache line,
+// và lock (ở header) nằm riêng 1 cache line với data
+// Dùng shared_movies() / shared_slab() để lấy AggTables
+// Sau các bộ bảng (ở queue_offset) là work queue: WorkCursor[num_workers],
+// WorkerStats[num_workers], WorkChunk[num_chunks] (xem work_cursors() ...)
 typedef struct {
-    MovieData movies[MAX_MOVIES];  // Mảng 1682 movies
     int lock;                       // Simple lock để tránh race condition
+    int num_movies;                 // Số movie = movieID lớn nhất (index = movieID - 1)
+    int num_users;                  // Số user = userID lớn nhất (index = userID - 1)
+    int num_slabs;                  // Số slab riêng phía sau (0 ở MODE_LOCK)
+    int movie_stride;               // Số phần tử mỗi mảng movie (>= num_movies, căn 64 bytes)
+    int user_stride;                // Số phần tử mỗi mảng user (>= num_users, căn 64 bytes)
+    size_t table_ints;              // Số phần tử Counter của 1 bộ bảng
+    int ready;                      // 1 khi bảng chính đã có kết quả (process khác query được)
+    long long updates;              // Số lần bảng chính được cập nhật ở --follow
+    volatile unsigned int seq;      // Seqlock của bảng chính ở --follow (lẻ = đang ghi)
+    int num_workers;                // Số cursor / stats trong work queue
+    int num_chunks;                 // Số chunk trong work queue
+    size_t queue_offset;            // Offset (bytes) của work queue tính từ đầu segment
+    int bucket_kind;                // BucketKind của --bucket (BUCKET_NONE = không chia)
+    int num_time_buckets;           // Số bucket thời gian trong bảng
+    long long bucket_base;          // Số thứ tự tuyệt đối (time_bucket) của bucket 0
+    long long since;                // Chỉ tính rating có timestamp trong [since, until]
+    long long until;
+    int hll_bits;                   // --distinct: 2^hll_bits register HLL / movie (0 = không)
+    Counter data[] __attribute__((aligned(64)));
 } SharedData;
 
+// 1 chunk công việc: đoạn [start, end) của file thứ file
+// (bytes với file text, số dòng với file .rcol, số frame với file nén)
+typedef struct {
+    int file;
+    off_t start;
+    off_t end;
+} WorkChunk;
+
+// Các chunk CHƯA lấy của 1 worker: [head, tail) gói trong 1 word 64-bit
+// (head ở 32 bit cao) để chủ lấy từ đầu, worker khác lấy trộm từ cuối
+// chỉ bằng 1 lệnh CAS, không cần lock. Mỗi cursor 1 cache line riêng
+typedef struct {
+    volatile uint64_t range;
+} __attribute__((aligned(64))) WorkCursor;
+
+// Thống kê của 1 worker (mỗi worker 1 cache line riêng -> không false sharing)
+typedef struct {
+    double busy_ms;                 // Tổng thời gian xử lý chunk
+    long long rows;                 // Số dòng đã đọc
+    int chunks;                     // Số chunk đã xử lý (kể cả lấy trộm)
+    int stolen;                     // Số chunk lấy trộm của worker khác
+    int cpu;                        // Core được ghim (-1 nếu không ghim)
+    int node;                       // NUMA node của core đó (-1 nếu không rõ)
+    long long lock_contended;       // Số lần acquire_lock phải chờ (MODE_LOCK)
+    int hot_keys;                   // Số movie hot đã chọn (MODE_HOT)
+    long long hot_rows;             // Số rating cộng vào bộ đếm riêng của movie hot
+    long long spill_rows;           // Số rating ghi vào run file (MODE_SPILL)
+    long long spill_sum;            // Tổng các rating đó (nửa sao)
+    long long rejected[REJECT_KINDS];  // Số dòng bị loại theo lý do
+#ifdef PROFILE
+    WorkerProfile prof;             // Bộ đếm hot loop (make profile, xem worker_profile.h)
+#endif
+} __attribute__((aligned(64))) WorkerStats;
+
+// Số mảng theo movie trong 1 bộ bảng: sum, count, hist[NUM_BUCKETS]
+#define MOVIE_ARRAYS (2 + NUM_BUCKETS)
+// Số mảng theo user trong 1 bộ bảng: user_sum, user_count
+#define USER_ARRAYS 2
+
+// Kết quả pass quét: ID lớn nhất -> kích thước bảng
+// min_ts / max_ts: khoảng timestamp (chỉ quét khi có --bucket, INT_MAX / INT_MIN nếu rỗng)
+typedef struct {
+    int max_user_id;
+    int max_movie_id;
+    int min_ts;
+    int max_ts;
+} IdBounds;
+
+// Số liệu 1 lần chạy (TIMING REPORT và --report-csv)
+typedef struct {
+    Engine engine;
+    AggregateMode mode;
+    ParserKind parser;
+    ShmBackend shm_backend;
+    ShmHugeMode shm_huge;
+    int num_workers;
+    double scan_ms;
+    double ingest_ms;
+    double merge_ms;
+    double sim_ms;                 // --similar: pass 2 + CSR theo movie + láng giềng (0 nếu không)
+    long long total_ratings;       // Chỉ ratings đọc ở lần chạy này (không tính checkpoint)
+    long long total_bytes;
+    long peak_rss_kb;
+    long long lock_contended;
+} RunReport;
+
+// Thông tin 1 file input (parent lấy size trước khi fork)
+typedef struct {
+    const char *name;
+    off_t size;
+    MappedFile map;        // Dùng với PARSER_MMAP hoặc file .rcol (map trước khi fork)
+    int columnar;          // 1 nếu là file nhị phân .rcol
+    RcolView cols;         // Các cột của file .rcol (chia đoạn theo số dòng)
+    CompressedInput compressed;  // File gzip / zstd: các frame (chia đoạn theo số frame)
+    off_t start;           // Phần đã có trong checkpoint: bytes (text) / số dòng (.rcol)
+} InputFile;
+
+
+/*
+ * Hàm: stride_for
+ * Mục đích: Số phần tử mỗi mảng, làm tròn để mỗi mảng bắt đầu ở đầu cache line
+ */
+int stride_for(int n) {
+    int per_line = 64 / sizeof(Counter);
+    return (n + per_line - 1) / per_line * per_line;
+}
+
+/*
+ * Hàm: counter_ints_for
+ * Mục đích: Số phần tử Counter (cộng được) của 1 bộ bảng: movie + user + bucket thời gian
+ */
+size_t counter_ints_for(int num_movies, int num_users, int num_time_buckets) {
+    return (size_t)(MOVIE_ARRAYS + 2 * num_time_buckets) * stride_for(num_movies) +
+           (size_t)USER_ARRAYS * stride_for(num_users);
+}
+
+/*
+ * Hàm: table_ints_for
+ * Mục đích: Số phần tử Counter của 1 bộ bảng, kể cả vùng register HLL phía sau
+ */
+size_t table_ints_for(int num_movies, int num_users, int num_time_buckets, int hll_bits) {
+    size_t hll_bytes = hll_bits > 0 ? (size_t)stride_for(num_movies) << hll_bits : 0;
+    return counter_ints_for(num_movies, num_users, num_time_buckets) +
+           hll_bytes / sizeof(Counter);
+}
+
+/*
+ * Hàm: shared_data_size
+ * Mục đích: Size shared memory cần cho bảng chính + num_slabs slab riêng
+ */
+size_t shared_data_size(int num_movies, int num_users, int num_time_buckets, int hll_bits,
+                        int num_slabs) {
+    return sizeof(SharedData) + (size_t)(num_slabs + 1) *
+           table_ints_for(num_movies, num_users, num_time_buckets, hll_bits) * sizeof(Counter);
+}
+
+// Số phần tử Counter cộng được của 1 bộ bảng trong shared_data
+static inline size_t table_counter_ints(const SharedData *shared_data) {
+    return counter_ints_for(shared_data->num_movies, shared_data->num_users,
+                            shared_data->num_time_buckets);
+}
+
+/*
+ * Hàm: table_view
+ * Mục đích: Các mảng của 1 bộ bảng bắt đầu tại base (table_ints phần tử,
+ * cùng layout với bảng trong shared memory)
+ */
+static inline AggTables table_view(const SharedData *shared_data, Counter *base) {
+    AggTables tables;
+    int ms = shared_data->movie_stride;
+    
+    tables.sum = base;
+    tables.count = base + ms;
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+        tables.hist[b] = base + (size_t)(2 + b) * ms;
+    }
+    tables.user_sum = base + (size_t)MOVIE_ARRAYS * ms;
+    tables.user_count = tables.user_sum + shared_data->user_stride;
+    if (shared_data->num_time_buckets > 0) {
+        tables.bucket_sum = tables.user_sum + (size_t)USER_ARRAYS * shared_data->user_stride;
+        tables.bucket_count = tables.bucket_sum + (size_t)shared_data->num_time_buckets * ms;
+    } else {
+        tables.bucket_sum = NULL;
+        tables.bucket_count = NULL;
+    }
+    tables.hll = (shared_data->hll_bits > 0)
+        ? (uint8_t *)(base + table_counter_ints(shared_data)) : NULL;
+    return tables;
+}
+
+/*
+ * Hàm: merge_table_set
+ * Mục đích: Gộp bộ bảng src vào dst (cùng layout): cộng phần Counter,
+ * max từng register HLL (cả 2 bằng SIMD, table_merge.c)
+ */
+void merge_table_set(const SharedData *shared_data, Counter *dst, const Counter *src) {
+    size_t counters = table_counter_ints(shared_data);
+    
+    table_add_i64(dst, src, counters);
+    if (shared_data->hll_bits > 0) {
+        table_max_u8((uint8_t *)(dst + counters), (const uint8_t *)(src + counters),
+                     (shared_data->table_ints - counters) * sizeof(Counter));
+    }
+}
+
+/*
+ * Hàm: shared_table
+ * Mục đích: Bộ bảng thứ t trong data[] (0 = bảng chính, i + 1 = slab của child i)
+ */
+static inline AggTables shared_table(SharedData *shared_data, int t) {
+    return table_view(shared_data, shared_data->data + (size_t)t * shared_data->table_ints);
+}
+
+/*
+ * Hàm: shared_movies / shared_slab
+ * Mục đích: Bảng chính / slab riêng của child thứ i (0-based)
+ */
+static inline AggTables shared_movies(SharedData *shared_data) {
+    return shared_table(shared_data, 0);
+}
+
+static inline AggTables shared_slab(SharedData *shared_data, int i) {
+    return shared_table(shared_data, i + 1);
+}
+
+/*
+ * Hàm: work_queue_size
+ * Mục đích: Size của work queue đặt sau các bộ bảng
+ */
+size_t work_queue_size(int num_workers, int num_chunks) {
+    return (size_t)num_workers * (sizeof(WorkCursor) + sizeof(WorkerStats)) +
+           (size_t)num_chunks * sizeof(WorkChunk);
+}
+
+/*
+ * Hàm: work_cursors / worker_stats / work_chunks
+ * Mục đích: Các phần của work queue trong shared memory
+ */
+static inline WorkCursor *work_cursors(SharedData *shared_data) {
+    return (WorkCursor *)((char *)shared_data + shared_data->queue_offset);
+}
+
+static inline WorkerStats *worker_stats(SharedData *shared_data) {
+    return (WorkerStats *)(work_cursors(shared_data) + shared_data->num_workers);
+}
+
+static inline WorkChunk *work_chunks(SharedData *shared_data) {
+    return (WorkChunk *)(worker_stats(shared_data) + shared_data->num_workers);
+}
+
+/*
+ * Hàm: worker_table
+ * Mục đích: Bảng mà child process_id ghi vào theo mode
+ */
+static inline AggTables worker_table(SharedData *shared_data, AggregateMode mode,
+                                     int process_id) {
+    return (mode == MODE_LOCKFREE) ? shared_slab(shared_data, process_id - 1)
+                                   : shared_movies(shared_data);
+}
+
+
+// Số lần acquire_lock gặp lock đang bị giữ, của worker hiện tại
+// (__thread: mỗi child / thread 1 bộ đếm riêng -> đếm không gây thêm tranh chấp)
+static __thread long long lock_contended = 0;
+
+// MODE_HOT: bộ đếm riêng của worker cho các movie hot (index = slot trong keys)
+// Histogram theo [nửa sao][slot] giống bảng chung
+typedef struct {
+    HotKeys keys;
+    Counter sum[HOT_MAX_KEYS];
+    Counter count[HOT_MAX_KEYS];
+    Counter hist[NUM_BUCKETS][HOT_MAX_KEYS];
+} HotCounters;
+
+// Bộ đếm hot của worker hiện tại (NULL nếu không phải MODE_HOT)
+static __thread HotCounters *hot_counters = NULL;
+
+// --similar: CSR dùng chung của pass 2 (MODE_CSR), tạo trước khi fork
+static SimIndex *sim_index = NULL;
+
+// --spill: cách chia partition (parent tính trước khi fork) và bộ ghi của worker hiện tại
+static SpillLayout *spill_layout = NULL;
+static __thread SpillWriter *spill_writer = NULL;
+
+// --spill: trả page của input đã đọc xong cho kernel (madvise) -> RSS không tăng theo input
+static int release_input = 0;
+
+// --quarantine: fd dùng chung (O_APPEND, mở trước khi fork, -1 = tắt) và bộ ghi của
+// worker hiện tại; số dòng bị loại theo lý do của worker hiện tại
+static int quarantine_fd = -1;
+static __thread QuarantineWriter *quarantine = NULL;
+static __thread long long reject_counts[REJECT_KINDS];
+
+/*
+ * Hàm: mode_name
+ * Mục đích: Tên mode như trong -m (để in báo cáo)
+ */
+const char *mode_name(AggregateMode mode) {
+    switch (mode) {
+    case MODE_LOCKFREE:
+        return "lockfree";
+    case MODE_HOT:
+        return "hot";
+    case MODE_CSR:
+        return "csr";
+    case MODE_SPILL:
+        return "spill";
+    default:
+        return "lock";
+    }
+}
 
 /*
  * Hàm: acquire_lock
  * Mục đích: Lock để tránh 2 processes cập nhật cùng lúc
  */
 void acquire_lock(volatile int *lock) {
-    while (__sync_lock_test_and_set(lock, 1)) {
-        // Busy wait
+    PROF_ADD(lock_acquires, 1);
+    if (__sync_lock_test_and_set(lock, 1)) {
+        lock_contended++;
+        while (__sync_lock_test_and_set(lock, 1)) {
+            // Busy wait
+            PROF_ADD(lock_spins, 1);
+        }
     }
 }
 
@@ -53,327 +481,4133 @@ void release_lock(volatile int *lock) {
     __sync_lock_release(lock);
 }
 
+/*
+ * Hàm: seq_write_begin / seq_write_end
+ * Mục đích: Seqlock của bảng chính. Chỉ có 1 writer (parent --follow): tăng seq lên
+ * số lẻ trước khi ghi, lên số chẵn sau khi ghi xong -> không bao giờ phải chờ reader
+ */
+static inline void seq_write_begin(SharedData *shared_data) {
+    shared_data->seq++;
+    __sync_synchronize();
+}
+
+static inline void seq_write_end(SharedData *shared_data) {
+    __sync_synchronize();
+    shared_data->seq++;
+}
+
+/*
+ * Hàm: seq_read_begin / seq_read_retry
+ * Mục đích: Reader (-q, --serve) chờ seq chẵn, đọc bản sao, rồi kiểm tra seq không đổi;
+ * đổi (writer đã ghi xen vào) -> bỏ bản sao và đọc lại
+ * seq_read_begin trả về -1 nếu seq vẫn lẻ sau SEQ_SPIN_MAX lần yield
+ */
+static inline int seq_read_begin(const SharedData *shared_data, unsigned int *seq) {
+    int spins = 0;
+    while ((*seq = shared_data->seq) & 1) {
+        if (++spins > SEQ_SPIN_MAX) {
+            return -1;  // Writer chết giữa lần ghi: seq lẻ mãi mãi -> caller báo "busy"
+        }
+        sched_yield();
+    }
+    __sync_synchronize();
+    return 0;
+}
+
+static inline int seq_read_retry(const SharedData *shared_data, unsigned int seq) {
+    __sync_synchronize();
+    return shared_data->seq != seq;
+}
+
+
+/*
+ * Hàm: now_ms
+ * Mục đích: Lấy thời gian hiện tại (milliseconds, monotonic) để đo hiệu năng
+ */
+double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+
+/*
+ * Hàm: split_range
+ * Mục đích: Chia [0, size) thành n đoạn gần bằng nhau, trả về đoạn thứ i
+ * Ranh giới chưa căn theo dòng: calculate_average() tự căn khi đọc
+ */
+void split_range(off_t size, int i, int n, off_t *start, off_t *end) {
+    *start = (off_t)((long long)size * i / n);
+    *end = (off_t)((long long)size * (i + 1) / n);
+}
+
+
+/*
+ * Hàm: input_limit
+ * Mục đích: Vị trí cuối của input: size (file text), số dòng (.rcol) hoặc số frame (file nén)
+ */
+off_t input_limit(const InputFile *input) {
+    if (input->compressed.kind != COMPRESS_NONE) {
+        return (off_t)input->compressed.num_frames;
+    }
+    return input->columnar ? (off_t)input->cols.num_rows : input->size;
+}
+
+/*
+ * Hàm: input_offset
+ * Mục đích: Byte offset trong file ứng với vị trí pos (theo đơn vị của input_limit)
+ */
+off_t input_offset(const InputFile *input, off_t pos) {
+    if (input->compressed.kind != COMPRESS_NONE) {
+        return input->compressed.start[pos];
+    }
+    return input->columnar ? pos * (off_t)RCOL_ROW_BYTES : pos;
+}
+
+/*
+ * Hàm: input_range
+ * Mục đích: Đoạn thứ i / n của phần CHƯA đọc [input->start, input_limit)
+ * File .rcol chia theo số dòng, file nén theo số frame, file text theo bytes
+ */
+void input_range(const InputFile *input, int i, int n, off_t *start, off_t *end) {
+    split_range(input_limit(input) - input->start, i, n, start, end);
+    *start += input->start;
+    *end += input->start;
+}
+
+/*
+ * Hàm: skip_line
+ * Mục đích: Bỏ qua phần còn lại của dòng hiện tại (tới sau ký tự '\n')
+ */
+void skip_line(FILE *file) {
+    int c;
+    while ((c = getc(file)) != EOF && c != '\n') {
+    }
+}
+
+
+/*
+ * Hàm: in_time_range
+ * Mục đích: Timestamp có nằm trong [since, until] (--since / --until) không?
+ */
+static inline int in_time_range(const SharedData *shared_data, long long timestamp) {
+    return timestamp >= shared_data->since && timestamp <= shared_data->until;
+}
+
+/*
+ * Hàm: rating_bucket
+ * Mục đích: Index bucket thời gian (trong bảng) của rating có timestamp này
+ * Trả về -1 nếu không --bucket hoặc timestamp nằm ngoài các bucket của bảng
+ */
+static inline int rating_bucket(const SharedData *shared_data, long long timestamp) {
+    if (shared_data->num_time_buckets == 0) {
+        return -1;
+    }
+    long long t = time_bucket(timestamp, (BucketKind)shared_data->bucket_kind) -
+                  shared_data->bucket_base;
+    return (t >= 0 && t < shared_data->num_time_buckets) ? (int)t : -1;
+}
+
+/*
+ * Hàm: update_tables
+ * Mục đích: Cộng 1 rating (đã validate, đơn vị nửa sao) vào bảng movie,
+ * histogram, bảng user và bucket thời gian (bucket = -1: không có)
+ *
+ * MODE_LOCK:     tables = bảng chính, lock cho MỖI rating
+ * MODE_LOCKFREE: tables = slab riêng của child, không lock
+ * MODE_HOT:      tables = bảng chính, atomic add; movie hot cộng vào hot_counters
+ * MODE_CSR:      bảng không đổi, rating được ghi vào hàng của user trong sim_index
+ * MODE_SPILL:    bảng không đổi, rating được ghi vào buffer partition của spill_writer
+ */
+static inline void update_tables(SharedData *shared_data, AggTables tables,
+                                 AggregateMode mode, int user_id, int movie_id, int rating,
+                                 int bucket) {
+    // Index trong mảng = ID - 1 (vì array bắt đầu từ 0)
+    int index = movie_id - 1;
+    int user = user_id - 1;
+    size_t cell = (size_t)bucket * shared_data->movie_stride + index;
+    uint8_t *reg = NULL;  // --distinct: register HLL của (movie, user) và rank cần ghi
+    uint8_t rank = 0;
+    
+    if (mode == MODE_CSR) {
+        sim_add(sim_index, user, index, rating);
+        return;
+    }
+    if (mode == MODE_SPILL) {
+        if (spill_add(spill_writer, user, index, rating) == -1) {
+            exit(1);
+        }
+        return;
+    }
+    if (tables.hll != NULL) {
+        uint64_t hash = hll_hash((uint64_t)user_id);
+        reg = tables.hll + ((size_t)index << shared_data->hll_bits) +
+              hll_register(hash, shared_data->hll_bits);
+        rank = hll_rank(hash, shared_data->hll_bits);
+    }
+    
+    if (mode == MODE_LOCKFREE) {
+        // Slab riêng của child này -> cập nhật trực tiếp, không lock
+        tables.sum[index] += rating;
+        tables.count[index]++;
+        tables.hist[rating - 1][index]++;
+        tables.user_sum[user] += rating;
+        tables.user_count[user]++;
+        if (bucket >= 0) {
+            tables.bucket_sum[cell] += rating;
+            tables.bucket_count[cell]++;
+        }
+        if (reg != NULL && *reg < rank) {
+            *reg = rank;
+        }
+    } else if (mode == MODE_HOT) {
+        // Movie hot: bộ đếm riêng -> không tranh cache line với worker khác
+        HotCounters *hot = hot_counters;
+        int slot = hot_keys_slot(&hot->keys, movie_id);
+        if (slot >= 0) {
+            hot->sum[slot] += rating;
+            hot->count[slot]++;
+            hot->hist[rating - 1][slot]++;
+        } else {
+            __sync_fetch_and_add(&tables.sum[index], rating);
+            __sync_fetch_and_add(&tables.count[index], 1);
+            __sync_fetch_and_add(&tables.hist[rating - 1][index], 1);
+            if (hot->keys.sampling) {
+                hot_keys_sample(&hot->keys, movie_id);
+            }
+        }
+        // User và bucket thời gian phân tán đều hơn: luôn cộng thẳng vào bảng chung
+        __sync_fetch_and_add(&tables.user_sum[user], rating);
+        __sync_fetch_and_add(&tables.user_count[user], 1);
+        if (bucket >= 0) {
+            __sync_fetch_and_add(&tables.bucket_sum[cell], rating);
+            __sync_fetch_and_add(&tables.bucket_count[cell], 1);
+        }
+        // Register chỉ tăng và hiếm khi đổi (rank lớn có xác suất nhỏ) -> CAS khi cần
+        if (reg != NULL) {
+            uint8_t old = *reg;
+            while (old < rank) {
+                uint8_t seen = __sync_val_compare_and_swap(reg, old, rank);
+                if (seen == old) {
+                    break;
+                }
+                old = seen;
+            }
+        }
+    } else {
+        // ========================================
+        // QUAN TRỌNG: Acquire lock trước khi cập nhật
+        // Vì nhiều child processes có thể cập nhật CÙNG movie/user đồng thời
+        // ========================================
+        acquire_lock(&shared_data->lock);
+        
+        // Cập nhật sum, count, histogram CHO MOVIE NÀY và sum, count CHO USER NÀY
+        tables.sum[index] += rating;  
+        tables.count[index]++;
+        tables.hist[rating - 1][index]++;
+        tables.user_sum[user] += rating;
+        tables.user_count[user]++;
+        if (bucket >= 0) {
+            tables.bucket_sum[cell] += rating;
+            tables.bucket_count[cell]++;
+        }
+        if (reg != NULL && *reg < rank) {
+            *reg = rank;
+        }
+        
+        // Release lock
+        release_lock(&shared_data->lock);
+    }
+}
+
+
+/*
+ * Hàm: row_reject_reason
+ * Mục đích: Lý do loại dòng có ID / rating (nửa sao) ngoài bảng, -1 nếu hợp lệ
+ * (long long: ID đọc từ cột uint32 của .rcol không bị đổi dấu)
+ */
+static inline int row_reject_reason(const SharedData *shared_data, long long user_id,
+                                    long long movie_id, int rating) {
+    if (user_id < 1 || user_id > shared_data->num_users) {
+        return REJECT_USER_ID;
+    }
+    if (movie_id < 1 || movie_id > shared_data->num_movies) {
+        return REJECT_MOVIE_ID;
+    }
+    if (rating < 1 || rating > NUM_BUCKETS) {
+        return REJECT_RATING;
+    }
+    return -1;
+}
+
+/*
+ * Hàm: reject_row
+ * Mục đích: Đếm dòng bị loại theo lý do và (--quarantine) chép dòng gốc vào file
+ * quarantine. Không in gì: input bẩn không làm hot loop chậm đi vì printf
+ * position: byte offset của dòng (file text) hoặc số thứ tự dòng (.rcol)
+ */
+static void reject_row(RejectReason reason, const char *source, long long position,
+                       const char *row, size_t len) {
+    reject_counts[reason]++;
+    PROF_ADD(rows_rejected, 1);
+    if (quarantine != NULL &&
+        quarantine_add(quarantine, reason, source, position, row, len) == -1) {
+        exit(1);
+    }
+}
+
+/*
+ * Hàm: row_length
+ * Mục đích: Độ dài dòng bắt đầu tại line, không tính '\n' (next: đầu dòng kế tiếp)
+ */
+static inline size_t row_length(const char *line, const char *next) {
+    return (size_t)(next - line) - (next > line && next[-1] == '\n');
+}
+
+
+/*
+ * Hàm: calculate_average_stdio
+ * Mục đích: Đọc đoạn [start, end) của file bằng stdio và cập nhật shared memory
+ * CHO TỪNG MOVIE (-p stdio: đọc qua buffer của FILE thay vì mmap, cùng parser)
+ * 
+ * ĐÂY LÀ PHẦN QUAN TRỌNG NHẤT:
+ * - Đọc từng dòng
+ * - Xác định movieID
+ * - Cập nhật sum và count CHO MOVIE ĐÓ trong shared memory
+ *
+ * Quy tắc chia đoạn: 1 dòng thuộc về đoạn chứa byte ĐẦU TIÊN của dòng đó.
+ * -> Nếu start không phải đầu dòng thì bỏ qua dòng dở dang (đoạn trước đã đọc nó)
+ * -> Đọc tiếp các dòng có vị trí bắt đầu < end (dòng cuối có thể vượt quá end)
+ * Đọc nguyên dòng (getline) rồi parse bằng parse_rating_line như parser mmap: cùng
+ * ngữ pháp -> cùng dòng bị loại, cùng kết quả với mọi -p; dòng sai định dạng chỉ bị
+ * loại, không làm dừng cả đoạn như fscanf trên stream
+ */
+int calculate_average_stdio(const char *filename, off_t start, off_t end,
+                            SharedData *shared_data, AggTables tables, int process_id,
+                            AggregateMode mode) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("[Child %d - PID %d] ERROR: Cannot open file %s\n", 
+               process_id, getpid(), filename);
+        exit(1);
+    }
+    
+    if (!quiet) {
+        printf("[Child %d - PID %d] Started reading %s [%lld, %lld)\n", 
+               process_id, getpid(), filename, (long long)start, (long long)end);
+    }
+    
+    // Căn start về đầu dòng: xem byte ngay trước start có phải '\n' không
+    if (start > 0) {
+        fseeko(file, start - 1, SEEK_SET);
+        if (getc(file) != '\n') {
+            skip_line(file);
+        }
+    }
+    
+    RatingRow row;
+    int ok;
+    int lines_read = 0;
+    int malformed = 0;
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t len;
+    off_t position = ftello(file);
+    
+    // Đọc từng dòng trong đoạn
+    // Format: userID <tab> movieID <tab> rating <tab> timestamp
+    while (position < end && (len = getline(&line, &capacity, file)) != -1) {
+        off_t line_start = position;
+        size_t row_len = row_length(line, line + len);
+        position += len;
+        
+        parse_rating_line(line, line + len, &row, &ok);
+        if (!ok) {
+            malformed++;
+            reject_row(REJECT_MALFORMED, filename, line_start, line, row_len);
+            continue;
+        }
+        lines_read++;
+        
+        // userID, movieID trong bảng, rating từ 0.5 đến 5 (1..NUM_BUCKETS nửa sao)
+        int reason = row_reject_reason(shared_data, row.user_id, row.movie_id, row.rating);
+        if (reason >= 0) {
+            reject_row(reason, filename, line_start, line, row_len);
+            continue;
+        }
+        
+        // Ngoài --since / --until: bỏ qua, không phải lỗi
+        if (!in_time_range(shared_data, row.timestamp)) {
+            continue;
+        }
+        
+        PROF_UPDATE(update_tables(shared_data, tables, mode, row.user_id, row.movie_id,
+                                  row.rating, rating_bucket(shared_data, row.timestamp)));
+        
+        // In progress mỗi 10000 dòng
+        if (!quiet && lines_read % 10000 == 0) {
+            printf("[Child %d] Progress: %d lines processed...\n", 
+                   process_id, lines_read);
+        }
+    }
+    
+    free(line);
+    fclose(file);
+    PROF_ADD(rows_parsed, lines_read + malformed);
+    if (!quiet) {
+        printf("[Child %d - PID %d] Completed: Read %d lines from %s", 
+               process_id, getpid(), lines_read, filename);
+        if (malformed > 0) {
+            printf(" (%d malformed lines skipped)", malformed);
+        }
+        printf("\n");
+    }
+    return lines_read;
+}
+
+
+/*
+ * Hàm: calculate_average_fscanf
+ * Mục đích: (-p fscanf) Vòng fscanf("%d\t%d\t%lf\t%d") của bản gốc trên đoạn [start, end),
+ * giữ lại làm mốc cho make bench-parser (MB/s của parser mmap / stdio so với bản gốc)
+ * - Cùng quy tắc chia đoạn và cùng kiểm tra rating / ID như calculate_average_stdio
+ * - "\n" cuối format ăn luôn ký tự xuống dòng -> ftello() là đầu dòng kế tiếp
+ * - Dòng sai định dạng làm fscanf dừng: bỏ phần còn lại của đoạn (như bản gốc)
+ *   -> không dùng cho dữ liệu bẩn, không ghi quarantine
+ */
+int calculate_average_fscanf(const char *filename, off_t start, off_t end,
+                             SharedData *shared_data, AggTables tables, int process_id,
+                             AggregateMode mode) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("[Child %d - PID %d] ERROR: Cannot open file %s\n", 
+               process_id, getpid(), filename);
+        exit(1);
+    }
+    
+    if (start > 0) {
+        fseeko(file, start - 1, SEEK_SET);
+        if (getc(file) != '\n') {
+            skip_line(file);
+        }
+    }
+    
+    int user_id, movie_id, timestamp;
+    double rating;
+    int lines_read = 0;
+    int matched = 0;
+    while (ftello(file) < end &&
+           (matched = fscanf(file, "%d\t%d\t%lf\t%d\n", &user_id, &movie_id, &rating,
+                             &timestamp)) == 4) {
+        lines_read++;
+        // Làm tròn xuống bội số 0.5, ngoài [0.5, 5] -> 0 (bị loại với lý do rating)
+        int half_stars = (rating < 1.0 / RATING_SCALE || rating > NUM_STARS)
+            ? 0 : (int)(rating * RATING_SCALE);
+        if (row_reject_reason(shared_data, user_id, movie_id, half_stars) >= 0 ||
+            !in_time_range(shared_data, timestamp)) {
+            continue;
+        }
+        PROF_UPDATE(update_tables(shared_data, tables, mode, user_id, movie_id, half_stars,
+                                  rating_bucket(shared_data, timestamp)));
+    }
+    if (matched != 4 && matched != EOF && ftello(file) < end) {
+        fprintf(stderr, "[Child %d] WARNING: fscanf stopped at a malformed row in %s "
+                "(offset %lld), rest of the chunk skipped\n",
+                process_id, filename, (long long)ftello(file));
+    }
+    
+    fclose(file);
+    PROF_ADD(rows_parsed, lines_read);
+    return lines_read;
+}
+
+/*
+ * Hàm: parse_text_lines
+ * Mục đích: Vòng parse của parser mmap: đọc các dòng bắt đầu trong [p, range_end)
+ * (dòng cuối có thể kéo tới file_end) của buffer data, cộng vào *lines_read / *malformed
+ * base: offset của data[0] trong input (vị trí ghi vào quarantine), -1 nếu không biết
+ */
+static inline void parse_text_lines(const char *source, const char *data, const char *p,
+                                    const char *range_end, const char *file_end,
+                                    long long base, SharedData *shared_data,
+                                    AggTables tables, int process_id, AggregateMode mode,
+                                    int *lines_read, int *malformed) {
+    RatingRow row;
+    int ok;
+    int lines = *lines_read;
+    
+    while (p < range_end) {
+        const char *line = p;
+        p = parse_rating_line(p, file_end, &row, &ok);
+        if (!ok) {
+            // Dòng sai định dạng: loại và đọc tiếp từ dòng sau
+            (*malformed)++;
+            reject_row(REJECT_MALFORMED, source, base < 0 ? -1 : base + (line - data), line,
+                       row_length(line, p));
+            continue;
+        }
+        lines++;
+        
+        // userID, movieID trong bảng, rating từ 0.5 đến 5 (1..NUM_BUCKETS nửa sao)
+        int reason = row_reject_reason(shared_data, row.user_id, row.movie_id, row.rating);
+        if (reason >= 0) {
+            reject_row(reason, source, base < 0 ? -1 : base + (line - data), line,
+                       row_length(line, p));
+            continue;
+        }
+        
+        // Ngoài --since / --until: bỏ qua, không phải lỗi
+        if (!in_time_range(shared_data, row.timestamp)) {
+            continue;
+        }
+        
+        PROF_UPDATE(update_tables(shared_data, tables, mode, row.user_id, row.movie_id,
+                                  row.rating, rating_bucket(shared_data, row.timestamp)));
+        
+        // In progress mỗi 10000 dòng
+        if (!quiet && lines % 10000 == 0) {
+            printf("[Child %d] Progress: %d lines processed...\n", 
+                   process_id, lines);
+        }
+    }
+    *lines_read = lines;
+}
+
+/*
+ * Hàm: calculate_average_mmap
+ * Mục đích: Giống calculate_average_stdio nhưng parse trực tiếp trên vùng nhớ
+ * đã mmap (zero-copy) bằng parser số nguyên viết tay trong rating_parser.h
+ * Cùng quy tắc chia đoạn: bỏ dòng dở dang ở đầu, đọc các dòng bắt đầu < end
+ */
+int calculate_average_mmap(const InputFile *input, off_t start, off_t end,
+                           SharedData *shared_data, AggTables tables, int process_id,
+                           AggregateMode mode) {
+    if (!quiet) {
+        printf("[Child %d - PID %d] Started reading %s [%lld, %lld) (mmap)\n", 
+               process_id, getpid(), input->name, (long long)start, (long long)end);
+    }
+    
+    const char *data = input->map.data;
+    const char *p = data + start;
+    const char *file_end = data + input->map.size;
+    
+    // Căn start về đầu dòng
+    if (start > 0 && p[-1] != '\n') {
+        p = next_line(p, file_end);
+    }
+    
+    int lines_read = 0;
+    int malformed = 0;
+    parse_text_lines(input->name, data, p, data + end, file_end, 0, shared_data, tables,
+                     process_id, mode, &lines_read, &malformed);
+    
+    PROF_ADD(rows_parsed, lines_read + malformed);
+    if (!quiet) {
+        printf("[Child %d - PID %d] Completed: Read %d lines from %s", 
+               process_id, getpid(), lines_read, input->name);
+        if (malformed > 0) {
+            printf(" (%d malformed lines skipped)", malformed);
+        }
+        printf("\n");
+    }
+    return lines_read;
+}
+
+
+// Trạng thái của calculate_average_compressed giữa các khối đã giải nén
+typedef struct {
+    const char *source;
+    SharedData *shared_data;
+    AggTables tables;
+    int process_id;
+    AggregateMode mode;
+    int lines_read;
+    int malformed;
+} CompressedParse;
+
+/*
+ * Hàm: parse_decompressed_block
+ * Mục đích: (LineBlockFn) Parse 1 khối dòng trọn vẹn vừa giải nén
+ */
+static void parse_decompressed_block(void *ctx, const char *data, size_t len,
+                                     long long position) {
+    CompressedParse *c = ctx;
+    parse_text_lines(c->source, data, data, data + len, data + len, position, c->shared_data,
+                     c->tables, c->process_id, c->mode, &c->lines_read, &c->malformed);
+}
+
+/*
+ * Hàm: calculate_average_compressed
+ * Mục đích: Giải nén nhóm frame [first, last) của file gzip / zstd theo khối vào buffer
+ * riêng của worker và parse bằng cùng vòng lặp với parser mmap
+ * (quy tắc dòng ở biên frame: xem compressed_input.h)
+ */
+int calculate_average_compressed(const InputFile *input, long long first, long long last,
+                                 SharedData *shared_data, AggTables tables, int process_id,
+                                 AggregateMode mode) {
+    if (!quiet) {
+        printf("[Child %d - PID %d] Started reading %s frames [%lld, %lld) (%s)\n", 
+               process_id, getpid(), input->name, first, last,
+               compress_name(input->compressed.kind));
+    }
+    
+    CompressedParse ctx = {input->name, shared_data, tables, process_id, mode, 0, 0};
+    if (compressed_read_lines(&input->map, &input->compressed, first, last,
+                              parse_decompressed_block, &ctx) == -1) {
+        fprintf(stderr, "ERROR: Cannot decompress %s\n", input->name);
+        exit(1);
+    }
+    
+    PROF_ADD(rows_parsed, ctx.lines_read + ctx.malformed);
+    if (!quiet) {
+        printf("[Child %d - PID %d] Completed: Read %d lines from %s", 
+               process_id, getpid(), ctx.lines_read, input->name);
+        if (ctx.malformed > 0) {
+            printf(" (%d malformed lines skipped)", ctx.malformed);
+        }
+        printf("\n");
+    }
+    return ctx.lines_read;
+}
+
+
+/*
+ * Hàm: calculate_average_columnar
+ * Mục đích: Cập nhật shared memory từ các dòng [row_start, row_end) của file .rcol
+ * Không cần parse: userID, movieID và rating đọc thẳng từ các cột đã map
+ */
+int calculate_average_columnar(const InputFile *input, uint64_t row_start, uint64_t row_end,
+                               SharedData *shared_data, AggTables tables, int process_id,
+                               AggregateMode mode) {
+    if (!quiet) {
+        printf("[Child %d - PID %d] Started reading %s rows [%llu, %llu) (columnar)\n", 
+               process_id, getpid(), input->name,
+               (unsigned long long)row_start, (unsigned long long)row_end);
+    }
+    
+    const uint32_t *user_col = input->cols.user_id;
+    const uint32_t *movie_col = input->cols.movie_id;
+    const uint8_t *rating_col = input->cols.rating;
+    const uint32_t *ts_col = input->cols.timestamp;
+    int lines_read = 0;
+    
+    for (uint64_t i = row_start; i < row_end; i++) {
+        uint32_t user_id = user_col[i];
+        uint32_t movie_id = movie_col[i];
+        int rating = rating_col[i];
+        lines_read++;
+        
+        // userID, movieID trong bảng, rating từ 0.5 đến 5 (1..NUM_BUCKETS nửa sao)
+        int reason = row_reject_reason(shared_data, user_id, movie_id, rating);
+        if (reason >= 0) {
+            // Không có dòng text gốc: quarantine dòng dựng lại từ các cột
+            char text[64];
+            int len = snprintf(text, sizeof(text), "%u\t%u\t%g\t%u", user_id, movie_id,
+                               (double)rating / RATING_SCALE, ts_col[i]);
+            reject_row(reason, input->name, (long long)i, text, len);
+            continue;
+        }
+        
+        // Ngoài --since / --until: bỏ qua, không phải lỗi
+        if (!in_time_range(shared_data, ts_col[i])) {
+            continue;
+        }
+        
+        PROF_UPDATE(update_tables(shared_data, tables, mode, (int)user_id, (int)movie_id,
+                                  rating, rating_bucket(shared_data, ts_col[i])));
+    }
+    
+    PROF_ADD(rows_parsed, lines_read);
+    if (!quiet) {
+        printf("[Child %d - PID %d] Completed: Read %d rows from %s\n", 
+               process_id, getpid(), lines_read, input->name);
+    }
+    return lines_read;
+}
+
+
+/*
+ * Hàm: build_chunks
+ * Mục đích: Chia phần chưa đọc của mọi input thành các chunk ~chunk_size bytes
+ * (file .rcol: chunk_size / RCOL_ROW_BYTES dòng; file nén: nhóm frame ~chunk_size bytes
+ * đã giải nén). chunks = NULL -> chỉ đếm
+ * Biên chunk không cần căn dòng: parser đã bỏ dòng dở dang ở đầu đoạn
+ * Trả về số chunk
+ */
+int build_chunks(const InputFile *files, int num_files, long long chunk_size, WorkChunk *chunks) {
+    int n = 0;
+    
+    for (int f = 0; f < num_files; f++) {
+        if (files[f].compressed.kind != COMPRESS_NONE) {
+            long long num_frames = files[f].compressed.num_frames;
+            for (long long first = files[f].start, last; first < num_frames; first = last) {
+                last = compressed_group_end(&files[f].compressed, first, chunk_size);
+                if (chunks != NULL) {
+                    chunks[n].file = f;
+                    chunks[n].start = first;
+                    chunks[n].end = last;
+                }
+                n++;
+            }
+            continue;
+        }
+        off_t step = files[f].columnar ? (off_t)(chunk_size / RCOL_ROW_BYTES) : (off_t)chunk_size;
+        off_t limit = input_limit(&files[f]);
+        for (off_t pos = files[f].start; pos < limit; pos += step) {
+            if (chunks != NULL) {
+                chunks[n].file = f;
+                chunks[n].start = pos;
+                chunks[n].end = (limit - pos > step) ? pos + step : limit;
+            }
+            n++;
+        }
+    }
+    return n;
+}
+
+/*
+ * Hàm: cursor_take_front / cursor_take_back
+ * Mục đích: Lấy 1 chunk từ đầu (chủ) / cuối (worker khác lấy trộm) của cursor
+ * Trả về chỉ số chunk, -1 nếu cursor đã hết
+ */
+static inline int cursor_take_front(WorkCursor *cursor) {
+    for (;;) {
+        uint64_t old = cursor->range;
+        uint32_t head = (uint32_t)(old >> 32);
+        uint32_t tail = (uint32_t)old;
+        if (head >= tail) {
+            return -1;
+        }
+        if (__sync_bool_compare_and_swap(&cursor->range, old, old + ((uint64_t)1 << 32))) {
+            return (int)head;
+        }
+    }
+}
+
+static inline int cursor_take_back(WorkCursor *cursor) {
+    for (;;) {
+        uint64_t old = cursor->range;
+        uint32_t head = (uint32_t)(old >> 32);
+        uint32_t tail = (uint32_t)old;
+        if (head >= tail) {
+            return -1;
+        }
+        if (__sync_bool_compare_and_swap(&cursor->range, old, old - 1)) {
+            return (int)(tail - 1);
+        }
+    }
+}
+
+/*
+ * Hàm: init_work_queue
+ * Mục đích: (parent, trước khi fork) Ghi các chunk vào shared memory và chia
+ * cho mỗi worker 1 dải chunk liên tiếp (đọc tuần tự trong file)
+ */
+void init_work_queue(SharedData *shared_data, const InputFile *files, int num_files,
+                     long long chunk_size) {
+    int n = build_chunks(files, num_files, chunk_size, work_chunks(shared_data));
+    WorkCursor *cursors = work_cursors(shared_data);
+    int num_workers = shared_data->num_workers;
+    
+    for (int w = 0; w < num_workers; w++) {
+        uint64_t head = (uint64_t)n * w / num_workers;
+        uint64_t tail = (uint64_t)n * (w + 1) / num_workers;
+        cursors[w].range = (head << 32) | tail;
+    }
+}
+
+/*
+ * Hàm: process_chunk
+ * Mục đích: Đọc 1 chunk bằng parser phù hợp vào tables, trả về số dòng đã đọc
+ */
+int process_chunk(const InputFile *input, const WorkChunk *chunk, SharedData *shared_data,
+                  AggTables tables, int process_id, AggregateMode mode, ParserKind parser) {
+    if (input->columnar) {
+        return calculate_average_columnar(input, chunk->start, chunk->end, shared_data, tables,
+                                          process_id, mode);
+    }
+    if (input->compressed.kind != COMPRESS_NONE) {
+        // Dữ liệu đã giải nén nằm trong buffer -> luôn dùng vòng parse của parser mmap
+        return calculate_average_compressed(input, chunk->start, chunk->end, shared_data,
+                                            tables, process_id, mode);
+    }
+    if (parser == PARSER_MMAP) {
+        return calculate_average_mmap(input, chunk->start, chunk->end, shared_data, tables,
+                                      process_id, mode);
+    }
+    if (parser == PARSER_FSCANF) {
+        return calculate_average_fscanf(input->name, chunk->start, chunk->end, shared_data,
+                                        tables, process_id, mode);
+    }
+    return calculate_average_stdio(input->name, chunk->start, chunk->end, shared_data, tables,
+                                   process_id, mode);
+}
+
+/*
+ * Hàm: flush_hot_counters
+ * Mục đích: (MODE_HOT) Cộng bộ đếm riêng của các movie hot vào bảng chung
+ * (atomic: worker khác có thể vẫn đang ghi). Trả về số rating đã cộng
+ */
+long long flush_hot_counters(AggTables tables, const HotCounters *hot) {
+    long long rows = 0;
+    
+    for (int s = 0; s < hot->keys.num_hot; s++) {
+        int index = hot->keys.hot_id[s] - 1;
+        __sync_fetch_and_add(&tables.sum[index], hot->sum[s]);
+        __sync_fetch_and_add(&tables.count[index], hot->count[s]);
+        for (int b = 0; b < NUM_BUCKETS; b++) {
+            if (hot->hist[b][s] != 0) {
+                __sync_fetch_and_add(&tables.hist[b][index], hot->hist[b][s]);
+            }
+        }
+        rows += hot->count[s];
+    }
+    return rows;
+}
+
+/*
+ * Hàm: release_input_range
+ * Mục đích: (--spill) Bỏ các page chứa [start, end) của file text / file nén đã map khỏi
+ * address space. Mapping chỉ đọc: page vẫn ở page cache, worker khác đang đọc page biên
+ * thì chỉ map lại (không mất dữ liệu). File .rcol giữ nguyên
+ */
+void release_input_range(const InputFile *input, off_t start, off_t end) {
+    long page = sysconf(_SC_PAGESIZE);
+    if (input->columnar || input->map.data == NULL) {
+        return;
+    }
+    start = input_offset(input, start);
+    end = input_offset(input, end);
+    off_t first = start / page * page;
+    off_t last = (end + page - 1) / page * page;
+    if (last > (off_t)input->map.size) {
+        last = input->map.size;
+    }
+    if (last > first) {
+        madvise((void *)(input->map.data + first), last - first, MADV_DONTNEED);
+    }
+}
+
+/*
+ * Hàm: run_worker
+ * Mục đích: Công việc của worker thứ process_id (1..num_workers), ghi vào tables
+ * (bảng chính, slab của child hoặc bảng riêng của thread):
+ * lấy hết chunk của mình (từ đầu), sau đó lấy trộm chunk còn lại của các
+ * worker khác (từ cuối) -> worker nào xong sớm sẽ đỡ việc cho worker chậm
+ * Cursor chỉ co lại nên mỗi worker khác chỉ cần xét 1 lần
+ * MODE_HOT: lấy mẫu movie trong chunk đầu tiên, chọn tập hot rồi mới đếm riêng
+ */
+void run_worker(const InputFile *files, SharedData *shared_data, AggTables tables,
+                int process_id, AggregateMode mode, ParserKind parser) {
+    int self = process_id - 1;
+    int num_workers = shared_data->num_workers;
+    WorkCursor *cursors = work_cursors(shared_data);
+    WorkChunk *chunks = work_chunks(shared_data);
+    WorkerStats *stats = &worker_stats(shared_data)[self];
+    
+    lock_contended = 0;
+    memset(reject_counts, 0, sizeof(reject_counts));
+    PROF_RESET();
+    if (mode == MODE_HOT) {
+        hot_counters = calloc(1, sizeof(HotCounters));
+        if (hot_counters == NULL) {
+            perror("malloc failed");
+            exit(1);
+        }
+        hot_keys_init(&hot_counters->keys);
+    }
+    if (mode == MODE_SPILL) {
+        spill_writer = malloc(sizeof(SpillWriter));
+        if (spill_writer == NULL) {
+            perror("malloc failed");
+            exit(1);
+        }
+        if (spill_writer_open(spill_writer, spill_layout, process_id) == -1) {
+            exit(1);
+        }
+    }
+    if (quarantine_fd >= 0) {
+        quarantine = malloc(sizeof(QuarantineWriter));
+        if (quarantine == NULL) {
+            perror("malloc failed");
+            exit(1);
+        }
+        if (quarantine_open(quarantine, quarantine_fd) == -1) {
+            exit(1);
+        }
+    }
+    for (int v = 0; v < num_workers; v++) {
+        int victim = (self + v) % num_workers;
+        int c;
+        while ((c = (victim == self) ? cursor_take_front(&cursors[victim])
+                                     : cursor_take_back(&cursors[victim])) >= 0) {
+            double chunk_start = now_ms();
+            PROF_TIME(busy_ticks,
+                      stats->rows += process_chunk(&files[chunks[c].file], &chunks[c],
+                                                   shared_data, tables, process_id, mode,
+                                                   parser));
+            double chunk_ms = now_ms() - chunk_start;
+            stats->busy_ms += chunk_ms;
+            PROF_ADD(busy_ns, (long long)(chunk_ms * 1e6));
+            PROF_ADD(bytes_read, input_offset(&files[chunks[c].file], chunks[c].end) -
+                                 input_offset(&files[chunks[c].file], chunks[c].start));
+            PROF_PUBLISH(&stats->prof);
+            if (release_input) {
+                release_input_range(&files[chunks[c].file], chunks[c].start, chunks[c].end);
+            }
+            stats->chunks++;
+            if (victim != self) {
+                stats->stolen++;
+            }
+            if (hot_counters != NULL && hot_counters->keys.sampling) {
+                stats->hot_keys = hot_keys_select(&hot_counters->keys);
+            }
+        }
+    }
+    stats->lock_contended = lock_contended;
+    memcpy(stats->rejected, reject_counts, sizeof(reject_counts));
+    if (quarantine != NULL) {
+        if (quarantine_close(quarantine) == -1) {
+            exit(1);
+        }
+        free(quarantine);
+        quarantine = NULL;
+    }
+    if (hot_counters != NULL) {
+        stats->hot_rows = flush_hot_counters(tables, hot_counters);
+        free(hot_counters);
+        hot_counters = NULL;
+    }
+    if (spill_writer != NULL) {
+        stats->spill_rows = spill_writer->rows;
+        stats->spill_sum = spill_writer->sum;
+        if (spill_writer_close(spill_writer) == -1) {
+            exit(1);
+        }
+        free(spill_writer);
+        spill_writer = NULL;
+    }
+}
+
+
+// Kết quả quét dồn qua các khối đã giải nén của 1 file nén
+typedef struct {
+    IdBounds *bounds;
+    int want_ts;
+} CompressedScan;
+
+/*
+ * Hàm: scan_decompressed_block
+ * Mục đích: (LineBlockFn) scan_max_ids trên 1 khối dòng trọn vẹn vừa giải nén
+ */
+static void scan_decompressed_block(void *ctx, const char *data, size_t len,
+                                    long long position) {
+    CompressedScan *c = ctx;
+    MappedFile block = {data, len};
+    int user_id, movie_id;
+    
+    (void)position;
+    scan_max_ids(&block, 0, len, MAX_USER_ID, MAX_MOVIE_ID, &user_id, &movie_id,
+                 c->want_ts ? &c->bounds->min_ts : NULL, c->want_ts ? &c->bounds->max_ts : NULL);
+    if (user_id > c->bounds->max_user_id) {
+        c->bounds->max_user_id = user_id;
+    }
+    if (movie_id > c->bounds->max_movie_id) {
+        c->bounds->max_movie_id = movie_id;
+    }
+}
+
+/*
+ * Hàm: scan_range_max_ids
+ * Mục đích: userID, movieID lớn nhất trong đoạn thứ w (0-based) của mọi file
+ * want_ts = 1: tìm thêm khoảng timestamp (--bucket)
+ */
+IdBounds scan_range_max_ids(const InputFile *files, int num_files, int w, int num_workers,
+                            int want_ts) {
+    IdBounds bounds = {0, 0, INT_MAX, INT_MIN};
+    
+    for (int f = 0; f < num_files; f++) {
+        off_t start, end;
+        int user_id, movie_id;
+        input_range(&files[f], w, num_workers, &start, &end);
+        if (files[f].compressed.kind != COMPRESS_NONE) {
+            // Phải giải nén cả file 1 lần -> nên cho sẵn --max-movie-id / --max-user-id
+            CompressedScan ctx = {&bounds, want_ts};
+            if (start < end &&
+                compressed_read_lines(&files[f].map, &files[f].compressed, start, end,
+                                      scan_decompressed_block, &ctx) == -1) {
+                fprintf(stderr, "ERROR: Cannot decompress %s\n", files[f].name);
+                exit(1);
+            }
+            if (release_input) {
+                release_input_range(&files[f], start, end);
+            }
+            continue;
+        }
+        if (files[f].columnar) {
+            uint32_t u, m;
+            uint32_t min_ts = UINT32_MAX, max_ts = 0;
+            rcol_max_ids(&files[f].cols, start, end, MAX_USER_ID, MAX_MOVIE_ID, &u, &m,
+                         want_ts ? &min_ts : NULL, want_ts ? &max_ts : NULL);
+            user_id = (int)u;
+            movie_id = (int)m;
+            if (min_ts <= max_ts) {
+                if ((long long)min_ts < bounds.min_ts) {
+                    bounds.min_ts = (min_ts > INT_MAX) ? INT_MAX : (int)min_ts;
+                }
+                if ((long long)max_ts > bounds.max_ts) {
+                    bounds.max_ts = (max_ts > INT_MAX) ? INT_MAX : (int)max_ts;
+                }
+            }
+        } else {
+            scan_max_ids(&files[f].map, start, end, MAX_USER_ID, MAX_MOVIE_ID, &user_id,
+                         &movie_id, want_ts ? &bounds.min_ts : NULL,
+                         want_ts ? &bounds.max_ts : NULL);
+            if (release_input) {
+                release_input_range(&files[f], start, end);
+            }
+        }
+        if (user_id > bounds.max_user_id) {
+            bounds.max_user_id = user_id;
+        }
+        if (movie_id > bounds.max_movie_id) {
+            bounds.max_movie_id = movie_id;
+        }
+    }
+    return bounds;
+}
+
+/*
+ * Hàm: scan_max_ids_parallel
+ * Mục đích: Pass quét đầu tiên (song song, N child) để tìm userID, movieID lớn nhất
+ * -> kích thước bảng movie/user trong shared memory (want_ts: cả khoảng timestamp
+ * -> số bucket thời gian)
+ * Mỗi child ghi kết quả vào 1 ô của vùng nhớ anonymous dùng chung, parent lấy max
+ */
+IdBounds scan_max_ids_parallel(const InputFile *files, int num_files, int num_workers,
+                               int want_ts) {
+    IdBounds *results = mmap(NULL, num_workers * sizeof(IdBounds), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        perror("mmap failed");
+        exit(1);
+    }
+    
+    fflush(stdout);
+    pid_t *pids = malloc(num_workers * sizeof(pid_t));
+    if (pids == NULL) {
+        perror("malloc failed");
+        exit(1);
+    }
+    for (int w = 0; w < num_workers; w++) {
+        pids[w] = fork();
+        if (pids[w] < 0) {
+            perror("fork failed");
+            exit(1);
+        }
+        if (pids[w] == 0) {
+            results[w] = scan_range_max_ids(files, num_files, w, num_workers, want_ts);
+            exit(0);
+        }
+    }
+    
+    IdBounds bounds = {0, 0, INT_MAX, INT_MIN};
+    for (int w = 0; w < num_workers; w++) {
+        int status;
+        waitpid(pids[w], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "ERROR: Scan child %d failed\n", w + 1);
+            exit(1);
+        }
+        if (results[w].max_user_id > bounds.max_user_id) {
+            bounds.max_user_id = results[w].max_user_id;
+        }
+        if (results[w].max_movie_id > bounds.max_movie_id) {
+            bounds.max_movie_id = results[w].max_movie_id;
+        }
+        if (results[w].min_ts < bounds.min_ts) {
+            bounds.min_ts = results[w].min_ts;
+        }
+        if (results[w].max_ts > bounds.max_ts) {
+            bounds.max_ts = results[w].max_ts;
+        }
+    }
+    
+    free(pids);
+    munmap(results, num_workers * sizeof(IdBounds));
+    return bounds;
+}
+
+
+/*
+ * Hàm: merge_partials
+ * Mục đích: (MODE_LOCKFREE) Parent cộng các slab riêng của child vào bảng chính
+ * Gọi SAU khi tất cả child đã kết thúc -> không cần lock.
+ * Mọi bộ bảng có cùng layout nên merge = cộng 2 mảng Counter phẳng
+ * (phần đệm đều bằng 0) và max vùng HLL bằng SIMD (merge_table_set)
+ */
+void merge_partials(SharedData *shared_data) {
+    Counter *main_table = shared_data->data;
+    size_t n = shared_data->table_ints;
+    
+    for (int c = 0; c < shared_data->num_slabs; c++) {
+        merge_table_set(shared_data, main_table, shared_data->data + (size_t)(c + 1) * n);
+    }
+}
+
+
+/*
+ * Hàm: run_processes
+ * Mục đích: (ENGINE_PROCESS) Fork N child, mỗi child chạy run_worker rồi thoát;
+ * parent chờ tất cả. Trả về 0 nếu mọi child thành công
+ */
+int run_processes(const InputFile *files, SharedData *shared_data, ShmSegment *seg,
+                  AggregateMode mode, ParserKind parser) {
+    int num_workers = shared_data->num_workers;
+    
+    printf("Creating %d child processes...\n", num_workers);
+    fflush(stdout);  // Tránh child kế thừa buffer stdout chưa flush (in lặp output)
+    pid_t *pids = malloc(num_workers * sizeof(pid_t));
+    if (pids == NULL) {
+        perror("malloc failed");
+        exit(1);
+    }
+    
+    for (int w = 0; w < num_workers; w++) {
+        pids[w] = fork();
+        
+        if (pids[w] < 0) {
+            perror("fork failed");
+            exit(1);
+        }
+        
+        if (pids[w] == 0) {
+            // CHILD PROCESS w+1: Xử lý đoạn w+1 của các file
+            // Line-buffered: mỗi dòng log là 1 write() -> không bị cắt giữa dòng
+            // khi nhiều child cùng ghi vào 1 pipe / file
+            setvbuf(stdout, NULL, _IOLBF, 0);
+            run_worker(files, shared_data, worker_table(shared_data, mode, w + 1), w + 1,
+                       mode, parser);
+            
+            // Detach shared memory
+            fflush(stdout);
+            shm_segment_detach(seg);
+            exit(0);
+        }
+    }
+    
+    // ========================================
+    // PARENT PROCESS: Chờ tất cả child processes hoàn thành
+    // ========================================
+    printf("\n[Parent] Waiting for child processes to complete...\n\n");
+    
+    int failed = 0;
+    for (int w = 0; w < num_workers; w++) {
+        int status;
+        waitpid(pids[w], &status, 0);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            printf("✓ Child %d (PID %d) finished\n", w + 1, pids[w]);
+        } else {
+            printf("❌ Child %d (PID %d) failed\n", w + 1, pids[w]);
+            failed = 1;
+        }
+    }
+    free(pids);
+    return failed ? -1 : 0;
+}
+
+
+// ENGINE_THREAD: trạng thái dùng chung của các worker thread
+typedef struct {
+    const InputFile *files;
+    SharedData *shared_data;
+    AggregateMode mode;
+    ParserKind parser;
+    int num_threads;
+    const int *cpus;                // cpus[i]: core ghim thread i (NULL = không ghim)
+    Counter **locals;               // locals[i]: bảng riêng của thread i (MODE_LOCKFREE)
+    pthread_barrier_t barrier;
+    double ingest_end;              // Lúc thread cuối cùng đọc xong (thread 0 ghi)
+    volatile int failed;
+} ThreadPool;
+
+typedef struct {
+    ThreadPool *pool;
+    int id;                         // 0-based
+} ThreadArg;
+
+/*
+ * Hàm: cpu_node
+ * Mục đích: NUMA node của core (thư mục nodeN trong /sys/devices/system/cpu/cpuC)
+ * Trả về -1 nếu không xác định được
+ */
+int cpu_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return -1;
+    }
+    
+    int node = -1;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 &&
+            (unsigned int)(entry->d_name[4] - '0') < 10) {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+/*
+ * Hàm: allowed_cpus
+ * Mục đích: Danh sách core process được phép chạy (theo thứ tự), để ghim thread i
+ * vào cpus[i % n]. Trả về số core, 0 nếu lỗi
+ */
+int allowed_cpus(int *cpus, int max) {
+    cpu_set_t set;
+    int n = 0;
+    
+    if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+        return 0;
+    }
+    for (int c = 0; c < CPU_SETSIZE && n < max; c++) {
+        if (CPU_ISSET(c, &set)) {
+            cpus[n++] = c;
+        }
+    }
+    return n;
+}
+
+/*
+ * Hàm: thread_main
+ * Mục đích: 1 worker thread (ENGINE_THREAD):
+ * 1. Ghim vào core của mình. Bảng riêng (MODE_LOCKFREE) được cấp phát và chạm
+ *    lần đầu SAU khi ghim -> kernel đặt page trên NUMA node của core đó
+ * 2. Lấy chunk từ work queue như child process (run_worker)
+ * 3. Merge cây: vòng step = 1, 2, 4...: thread i (i chia hết 2 * step) cộng bảng
+ *    của thread i + step vào bảng mình -> log2(N) vòng song song thay vì N lần
+ *    cộng tuần tự; cuối cùng thread 0 cộng vào bảng chính
+ */
+void *thread_main(void *arg) {
+    ThreadPool *pool = ((ThreadArg *)arg)->pool;
+    int id = ((ThreadArg *)arg)->id;
+    SharedData *shared_data = pool->shared_data;
+    WorkerStats *stats = &worker_stats(shared_data)[id];
+    size_t table_bytes = shared_data->table_ints * sizeof(Counter);
+    
+    if (pool->cpus != NULL) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(pool->cpus[id], &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+            stats->cpu = pool->cpus[id];
+            stats->node = cpu_node(pool->cpus[id]);
+        }
+    }
+    
+    AggTables tables = shared_movies(shared_data);
+    if (pool->mode == MODE_LOCKFREE) {
+        // mmap anonymous: page 0 chỉ được cấp khi ghi lần đầu (first touch)
+        void *local = mmap(NULL, table_bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (local == MAP_FAILED) {
+            perror("mmap thread table failed");
+            pool->failed = 1;
+            local = NULL;
+        }
+        pool->locals[id] = local;
+        tables = table_view(shared_data, local);
+    }
+    
+    if (pool->mode != MODE_LOCKFREE || pool->locals[id] != NULL) {
+        run_worker(pool->files, shared_data, tables, id + 1, pool->mode, pool->parser);
+    }
+    
+    if (pthread_barrier_wait(&pool->barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+        pool->ingest_end = now_ms();
+    }
+    if (pool->mode == MODE_LOCKFREE) {
+        for (int step = 1; step < pool->num_threads; step *= 2) {
+            int peer = id + step;
+            if (id % (2 * step) == 0 && peer < pool->num_threads &&
+                pool->locals[id] != NULL && pool->locals[peer] != NULL) {
+                merge_table_set(shared_data, pool->locals[id], pool->locals[peer]);
+            }
+            pthread_barrier_wait(&pool->barrier);
+        }
+        if (id == 0 && pool->locals[0] != NULL) {
+            merge_table_set(shared_data, shared_data->data, pool->locals[0]);
+        }
+        // Mọi thread đã qua barrier cuối -> không ai còn đọc bảng của mình
+        if (pool->locals[id] != NULL) {
+            munmap(pool->locals[id], table_bytes);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Hàm: run_threads
+ * Mục đích: (ENGINE_THREAD) Chạy N worker thread, chờ đọc + merge xong
+ * *ingest_end = lúc đọc xong (phần sau đó là merge). Trả về 0 nếu thành công
+ */
+int run_threads(const InputFile *files, SharedData *shared_data, AggregateMode mode,
+                ParserKind parser, int pin, double *ingest_end) {
+    int num_threads = shared_data->num_workers;
+    ThreadPool pool;
+    int cpus[MAX_WORKERS];
+    int num_cpus = pin ? allowed_cpus(cpus, MAX_WORKERS) : 0;
+    
+    memset(&pool, 0, sizeof(pool));
+    pool.files = files;
+    pool.shared_data = shared_data;
+    pool.mode = mode;
+    pool.parser = parser;
+    pool.num_threads = num_threads;
+    if (num_cpus > 0) {
+        for (int i = num_cpus; i < num_threads; i++) {
+            cpus[i] = cpus[i % num_cpus];  // Nhiều thread hơn core: quay vòng
+        }
+        pool.cpus = cpus;
+    }
+    
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    ThreadArg *args = malloc(num_threads * sizeof(ThreadArg));
+    pool.locals = calloc(num_threads, sizeof(Counter *));
+    if (threads == NULL || args == NULL || pool.locals == NULL) {
+        perror("malloc failed");
+        exit(1);
+    }
+    pthread_barrier_init(&pool.barrier, NULL, num_threads);
+    
+    for (int t = 0; t < num_threads; t++) {
+        args[t].pool = &pool;
+        args[t].id = t;
+        if (pthread_create(&threads[t], NULL, thread_main, &args[t]) != 0) {
+            // Barrier chờ đủ num_threads thread -> không thể chạy thiếu
+            perror("pthread_create failed");
+            exit(1);
+        }
+    }
+    for (int t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    
+    *ingest_end = pool.ingest_end;
+    pthread_barrier_destroy(&pool.barrier);
+    free(pool.locals);
+    free(args);
+    free(threads);
+    return pool.failed ? -1 : 0;
+}
+
+
+/*
+ * Hàm: average_stars
+ * Mục đích: Average (đơn vị sao) từ sum theo nửa sao và count
+ */
+static inline double average_stars(Counter sum, Counter count) {
+    return (double)sum / RATING_SCALE / (double)count;
+}
+
+/*
+ * Hàm: movie_distinct
+ * Mục đích: (--distinct) Số user khác nhau ước lượng của movie index i
+ */
+static inline long long movie_distinct(const SharedData *shared_data, AggTables tables, int i) {
+    return llround(hll_estimate(tables.hll + ((size_t)i << shared_data->hll_bits),
+                                shared_data->hll_bits));
+}
+
+/*
+ * Hàm: out_half_stars
+ * Mục đích: Ghi tổng theo nửa sao dưới dạng số sao chính xác: 7 -> "3.5", 8 -> "4"
+ * (chỉ dùng số nguyên, không qua double -> đúng cả với tổng rất lớn)
+ */
+static inline void out_half_stars(OutBuf *out, Counter half_stars) {
+    out_i64(out, half_stars / RATING_SCALE);
+    if (half_stars % RATING_SCALE != 0) {
+        out_str(out, ".5");
+    }
+}
+
+/*
+ * Hàm: out_average
+ * Mục đích: Average (đơn vị sao, 4 chữ số thập phân) từ sum theo nửa sao và count
+ */
+static inline void out_average(OutBuf *out, Counter sum, Counter count) {
+    out_ratio(out, sum, count * RATING_SCALE, 4);
+}
+
+/*
+ * Hàm: out_score
+ * Mục đích: Số thực có dấu, 4 chữ số thập phân (out_double chỉ nhận số không âm)
+ * Pearson có thể âm
+ */
+static inline void out_score(OutBuf *out, double value) {
+    if (value <= -0.00005) {
+        out_char(out, '-');
+        value = -value;
+    } else if (value < 0) {
+        value = 0;
+    }
+    out_double(out, value, 4);
+}
+
+/*
+ * Hàm: out_field
+ * Mục đích: Kết thúc 1 trường căn trái bắt đầu tại field_start (giống "%-*s ")
+ */
+static inline void out_field(OutBuf *out, size_t field_start, int width) {
+    out_pad(out, field_start, width);
+    out_char(out, ' ');
+}
+
+/*
+ * Hàm: out_date
+ * Mục đích: Ghi ngày (số ngày kể từ 1970-01-01) dạng YYYY-MM-DD
+ */
+static inline void out_date(OutBuf *out, long long days) {
+    long long y;
+    int m, d;
+    civil_from_days(days, &y, &m, &d);
+    out_i64(out, y);
+    out_char(out, '-');
+    out_char(out, (char)('0' + m / 10));
+    out_char(out, (char)('0' + m % 10));
+    out_char(out, '-');
+    out_char(out, (char)('0' + d / 10));
+    out_char(out, (char)('0' + d % 10));
+}
+
+/*
+ * Hàm: out_bucket_start
+ * Mục đích: Ghi ngày bắt đầu của bucket thứ t trong bảng
+ */
+static inline void out_bucket_start(OutBuf *out, const SharedData *shared_data, int t) {
+    out_date(out, bucket_start_days(shared_data->bucket_base + t,
+                                    (BucketKind)shared_data->bucket_kind));
+}
+
+/*
+ * Hàm: last_active_bucket
+ * Mục đích: Bucket cuối cùng có rating (mốc "hiện tại" của --window)
+ * --follow chừa sẵn bucket cho tương lai nên không lấy bucket cuối của bảng
+ * Trả về -1 nếu không có bucket nào có rating
+ */
+int last_active_bucket(SharedData *shared_data) {
+    AggTables tables = shared_movies(shared_data);
+    
+    for (int t = shared_data->num_time_buckets - 1; t >= 0; t--) {
+        const Counter *row = tables.bucket_count + (size_t)t * shared_data->movie_stride;
+        for (int i = 0; i < shared_data->num_movies; i++) {
+            if (row[i] != 0) {
+                return t;
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ * Hàm: window_totals
+ * Mục đích: (--window) Sum, count của từng movie trong window bucket gần nhất
+ * = cộng window hàng của bảng bucket (SIMD, table_merge.c), không đọc lại input
+ * *sums, *counts: mảng movie_stride phần tử (caller free)
+ * Trả về index bucket đầu tiên của cửa sổ, -1 nếu lỗi
+ */
+int window_totals(SharedData *shared_data, int window, Counter **sums, Counter **counts) {
+    AggTables tables = shared_movies(shared_data);
+    size_t ms = (size_t)shared_data->movie_stride;
+    int last = last_active_bucket(shared_data);
+    int first = (last - window + 1 > 0) ? last - window + 1 : 0;
+    
+    *sums = calloc(ms, sizeof(Counter));
+    *counts = calloc(ms, sizeof(Counter));
+    if (*sums == NULL || *counts == NULL) {
+        perror("calloc failed");
+        free(*sums);
+        free(*counts);
+        return -1;
+    }
+    for (int t = first; t <= last; t++) {
+        table_add_i64(*sums, tables.bucket_sum + (size_t)t * ms, ms);
+        table_add_i64(*counts, tables.bucket_count + (size_t)t * ms, ms);
+    }
+    return first;
+}
+
+/*
+ * Hàm: headroom_id
+ * Mục đích: (--follow) Nhân ID lớn nhất đã quét với FOLLOW_ID_HEADROOM, không vượt limit
+ */
+int headroom_id(int scanned, int limit) {
+    long long id = (long long)scanned * FOLLOW_ID_HEADROOM;
+    return (id > limit) ? limit : (int)id;
+}
+
+/*
+ * Hàm: checkpoint_matches
+ * Mục đích: Checkpoint có cùng danh sách input (tên, thứ tự), cùng --bucket,
+ * --since / --until, --distinct và mỗi file vẫn là file đã lưu (cùng inode, phần đã đọc
+ * không đổi, chỉ được ghi thêm: checkpoint_file_matches) không?
+ * Không khớp -> tính lại từ đầu
+ */
+int checkpoint_matches(const Checkpoint *ck, const InputFile *files, int num_files,
+                       BucketKind bucket_kind, long long since, long long until, int hll_bits) {
+    const CheckpointHeader *h = ck->header;
+    if (h->num_files != num_files || h->bucket_kind != (int32_t)bucket_kind ||
+        h->since != since || h->until != until || h->hll_bits != hll_bits) {
+        return 0;
+    }
+    // Kích thước bảng phải đúng như layout tính lại (restore đọc theo layout đó)
+    if (h->movie_stride != stride_for(h->num_movies) || h->user_stride != stride_for(h->num_users) ||
+        h->table_ints != table_ints_for(h->num_movies, h->num_users, h->num_time_buckets,
+                                        h->hll_bits)) {
+        return 0;
+    }
+    for (int f = 0; f < num_files; f++) {
+        if (strncmp(ck->files[f].name, files[f].name, CKPT_NAME_MAX - 1) != 0 ||
+            ck->files[f].consumed < 0 || ck->files[f].consumed > input_limit(&files[f]) ||
+            !checkpoint_file_matches(&ck->files[f], files[f].columnar)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Hàm: restore_checkpoint
+ * Mục đích: Copy bảng trong checkpoint vào bảng chính (đã memset 0)
+ * Bảng mới có thể lớn hơn (phần ghi thêm có ID mới) -> copy từng mảng theo stride cũ
+ */
+void restore_checkpoint(SharedData *shared_data, const Checkpoint *ck) {
+    const CheckpointHeader *h = ck->header;
+    Counter *base = shared_data->data;
+    
+    for (int a = 0; a < MOVIE_ARRAYS; a++) {
+        memcpy(base + (size_t)a * shared_data->movie_stride,
+               ck->table + (size_t)a * h->movie_stride, (size_t)h->num_movies * sizeof(Counter));
+    }
+    Counter *user_base = base + (size_t)MOVIE_ARRAYS * shared_data->movie_stride;
+    const int64_t *ck_user_base = ck->table + (size_t)MOVIE_ARRAYS * h->movie_stride;
+    for (int a = 0; a < USER_ARRAYS; a++) {
+        memcpy(user_base + (size_t)a * shared_data->user_stride,
+               ck_user_base + (size_t)a * h->user_stride, (size_t)h->num_users * sizeof(Counter));
+    }
+    
+    // Bucket thời gian: bucket t cũ -> t + (base cũ - base mới) (bảng mới đã bao trùm bảng cũ)
+    if (h->num_time_buckets > 0 && shared_data->num_time_buckets > 0) {
+        AggTables tables = shared_movies(shared_data);
+        const int64_t *ck_bucket_sum = ck_user_base + (size_t)USER_ARRAYS * h->user_stride;
+        const int64_t *ck_bucket_count = ck_bucket_sum + (size_t)h->num_time_buckets * h->movie_stride;
+        long long shift = h->bucket_base - shared_data->bucket_base;
+        for (int t = 0; t < h->num_time_buckets; t++) {
+            size_t dst = (size_t)(t + shift) * shared_data->movie_stride;
+            size_t src = (size_t)t * h->movie_stride;
+            memcpy(tables.bucket_sum + dst, ck_bucket_sum + src,
+                   (size_t)h->num_movies * sizeof(Counter));
+            memcpy(tables.bucket_count + dst, ck_bucket_count + src,
+                   (size_t)h->num_movies * sizeof(Counter));
+        }
+    }
+    
+    // Sketch HLL: mỗi movie 1 khối 2^hll_bits byte liên tiếp -> 1 lần copy
+    if (h->hll_bits > 0) {
+        const int64_t *ck_hll = ck->table + counter_ints_for(h->num_movies, h->num_users,
+                                                             h->num_time_buckets);
+        memcpy(shared_movies(shared_data).hll, ck_hll, (size_t)h->num_movies << h->hll_bits);
+    }
+}
+
+/*
+ * Hàm: save_checkpoint
+ * Mục đích: Lưu bảng chính + vị trí đã đọc consumed[f] của từng input
+ */
+int save_checkpoint(SharedData *shared_data, const InputFile *files, int num_files,
+                    const off_t *consumed, const char *path) {
+    CheckpointHeader layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.num_movies = shared_data->num_movies;
+    layout.num_users = shared_data->num_users;
+    layout.movie_stride = shared_data->movie_stride;
+    layout.user_stride = shared_data->user_stride;
+    layout.num_files = num_files;
+    layout.table_ints = shared_data->table_ints;
+    layout.bucket_kind = shared_data->bucket_kind;
+    layout.bucket_base = shared_data->bucket_base;
+    layout.num_time_buckets = shared_data->num_time_buckets;
+    layout.since = shared_data->since;
+    layout.until = shared_data->until;
+    layout.hll_bits = shared_data->hll_bits;
+    
+    CheckpointFile *prints = malloc(num_files * sizeof(CheckpointFile));
+    if (prints == NULL) {
+        return -1;
+    }
+    for (int f = 0; f < num_files; f++) {
+        if (checkpoint_fingerprint(files[f].name, files[f].columnar, consumed[f],
+                                   &prints[f]) == -1) {
+            fprintf(stderr, "Cannot fingerprint %s for the checkpoint\n", files[f].name);
+            free(prints);
+            return -1;
+        }
+    }
+    
+    int result = checkpoint_save(path, &layout, prints, shared_data->data);
+    free(prints);
+    return result;
+}
+
+// Cờ dừng --follow (set bởi SIGINT/SIGTERM)
+static volatile sig_atomic_t stop_requested = 0;
+
+void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+/*
+ * Hàm: complete_length
+ * Mục đích: Độ dài phần đầu buf gồm các dòng đã kết thúc bằng '\n'
+ * Dòng cuối chưa có '\n' (đang được ghi dở) để dành lần đọc sau
+ */
+size_t complete_length(const char *buf, size_t len) {
+    const char *nl = memrchr(buf, '\n', len);
+    return (nl == NULL) ? 0 : (size_t)(nl - buf) + 1;
+}
+
+/*
+ * Hàm: ingest_appended
+ * Mục đích: (--follow) Đọc phần được ghi thêm vào file từ *offset và cập nhật
+ * trực tiếp bảng chính. Parent là process DUY NHẤT ghi lúc này nên không cần lock
+ * Trả về số ratings đã thêm; *rejected cộng thêm số dòng lỗi/không hợp lệ
+ */
+int ingest_appended(SharedData *shared_data, const InputFile *input, off_t *offset,
+                    char *buf, int *rejected) {
+    int fd = open(input->name, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return 0;
+    }
+    if (st.st_size < *offset) {
+        // File bị truncate/rotate: không thể biết phần nào đã đọc -> bắt đầu từ cuối
+        printf("[Follow] WARNING: %s shrank, continuing from its new end\n", input->name);
+        *offset = st.st_size;
+        close(fd);
+        return 0;
+    }
+    
+    AggTables tables = shared_movies(shared_data);
+    int added = 0;
+    
+    while (*offset < st.st_size) {
+        size_t want = (size_t)(st.st_size - *offset);
+        if (want > FOLLOW_BUFFER_SIZE) {
+            want = FOLLOW_BUFFER_SIZE;
+        }
+        ssize_t n = pread(fd, buf, want, *offset);
+        if (n <= 0) {
+            break;
+        }
+        
+        size_t len = complete_length(buf, (size_t)n);
+        if (len == 0) {
+            break;  // Chưa có dòng hoàn chỉnh
+        }
+        
+        const char *p = buf;
+        const char *end = buf + len;
+        RatingRow row;
+        int ok;
+        // Mỗi buffer (<= FOLLOW_BUFFER_SIZE) là 1 lần ghi của seqlock -> --serve
+        // không bao giờ thấy bảng cập nhật dở, và không phải chờ lâu
+        seq_write_begin(shared_data);
+        while (p < end) {
+            const char *line = p;
+            p = parse_rating_line(p, end, &row, &ok);
+            int reason = ok ? row_reject_reason(shared_data, row.user_id, row.movie_id,
+                                                row.rating)
+                            : REJECT_MALFORMED;
+            if (reason >= 0) {
+                reject_row(reason, input->name, *offset + (line - buf), line,
+                           row_length(line, p));
+                (*rejected)++;
+                continue;
+            }
+            if (!in_time_range(shared_data, row.timestamp)) {
+                continue;
+            }
+            update_tables(shared_data, tables, MODE_LOCKFREE, row.user_id, row.movie_id,
+                          row.rating, rating_bucket(shared_data, row.timestamp));
+            added++;
+        }
+        seq_write_end(shared_data);
+        *offset += len;
+    }
+    
+    close(fd);
+    return added;
+}
+
+/*
+ * Hàm: follow_inputs
+ * Mục đích: (--follow) Giữ shared memory sống và theo dõi các file text append-only:
+ * mỗi poll_ms kiểm tra size, đọc phần mới ghi thêm, cập nhật bảng chính.
+ * Process khác đọc kết quả hiện tại bằng --query mà không cần tính lại.
+ * Có --checkpoint: lưu tối đa 1 lần / CHECKPOINT_INTERVAL_MS và lúc dừng
+ * Dừng khi nhận SIGINT/SIGTERM
+ */
+void follow_inputs(SharedData *shared_data, const InputFile *files, int num_files,
+                   off_t *offsets, int poll_ms, const char *checkpoint_path) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    
+    char *buf = malloc(FOLLOW_BUFFER_SIZE);
+    if (buf == NULL) {
+        perror("malloc failed");
+        return;
+    }
+    
+    printf("[Follow] Watching %d file(s) every %d ms, press Ctrl+C to stop\n",
+           num_files, poll_ms);
+    fflush(stdout);
+    
+    // --quarantine: parent là worker duy nhất của phần ghi thêm
+    QuarantineWriter follow_quarantine;
+    if (quarantine_fd >= 0 && quarantine_open(&follow_quarantine, quarantine_fd) == 0) {
+        quarantine = &follow_quarantine;
+    }
+    
+    long long total_added = 0;
+    int dirty = 0;  // Có cập nhật chưa được checkpoint
+    double last_checkpoint = now_ms();
+    while (!stop_requested) {
+        int added = 0;
+        int rejected = 0;
+        for (int f = 0; f < num_files; f++) {
+            if (!files[f].columnar) {
+                added += ingest_appended(shared_data, &files[f], &offsets[f], buf, &rejected);
+            }
+        }
+        
+        if (added > 0 || rejected > 0) {
+            shared_data->updates++;
+            total_added += added;
+            dirty = 1;
+            printf("[Follow] +%d ratings (%d rejected), %lld added since start\n",
+                   added, rejected, total_added);
+            fflush(stdout);
+            if (rejected > 0 && quarantine != NULL) {
+                quarantine_flush(quarantine);  // Dòng bị loại ra file ngay, không đợi lúc dừng
+            }
+        } else {
+            struct timespec ts = {poll_ms / 1000, (long)(poll_ms % 1000) * 1000000L};
+            nanosleep(&ts, NULL);
+        }
+        
+        if (checkpoint_path != NULL && dirty &&
+            now_ms() - last_checkpoint >= CHECKPOINT_INTERVAL_MS) {
+            if (save_checkpoint(shared_data, files, num_files, offsets, checkpoint_path) == 0) {
+                dirty = 0;
+            }
+            last_checkpoint = now_ms();
+        }
+    }
+    
+    if (checkpoint_path != NULL && dirty &&
+        save_checkpoint(shared_data, files, num_files, offsets, checkpoint_path) == 0) {
+        printf("[Follow] Checkpoint saved to %s\n", checkpoint_path);
+    }
+    
+    printf("\n[Follow] Stopped, %lld ratings added since start\n", total_added);
+    if (quarantine != NULL) {
+        quarantine_close(quarantine);
+        quarantine = NULL;
+    }
+    free(buf);
+}
+
+/*
+ * Hàm: attach_analyzer
+ * Mục đích: Attach READ-ONLY vào shared memory của 1 process đang chạy --follow
+ * shm_name = NULL: thử tên POSIX mặc định của --follow, rồi key SysV
+ * Trả về bảng đã attach, NULL nếu không tìm thấy (đã in lỗi)
+ */
+SharedData *attach_analyzer(ShmSegment *seg, const char *shm_name) {
+    if (shm_segment_attach_readonly(seg, SHM_KEY, shm_name ? shm_name : SHM_FOLLOW_NAME) == -1 &&
+        (shm_name != NULL || shm_segment_attach_readonly(seg, SHM_KEY, NULL) == -1)) {
+        fprintf(stderr, "ERROR: No running analyzer found (shared memory %s / key 0x%x)\n",
+                shm_name ? shm_name : SHM_FOLLOW_NAME, SHM_KEY);
+        return NULL;
+    }
+    return (SharedData *)seg->addr;
+}
+
+/*
+ * Hàm: snapshot_movie
+ * Mục đích: (-q, --serve) Đọc sum, count, histogram của movie index i dưới seqlock
+ * Trả về 0 nếu có bản sao nhất quán, -1 nếu writer ghi liên tục quá SERVE_MAX_RETRIES lần
+ * hoặc kẹt giữa 1 lần ghi (seq lẻ quá SEQ_SPIN_MAX lần yield)
+ */
+int snapshot_movie(const SharedData *shared_data, AggTables tables, int i, Counter *sum,
+                   Counter *count, Counter *hist) {
+    for (int attempt = 0; attempt < SERVE_MAX_RETRIES; attempt++) {
+        unsigned int seq;
+        if (seq_read_begin(shared_data, &seq) != 0) {
+            return -1;
+        }
+        *sum = tables.sum[i];
+        *count = tables.count[i];
+        for (int b = 0; b < NUM_BUCKETS; b++) {
+            hist[b] = tables.hist[b][i];
+        }
+        if (!seq_read_retry(shared_data, seq)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// -q: mọi số liệu của 1 movie, chép trong cùng 1 lần đọc seqlock
+typedef struct {
+    Counter sum;
+    Counter count;
+    Counter hist[NUM_BUCKETS];
+    long long distinct;                        // -1 nếu analyzer không chạy --distinct
+    int first_bucket;                          // --bucket: các bucket [first_bucket, last_bucket]
+    int last_bucket;                           // -1 nếu chưa có bucket nào có rating
+    Counter bucket_sum[DISPLAY_LAST_BUCKETS];  // Phần tử t - first_bucket
+    Counter bucket_count[DISPLAY_LAST_BUCKETS];
+} MovieSnapshot;
+
+/*
+ * Hàm: snapshot_movie_detail
+ * Mục đích: (-q) Như snapshot_movie nhưng chép thêm ước lượng distinct và
+ * DISPLAY_LAST_BUCKETS bucket gần nhất -> count, sum của 1 bucket không bao giờ lệch
+ * nhau giữa 2 lần ghi của --follow. Trả về 0, -1 nếu writer bận (xem snapshot_movie)
+ */
+int snapshot_movie_detail(SharedData *shared_data, AggTables tables, int i, MovieSnapshot *snap) {
+    for (int attempt = 0; attempt < SERVE_MAX_RETRIES; attempt++) {
+        unsigned int seq;
+        if (seq_read_begin(shared_data, &seq) != 0) {
+            return -1;
+        }
+        snap->sum = tables.sum[i];
+        snap->count = tables.count[i];
+        for (int b = 0; b < NUM_BUCKETS; b++) {
+            snap->hist[b] = tables.hist[b][i];
+        }
+        snap->distinct = (tables.hll != NULL) ? movie_distinct(shared_data, tables, i) : -1;
+        snap->last_bucket = -1;
+        snap->first_bucket = 0;
+        if (shared_data->num_time_buckets > 0) {
+            int last = last_active_bucket(shared_data);
+            snap->last_bucket = last;
+            snap->first_bucket = (last - DISPLAY_LAST_BUCKETS + 1 > 0)
+                ? last - DISPLAY_LAST_BUCKETS + 1 : 0;
+            for (int t = snap->first_bucket; t <= last; t++) {
+                size_t cell = (size_t)t * shared_data->movie_stride + i;
+                snap->bucket_sum[t - snap->first_bucket] = tables.bucket_sum[cell];
+                snap->bucket_count[t - snap->first_bucket] = tables.bucket_count[cell];
+            }
+        }
+        if (!seq_read_retry(shared_data, seq)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Hàm: query_movie
+ * Mục đích: In kết quả hiện tại của movie_id từ 1 process đang chạy --follow
+ * (không đọc lại input). Mọi số liệu đọc dưới seqlock (snapshot_movie_detail)
+ */
+int query_movie(int movie_id, const char *shm_name) {
+    ShmSegment seg;
+    SharedData *shared_data = attach_analyzer(&seg, shm_name);
+    if (shared_data == NULL) {
+        return 1;
+    }
+    
+    int result = 0;
+    MovieSnapshot snap;
+    if (!shared_data->ready) {
+        fprintf(stderr, "Analyzer is still loading, try again later\n");
+        result = 1;
+    } else if (movie_id < 1 || movie_id > shared_data->num_movies) {
+        fprintf(stderr, "MovieID %d out of range (1..%d)\n", movie_id, shared_data->num_movies);
+        result = 1;
+    } else if (snapshot_movie_detail(shared_data, shared_movies(shared_data), movie_id - 1,
+                                     &snap) != 0) {
+        fprintf(stderr, "Analyzer is busy updating, try again later\n");
+        result = 1;
+    } else {
+        OutBuf out;
+        out_init(&out, 512);
+        out_str(&out, "MovieID:  ");
+        out_i64(&out, movie_id);
+        out_str(&out, "\nCount:    ");
+        out_i64(&out, snap.count);
+        out_str(&out, "\nSum:      ");
+        out_half_stars(&out, snap.sum);
+        out_str(&out, "\nAverage:  ");
+        if (snap.count > 0) {
+            out_average(&out, snap.sum, snap.count);
+        } else {
+            out_str(&out, "0.0000");
+        }
+        out_str(&out, "\nStars:   ");
+        for (int b = 0; b < NUM_BUCKETS; b++) {
+            out_char(&out, ' ');
+            out_ratio(&out, b + 1, RATING_SCALE, 1);
+            out_char(&out, '=');
+            out_i64(&out, snap.hist[b]);
+        }
+        out_char(&out, '\n');
+        if (snap.distinct >= 0) {
+            out_str(&out, "Distinct: ~");
+            out_i64(&out, snap.distinct);
+            out_str(&out, " users\n");
+        }
+        
+        // --bucket: DISPLAY_LAST_BUCKETS bucket gần nhất
+        if (shared_data->num_time_buckets > 0) {
+            out_str(&out, "Recent (");
+            out_str(&out, bucket_name((BucketKind)shared_data->bucket_kind));
+            out_str(&out, "):\n");
+            for (int t = snap.first_bucket; t <= snap.last_bucket; t++) {
+                Counter bucket_count = snap.bucket_count[t - snap.first_bucket];
+                out_str(&out, "  ");
+                out_bucket_start(&out, shared_data, t);
+                out_char(&out, ' ');
+                out_i64_right(&out, bucket_count, 8);
+                if (bucket_count > 0) {
+                    out_char(&out, ' ');
+                    out_average(&out, snap.bucket_sum[t - snap.first_bucket], bucket_count);
+                }
+                out_char(&out, '\n');
+            }
+        }
+        out_write(&out, STDOUT_FILENO);
+        out_free(&out);
+    }
+    
+    shm_segment_detach(&seg);
+    return result;
+}
+
+/*
+ * Hàm: peak_rss_kb
+ * Mục đích: Peak RSS (KB) lớn nhất của parent và các child đã kết thúc
+ * (gồm cả page shared memory mà process đó đã chạm)
+ */
+long peak_rss_kb(void) {
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    return (self.ru_maxrss > children.ru_maxrss) ? self.ru_maxrss : children.ru_maxrss;
+}
+
+/*
+ * Hàm: total_lock_contended
+ * Mục đích: Tổng số lần chờ lock của mọi worker
+ */
+long long total_lock_contended(SharedData *shared_data) {
+    long long total = 0;
+    for (int w = 0; w < shared_data->num_workers; w++) {
+        total += worker_stats(shared_data)[w].lock_contended;
+    }
+    return total;
+}
+
+/*
+ * Hàm: display_timing
+ * Mục đích: Báo cáo thời gian xử lý để so sánh MODE_LOCK và MODE_LOCKFREE
+ */
+void display_timing(const RunReport *r) {
+    double total_ms = r->scan_ms + r->ingest_ms + r->merge_ms;
+    
+    printf("\n========== TIMING REPORT ==========\n");
+    printf("Engine:           %s\n", r->engine == ENGINE_THREAD ? "thread" : "process");
+    printf("Mode:             %s\n", mode_name(r->mode));
+    printf("Parser:           %s\n", parser_name(r->parser));
+    printf("Build:            %s\n", BUILD_FLAGS);
+    printf("Shared memory:    %s (huge pages: %s)\n", shm_backend_name(r->shm_backend),
+           shm_huge_name(r->shm_huge));
+    printf("Workers:          %d\n", r->num_workers);
+    printf("Scan time:        %.3f ms\n", r->scan_ms);
+    printf("Ingest time:      %.3f ms\n", r->ingest_ms);
+    printf("Merge time:       %.3f ms\n", r->merge_ms);
+    printf("Total time:       %.3f ms\n", total_ms);
+    if (r->sim_ms > 0) {
+        // Không tính vào Total / Throughput -> vẫn so sánh được với lần chạy không --similar
+        printf("Similarity time:  %.3f ms\n", r->sim_ms);
+    }
+    if (total_ms > 0) {
+        printf("Throughput:       %.0f ratings/s\n", r->total_ratings / (total_ms / 1000.0));
+    }
+    if (r->ingest_ms > 0) {
+        printf("Input bandwidth:  %.1f MB/s\n", r->total_bytes / 1e6 / (r->ingest_ms / 1000.0));
+    }
+    printf("Peak RSS:         %ld KB\n", r->peak_rss_kb);
+    if (r->mode == MODE_LOCK) {
+        printf("Lock contended:   %lld\n", r->lock_contended);
+    }
+    printf("===================================\n\n");
+}
+
+/*
+ * Hàm: append_report_csv
+ * Mục đích: (--report-csv) Thêm 1 dòng kết quả vào file CSV (ghi header nếu file
+ * mới / rỗng) -> nhiều lần chạy gom vào 1 bảng để so sánh / phát hiện chậm đi
+ * Trả về 0 nếu thành công, -1 nếu lỗi
+ */
+int append_report_csv(const char *path, const RunReport *r) {
+    FILE *file = fopen(path, "a");
+    if (file == NULL) {
+        perror("Cannot open report file");
+        return -1;
+    }
+    double total_ms = r->scan_ms + r->ingest_ms + r->merge_ms;
+    
+    if (ftello(file) == 0) {
+        fprintf(file, "engine,mode,parser,shm,huge,workers,ratings,bytes,scan_ms,ingest_ms,"
+                      "merge_ms,total_ms,ratings_per_s,mb_per_s,peak_rss_kb,lock_contended,"
+                      "sim_ms,build\n");
+    }
+    fprintf(file, "%s,%s,%s,%s,%s,%d,%lld,%lld,%.3f,%.3f,%.3f,%.3f,%.0f,%.1f,%ld,%lld,%.3f,%s\n",
+            r->engine == ENGINE_THREAD ? "thread" : "process",
+            mode_name(r->mode),
+            parser_name(r->parser),
+            shm_backend_name(r->shm_backend), shm_huge_name(r->shm_huge), r->num_workers,
+            r->total_ratings, r->total_bytes, r->scan_ms, r->ingest_ms, r->merge_ms, total_ms,
+            total_ms > 0 ? r->total_ratings / (total_ms / 1000.0) : 0.0,
+            r->ingest_ms > 0 ? r->total_bytes / 1e6 / (r->ingest_ms / 1000.0) : 0.0,
+            r->peak_rss_kb, r->lock_contended, r->sim_ms, BUILD_FLAGS);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+
+/*
+ * Hàm: display_worker_stats
+ * Mục đích: Busy time, số chunk (lấy trộm) của từng worker và độ lệch giữa
+ * worker bận nhất và rảnh nhất -> kiểm tra tải có cân bằng không
+ * MODE_HOT: thêm số movie hot và tỉ lệ rating đi vào bộ đếm riêng
+ * Số dòng bị loại của từng worker, tổng theo lý do
+ */
+void display_worker_stats(SharedData *shared_data, AggregateMode mode) {
+    WorkerStats *stats = worker_stats(shared_data);
+    double min_busy = 0, max_busy = 0;
+    
+    printf("========== WORKER BALANCE ==========\n");
+    printf("Chunks:           %d\n", shared_data->num_chunks);
+    printf("%-8s %12s %8s %8s %12s %10s %5s %5s", "Worker", "Busy (ms)", "Chunks", "Stolen",
+           "Rows", "Rejected", "CPU", "Node");
+    if (mode == MODE_HOT) {
+        printf(" %5s %6s", "Hot", "Hot %");
+    }
+    printf("\n");
+    long long rejected[REJECT_KINDS] = {0};
+    long long total_rejected = 0;
+    for (int w = 0; w < shared_data->num_workers; w++) {
+        long long worker_rejected = 0;
+        for (int k = 0; k < REJECT_KINDS; k++) {
+            rejected[k] += stats[w].rejected[k];
+            worker_rejected += stats[w].rejected[k];
+        }
+        total_rejected += worker_rejected;
+        printf("%-8d %12.3f %8d %8d %12lld %10lld", w + 1, stats[w].busy_ms,
+               stats[w].chunks, stats[w].stolen, stats[w].rows, worker_rejected);
+        if (stats[w].cpu >= 0) {
+            printf(" %5d %5d", stats[w].cpu, stats[w].node);
+        } else {
+            printf(" %5s %5s", "-", "-");
+        }
+        if (mode == MODE_HOT) {
+            printf(" %5d %5.1f%%", stats[w].hot_keys,
+                   stats[w].rows > 0 ? stats[w].hot_rows * 100.0 / stats[w].rows : 0.0);
+        }
+        printf("\n");
+        if (w == 0 || stats[w].busy_ms < min_busy) {
+            min_busy = stats[w].busy_ms;
+        }
+        if (w == 0 || stats[w].busy_ms > max_busy) {
+            max_busy = stats[w].busy_ms;
+        }
+    }
+    if (max_busy > 0) {
+        printf("Busy spread:      %.1f%% (max - min) / max\n",
+               (max_busy - min_busy) / max_busy * 100.0);
+    }
+    if (total_rejected > 0) {
+        printf("Rejected rows:    %lld (", total_rejected);
+        for (int k = 0; k < REJECT_KINDS; k++) {
+            printf("%s%s %lld", k > 0 ? ", " : "", reject_reason_name(k), rejected[k]);
+        }
+        printf(")\n");
+    }
+    printf("====================================\n\n");
+}
+
+
+#ifdef PROFILE
+/*
+ * Hàm: display_profile_row
+ * Mục đích: 1 dòng của bảng WORKER PROFILE (update_ns: thời gian cập nhật bảng ước lượng)
+ */
+static void display_profile_row(const char *label, const WorkerProfile *p, double update_ns) {
+    double parse_ns = p->busy_ns > update_ns ? p->busy_ns - update_ns : 0.0;
+    
+    printf("%-8s %12lld %10lld %12lld %12lld %10.1f %10.3f %10.3f %8.1f %8.1f\n", label,
+           p->rows_parsed, p->rows_rejected, p->lock_acquires, p->lock_spins,
+           p->bytes_read / 1e6, parse_ns / 1e6, update_ns / 1e6,
+           p->rows_parsed > 0 ? parse_ns / p->rows_parsed : 0.0,
+           p->rows_updated > 0 ? update_ns / p->rows_updated : 0.0);
+}
+
+/*
+ * Hàm: display_worker_profile
+ * Mục đích: (make profile) Bộ đếm hot loop của từng worker và tổng: dòng đã parse / bị
+ * loại, lock, bytes đã đọc, thời gian parse và cập nhật bảng (tổng và ns mỗi dòng)
+ * Parse = busy - cập nhật bảng (gồm cả đọc file và validate)
+ */
+void display_worker_profile(SharedData *shared_data) {
+    WorkerStats *stats = worker_stats(shared_data);
+    WorkerProfile total;
+    double total_update_ns = 0;
+    char label[16];
+    
+    memset(&total, 0, sizeof(total));
+    printf("========== WORKER PROFILE ==========\n");
+    printf("%-8s %12s %10s %12s %12s %10s %10s %10s %8s %8s\n", "Worker", "Parsed", "Rejected",
+           "Lock acq", "Spins", "MB read", "Parse ms", "Update ms", "Parse/r", "Upd/r");
+    for (int w = 0; w < shared_data->num_workers; w++) {
+        const WorkerProfile *p = &stats[w].prof;
+        double update_ns = prof_update_ns(p);
+        snprintf(label, sizeof(label), "%d", w + 1);
+        display_profile_row(label, p, update_ns);
+        
+        total.rows_parsed += p->rows_parsed;
+        total.rows_rejected += p->rows_rejected;
+        total.rows_updated += p->rows_updated;
+        total.lock_acquires += p->lock_acquires;
+        total.lock_spins += p->lock_spins;
+        total.bytes_read += p->bytes_read;
+        total.busy_ns += p->busy_ns;
+        total_update_ns += update_ns;
+    }
+    display_profile_row("Total", &total, total_update_ns);
+    printf("Parse/r, Upd/r: ns per row\n");
+    printf("====================================\n\n");
+}
+#endif
+
+/*
+ * Hàm: out_movie_header
+ * Mục đích: Tiêu đề bảng MOVIE AVERAGE RATINGS
+ */
+void out_movie_header(const SharedData *shared_data, OutBuf *out) {
+    out_str(out, "\n========== MOVIE AVERAGE RATINGS ==========\n");
+    out_str(out, "MovieID    Total Ratings   Count      Average             "
+                 "1*     2*     3*     4*     5*");
+    out_str(out, shared_data->hll_bits > 0 ? "   Users~\n" : "\n");
+    out_str(out, "=====================================================\n");
+}
+
+/*
+ * Hàm: out_movie_row
+ * Mục đích: 1 dòng của bảng movie: movie index i của tables, hiển thị với movieID id
+ * (tables có thể là bảng chính hoặc bảng 1 partition của --spill)
+ */
+void out_movie_row(const SharedData *shared_data, AggTables tables, int i, long long id,
+                   OutBuf *out) {
+    Counter sum = tables.sum[i];
+    Counter count = tables.count[i];
+    size_t field = out->len;
+    out_i64(out, id);
+    out_field(out, field, 10);
+    field = out->len;
+    out_half_stars(out, sum);
+    out_field(out, field, 15);
+    field = out->len;
+    out_i64(out, count);
+    out_field(out, field, 10);
+    field = out->len;
+    out_average(out, sum, count);  // Average của MOVIE NÀY
+    out_pad(out, field, 15);
+    // Histogram: cột s* gồm các rating trong (s - 1, s] (0.5 tính vào 1*)
+    for (int star = 0; star < NUM_STARS; star++) {
+        Counter stars = 0;
+        for (int b = star * RATING_SCALE; b < (star + 1) * RATING_SCALE; b++) {
+            stars += tables.hist[b][i];
+        }
+        out_char(out, ' ');
+        out_i64_right(out, stars, 6);
+    }
+    if (tables.hll != NULL) {
+        out_char(out, ' ');
+        out_i64_right(out, movie_distinct(shared_data, tables, i), 8);
+    }
+    out_char(out, '\n');
+}
+
+/*
+ * Hàm: out_movie_footer
+ * Mục đích: Tổng kết bảng movie: số movie có rating, tổng số ratings, average chung
+ */
+void out_movie_footer(const SharedData *shared_data, int total_movies_with_ratings,
+                      Counter overall_sum, Counter overall_count, OutBuf *out) {
+    out_str(out, "=====================================================\n");
+    out_str(out, "Total movies with ratings: ");
+    out_i64(out, total_movies_with_ratings);
+    out_str(out, " / ");
+    out_i64(out, shared_data->num_movies);
+    out_str(out, "\nTotal ratings processed: ");
+    out_i64(out, overall_count);
+    out_char(out, '\n');
+    
+    if (overall_count > 0) {
+        out_str(out, "Overall average rating: ");
+        out_average(out, overall_sum, overall_count);
+        out_char(out, '\n');
+    }
+    
+    if (total_movies_with_ratings > DISPLAY_FIRST_N) {
+        out_str(out, "(Showing first ");
+        out_i64(out, DISPLAY_FIRST_N);
+        out_str(out, " of ");
+        out_i64(out, total_movies_with_ratings);
+        out_str(out, " movies)\n");
+    }
+    out_str(out, "=====================================================\n\n");
+}
+
+/*
+ * Hàm: display_results
+ * Mục đích: Hiển thị average rating của TẤT CẢ MOVIES (ghi vào out)
+ */
+void display_results(SharedData *shared_data, OutBuf *out) {
+    out_movie_header(shared_data, out);
+    
+    AggTables movies = shared_movies(shared_data);
+    int total_movies_with_ratings = 0;
+    Counter overall_sum = 0;
+    Counter overall_count = 0;
+    
+    // Duyệt qua TẤT CẢ movies
+    for (int i = 0; i < shared_data->num_movies; i++) {
+        if (movies.count[i] > 0) {
+            // Hiển thị N movies đầu tiên 
+            if (total_movies_with_ratings < DISPLAY_FIRST_N) {
+                out_movie_row(shared_data, movies, i, i + 1, out);
+            }
+            
+            total_movies_with_ratings++;
+            overall_sum += movies.sum[i];
+            overall_count += movies.count[i];
+        }
+    }
+    
+    out_movie_footer(shared_data, total_movies_with_ratings, overall_sum, overall_count, out);
+}
+
+
+/*
+ * Hàm: out_user_header
+ * Mục đích: Tiêu đề bảng USER AVERAGE RATINGS
+ */
+void out_user_header(OutBuf *out) {
+    out_str(out, "\n========== USER AVERAGE RATINGS ==========\n");
+    out_str(out, "UserID     Total Ratings   Count      Average        \n");
+    out_str(out, "=====================================================\n");
+}
+
+/*
+ * Hàm: out_user_row
+ * Mục đích: 1 dòng của bảng user: user index u của tables, hiển thị với userID id
+ */
+void out_user_row(AggTables tables, int u, long long id, OutBuf *out) {
+    Counter count = tables.user_count[u];
+    size_t field = out->len;
+    out_i64(out, id);
+    out_field(out, field, 10);
+    field = out->len;
+    out_half_stars(out, tables.user_sum[u]);
+    out_field(out, field, 15);
+    field = out->len;
+    out_i64(out, count);
+    out_field(out, field, 10);
+    field = out->len;
+    out_average(out, tables.user_sum[u], count);
+    out_pad(out, field, 15);
+    out_char(out, '\n');
+}
+
+/*
+ * Hàm: out_user_footer
+ * Mục đích: Tổng kết bảng user
+ */
+void out_user_footer(const SharedData *shared_data, int total_users_with_ratings, OutBuf *out) {
+    out_str(out, "=====================================================\n");
+    out_str(out, "Total users with ratings: ");
+    out_i64(out, total_users_with_ratings);
+    out_str(out, " / ");
+    out_i64(out, shared_data->num_users);
+    out_char(out, '\n');
+    if (total_users_with_ratings > DISPLAY_FIRST_USERS) {
+        out_str(out, "(Showing first ");
+        out_i64(out, DISPLAY_FIRST_USERS);
+        out_str(out, " of ");
+        out_i64(out, total_users_with_ratings);
+        out_str(out, " users)\n");
+    }
+    out_str(out, "=====================================================\n\n");
+}
+
+/*
+ * Hàm: display_user_results
+ * Mục đích: Hiển thị số lượng và average rating của TỪNG USER
+ * (được tính cùng lần đọc với bảng movie)
+ */
+void display_user_results(SharedData *shared_data, OutBuf *out) {
+    out_user_header(out);
+    
+    AggTables tables = shared_movies(shared_data);
+    int total_users_with_ratings = 0;
+    
+    for (int u = 0; u < shared_data->num_users; u++) {
+        if (tables.user_count[u] > 0) {
+            if (total_users_with_ratings < DISPLAY_FIRST_USERS) {
+                out_user_row(tables, u, u + 1, out);
+            }
+            total_users_with_ratings++;
+        }
+    }
+    
+    out_user_footer(shared_data, total_users_with_ratings, out);
+}
+
+
+/*
+ * Hàm: display_bucket_results
+ * Mục đích: (--bucket) Số ratings, số movie và average của DISPLAY_LAST_BUCKETS
+ * bucket thời gian gần nhất, tính từ bảng bucket (không đọc lại input)
+ */
+void display_bucket_results(SharedData *shared_data, OutBuf *out) {
+    AggTables tables = shared_movies(shared_data);
+    int last = last_active_bucket(shared_data);
+    int first = (last - DISPLAY_LAST_BUCKETS + 1 > 0) ? last - DISPLAY_LAST_BUCKETS + 1 : 0;
+    
+    out_str(out, "\n========== RATINGS PER ");
+    out_str(out, bucket_name((BucketKind)shared_data->bucket_kind));
+    out_str(out, " ==========\n");
+    out_str(out, "Start        Count      Movies     Average        \n");
+    out_str(out, "=====================================================\n");
+    
+    for (int t = first; t <= last; t++) {
+        const Counter *row_sum = tables.bucket_sum + (size_t)t * shared_data->movie_stride;
+        const Counter *row_count = tables.bucket_count + (size_t)t * shared_data->movie_stride;
+        Counter sum = 0, count = 0;
+        int movies = 0;
+        for (int i = 0; i < shared_data->num_movies; i++) {
+            sum += row_sum[i];
+            count += row_count[i];
+            movies += (row_count[i] > 0);
+        }
+        
+        size_t field = out->len;
+        out_bucket_start(out, shared_data, t);
+        out_field(out, field, 12);
+        field = out->len;
+        out_i64(out, count);
+        out_field(out, field, 10);
+        field = out->len;
+        out_i64(out, movies);
+        out_field(out, field, 10);
+        field = out->len;
+        if (count > 0) {
+            out_average(out, sum, count);
+        } else {
+            out_char(out, '-');
+        }
+        out_pad(out, field, 15);
+        out_char(out, '\n');
+    }
+    
+    out_str(out, "=====================================================\n");
+    out_str(out, "Buckets in table: ");
+    out_i64(out, shared_data->num_time_buckets);
+    out_str(out, " (from ");
+    out_bucket_start(out, shared_data, 0);
+    out_str(out, ")\n");
+    if (last + 1 > DISPLAY_LAST_BUCKETS) {
+        out_str(out, "(Showing last ");
+        out_i64(out, DISPLAY_LAST_BUCKETS);
+        out_str(out, " of ");
+        out_i64(out, last + 1);
+        out_str(out, " buckets)\n");
+    }
+    out_str(out, "=====================================================\n\n");
+}
+
+
+/*
+ * Hàm: top_candidate
+ * Mục đích: Điền entry của movieID id (score theo opts->rank, global_mean cho RANK_BAYES)
+ * Trả về 1 nếu movie đủ min_ratings để được xếp hạng
+ */
+static inline int top_candidate(const TopOptions *opts, double global_mean, int id, Counter sum,
+                                Counter count, TopEntry *entry) {
+    if (count == 0 || count < opts->min_ratings) {
+        return 0;
+    }
+    entry->id = id;
+    entry->count = count;
+    entry->average = average_stars(sum, count);
+    entry->score = (opts->rank == RANK_BAYES)
+        ? (opts->prior * global_mean + (double)sum / RATING_SCALE) / (double)(opts->prior + count)
+        : entry->average;
+    return 1;
+}
+
+/*
+ * Hàm: select_top_movies
+ * Mục đích: Chọn top K movies có rating cao nhất (với ít nhất min_ratings ratings)
+ * Dùng min-heap K phần tử (topk.h): O(N log K), K lớn (10k) vẫn nhanh
+ *
+ * RANK_MEAN:  xếp theo average
+ * RANK_BAYES: xếp theo Bayesian average = (prior * C + sum) / (prior + count)
+ *             C = average của tất cả ratings -> movie ít ratings bị kéo về C
+ * --window N: chỉ tính ratings trong N bucket gần nhất (xem window_totals),
+ *             *window_first = index bucket đầu của cửa sổ (-1 nếu không dùng)
+ *
+ * Trả về số movie trong *top (đã sắp giảm dần, caller free), -1 nếu lỗi
+ */
+int select_top_movies(SharedData *shared_data, const TopOptions *opts, TopEntry **top,
+                      double *global_mean, int *window_first) {
+    AggTables movies = shared_movies(shared_data);
+    const Counter *sums = movies.sum;
+    const Counter *counts = movies.count;
+    Counter *window_sums = NULL;
+    Counter *window_counts = NULL;
+    
+    *window_first = -1;
+    if (opts->window > 0 && shared_data->num_time_buckets > 0) {
+        *window_first = window_totals(shared_data, opts->window, &window_sums, &window_counts);
+        if (*window_first < 0) {
+            return -1;
+        }
+        sums = window_sums;
+        counts = window_counts;
+    }
+    
+    // Average toàn bộ (dùng cho RANK_BAYES)
+    Counter overall_sum = 0;
+    Counter overall_count = 0;
+    for (int i = 0; i < shared_data->num_movies; i++) {
+        overall_sum += sums[i];
+        overall_count += counts[i];
+    }
+    *global_mean = overall_count > 0 ? average_stars(overall_sum, overall_count) : 0.0;
+    
+    *top = malloc((size_t)(opts->top_k > 0 ? opts->top_k : 1) * sizeof(TopEntry));
+    if (*top == NULL) {
+        perror("malloc failed");
+        free(window_sums);
+        free(window_counts);
+        return -1;
+    }
+    int top_count = 0;
+    
+    for (int i = 0; i < shared_data->num_movies; i++) {
+        TopEntry entry;
+        if (top_candidate(opts, *global_mean, i + 1, sums[i], counts[i], &entry)) {
+            topk_push(*top, &top_count, opts->top_k, &entry);
+        }
+    }
+    
+    // Sắp xếp giảm dần theo score
+    topk_sort(*top, top_count);
+    free(window_sums);
+    free(window_counts);
+    return top_count;
+}
+
+/*
+ * Hàm: out_top_table
+ * Mục đích: Bảng TOP K từ top[0..top_count) đã sắp xếp (xem select_top_movies)
+ */
+void out_top_table(const SharedData *shared_data, const TopOptions *opts, const TopEntry *top,
+                   int top_count, double global_mean, int window_first, OutBuf *out) {
+    out_str(out, "\n========== TOP ");
+    out_i64(out, opts->top_k);
+    out_str(out, " HIGHEST RATED MOVIES ==========\n");
+    out_str(out, "(Minimum ");
+    out_i64(out, opts->min_ratings);
+    out_str(out, " ratings required");
+    if (opts->rank == RANK_BAYES) {
+        out_str(out, ", Bayesian rank: prior ");
+        out_i64(out, opts->prior);
+        out_str(out, " at mean ");
+        out_double(out, global_mean, 4);
+    }
+    if (window_first >= 0) {
+        out_str(out, ", last ");
+        out_i64(out, opts->window);
+        out_char(out, ' ');
+        out_str(out, bucket_name((BucketKind)shared_data->bucket_kind));
+        out_str(out, "(s) from ");
+        out_bucket_start(out, shared_data, window_first);
+    }
+    out_str(out, ")\n");
+    out_str(out, "MovieID    Count      Average         Score          \n");
+    out_str(out, "=====================================================\n");
+    
+    // Hiển thị
+    for (int i = 0; i < top_count; i++) {
+        size_t field = out->len;
+        out_i64(out, top[i].id);
+        out_field(out, field, 10);
+        field = out->len;
+        out_i64(out, top[i].count);
+        out_field(out, field, 10);
+        field = out->len;
+        out_double(out, top[i].average, 4);
+        out_field(out, field, 15);
+        field = out->len;
+        out_double(out, top[i].score, 4);
+        out_pad(out, field, 15);
+        out_char(out, '\n');
+    }
+    
+    out_str(out, "=====================================================\n");
+    out_str(out, "Total movies shown: ");
+    out_i64(out, top_count);
+    out_str(out, "\n=====================================================\n\n");
+}
+
+/*
+ * Hàm: display_top_movies
+ * Mục đích: Hiển thị top K movies (xem select_top_movies)
+ */
+void display_top_movies(SharedData *shared_data, const TopOptions *opts, OutBuf *out) {
+    TopEntry *top;
+    double global_mean;
+    int window_first;
+    int top_count = select_top_movies(shared_data, opts, &top, &global_mean, &window_first);
+    if (top_count < 0) {
+        return;
+    }
+    out_top_table(shared_data, opts, top, top_count, global_mean, window_first, out);
+    free(top);
+}
+
+/*
+ * Hàm: display_similar_movies
+ * Mục đích: (--similar) Láng giềng gần nhất của các movie trong top K
+ */
+void display_similar_movies(SharedData *shared_data, const TopOptions *opts,
+                            const SimIndex *sim, OutBuf *out) {
+    TopEntry *top;
+    double global_mean;
+    int window_first;
+    int top_count = select_top_movies(shared_data, opts, &top, &global_mean, &window_first);
+    if (top_count < 0) {
+        return;
+    }
+    
+    out_str(out, "\n========== SIMILAR MOVIES (");
+    out_str(out, sim_metric_name(sim->metric));
+    out_str(out, ", top ");
+    out_i64(out, sim->top_n);
+    out_str(out, ", >= ");
+    out_i64(out, sim->min_common);
+    out_str(out, " common users) ==========\n");
+    out_str(out, "MovieID    Neighbor   Common     Score          \n");
+    out_str(out, "=====================================================\n");
+    for (int i = 0; i < top_count; i++) {
+        int x = top[i].id - 1;
+        const SimNeighbor *nb = sim->neighbors + (size_t)x * sim->top_n;
+        if (sim->num_neighbors[x] == 0) {
+            size_t field = out->len;
+            out_i64(out, top[i].id);
+            out_field(out, field, 10);
+            out_str(out, "-\n");
+        }
+        for (int k = 0; k < sim->num_neighbors[x]; k++) {
+            size_t field = out->len;
+            if (k == 0) {
+                out_i64(out, top[i].id);
+            }
+            out_field(out, field, 10);
+            field = out->len;
+            out_i64(out, nb[k].movie);
+            out_field(out, field, 10);
+            field = out->len;
+            out_i64(out, nb[k].common);
+            out_field(out, field, 10);
+            out_score(out, nb[k].score);
+            out_char(out, '\n');
+        }
+    }
+    out_str(out, "=====================================================\n\n");
+    free(top);
+}
+
+
+/*
+ * Hàm: out_movie_csv_header
+ * Mục đích: Dòng tiêu đề của --format csv
+ */
+void out_movie_csv_header(int distinct, OutBuf *out) {
+    out_str(out, "movie_id,sum,count,average");
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+        out_str(out, ",r");
+        out_ratio(out, b + 1, RATING_SCALE, 1);
+    }
+    out_str(out, distinct ? ",distinct_users\n" : "\n");
+}
+
+/*
+ * Hàm: out_movie_csv
+ * Mục đích: 1 dòng csv của movie index i trong tables (movieID id)
+ */
+void out_movie_csv(const SharedData *shared_data, AggTables tables, int i, long long id,
+                   OutBuf *out) {
+    out_i64(out, id);
+    out_char(out, ',');
+    out_half_stars(out, tables.sum[i]);
+    out_char(out, ',');
+    out_i64(out, tables.count[i]);
+    out_char(out, ',');
+    out_average(out, tables.sum[i], tables.count[i]);
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+        out_char(out, ',');
+        out_i64(out, tables.hist[b][i]);
+    }
+    if (tables.hll != NULL) {
+        out_char(out, ',');
+        out_i64(out, movie_distinct(shared_data, tables, i));
+    }
+    out_char(out, '\n');
+}
+
+/*
+ * Hàm: write_results_csv
+ * Mục đích: --format csv: 1 dòng / movie có rating (không giới hạn DISPLAY_FIRST_N)
+ * Cột histogram theo nửa sao: r0.5 .. r5.0
+ */
+void write_results_csv(SharedData *shared_data, OutBuf *out) {
+    AggTables movies = shared_movies(shared_data);
+    
+    out_movie_csv_header(movies.hll != NULL, out);
+    for (int i = 0; i < shared_data->num_movies; i++) {
+        if (movies.count[i] > 0) {
+            out_movie_csv(shared_data, movies, i, i + 1, out);
+        }
+    }
+}
+
+/*
+ * Hàm: out_movie_json
+ * Mục đích: 1 phần tử của mảng "movies" (movie index i trong tables, movieID id)
+ */
+void out_movie_json(const SharedData *shared_data, AggTables tables, int i, long long id,
+                    int first, OutBuf *out) {
+    out_str(out, first ? "\n{\"id\":" : ",\n{\"id\":");
+    out_i64(out, id);
+    out_str(out, ",\"count\":");
+    out_i64(out, tables.count[i]);
+    out_str(out, ",\"sum\":");
+    out_half_stars(out, tables.sum[i]);
+    out_str(out, ",\"average\":");
+    out_average(out, tables.sum[i], tables.count[i]);
+    out_str(out, ",\"hist\":[");
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+        if (b > 0) {
+            out_char(out, ',');
+        }
+        out_i64(out, tables.hist[b][i]);
+    }
+    out_char(out, ']');
+    if (tables.hll != NULL) {
+        out_str(out, ",\"distinct_users\":");
+        out_i64(out, movie_distinct(shared_data, tables, i));
+    }
+    out_char(out, '}');
+}
+
+/*
+ * Hàm: out_user_json
+ * Mục đích: 1 phần tử của mảng "users" (user index u trong tables, userID id)
+ */
+void out_user_json(AggTables tables, int u, long long id, int first, OutBuf *out) {
+    out_str(out, first ? "\n{\"id\":" : ",\n{\"id\":");
+    out_i64(out, id);
+    out_str(out, ",\"count\":");
+    out_i64(out, tables.user_count[u]);
+    out_str(out, ",\"sum\":");
+    out_half_stars(out, tables.user_sum[u]);
+    out_str(out, ",\"average\":");
+    out_average(out, tables.user_sum[u], tables.user_count[u]);
+    out_char(out, '}');
+}
+
+/*
+ * Hàm: out_top_json
+ * Mục đích: Phần "top" của --format json từ top[0..top_count) (top_count < 0: rỗng)
+ */
+void out_top_json(const SharedData *shared_data, const TopOptions *opts, const TopEntry *top,
+                  int top_count, int window_first, OutBuf *out) {
+    out_str(out, ",\"top\":{\"k\":");
+    out_i64(out, opts->top_k);
+    out_str(out, ",\"min_ratings\":");
+    out_i64(out, opts->min_ratings);
+    out_str(out, opts->rank == RANK_BAYES ? ",\"rank\":\"bayes\"" : ",\"rank\":\"mean\"");
+    if (window_first >= 0) {
+        out_str(out, ",\"window\":");
+        out_i64(out, opts->window);
+        out_str(out, ",\"window_start\":\"");
+        out_bucket_start(out, shared_data, window_first);
+        out_char(out, '"');
+    }
+    out_str(out, ",\"movies\":[");
+    for (int i = 0; i < top_count; i++) {
+        out_str(out, i > 0 ? ",\n{\"id\":" : "\n{\"id\":");
+        out_i64(out, top[i].id);
+        out_str(out, ",\"count\":");
+        out_i64(out, top[i].count);
+        out_str(out, ",\"average\":");
+        out_double(out, top[i].average, 4);
+        out_str(out, ",\"score\":");
+        out_double(out, top[i].score, 4);
+        out_char(out, '}');
+    }
+    out_str(out, "\n]}");
+}
+
+/*
+ * Hàm: write_results_json
+ * Mục đích: --format json: {"movies": [...], "users": [...], "buckets": {...}, "top": {...},
+ * "similar": {...}} ("buckets" chỉ có khi --bucket, "similar" khi --similar)
+ * Chỉ gồm movie / user có rating, không giới hạn số dòng như bảng
+ */
+void write_results_json(SharedData *shared_data, const TopOptions *opts, const SimIndex *sim,
+                        OutBuf *out) {
+    AggTables tables = shared_movies(shared_data);
+    int first = 1;
+    
+    out_str(out, "{\"movies\":[");
+    for (int i = 0; i < shared_data->num_movies; i++) {
+        if (tables.count[i] > 0) {
+            out_movie_json(shared_data, tables, i, i + 1, first, out);
+            first = 0;
+        }
+    }
+    
+    out_str(out, "\n],\"users\":[");
+    first = 1;
+    for (int u = 0; u < shared_data->num_users; u++) {
+        if (tables.user_count[u] > 0) {
+            out_user_json(tables, u, u + 1, first, out);
+            first = 0;
+        }
+    }
+    
+    if (shared_data->num_time_buckets > 0) {
+        AggTables movies = shared_movies(shared_data);
+        out_str(out, "\n],\"buckets\":{\"kind\":\"");
+        out_str(out, bucket_name((BucketKind)shared_data->bucket_kind));
+        out_str(out, "\",\"totals\":[");
+        first = 1;
+        for (int t = 0; t < shared_data->num_time_buckets; t++) {
+            Counter sum = 0, count = 0;
+            const Counter *row_sum = movies.bucket_sum + (size_t)t * shared_data->movie_stride;
+            const Counter *row_count = movies.bucket_count + (size_t)t * shared_data->movie_stride;
+            for (int i = 0; i < shared_data->num_movies; i++) {
+                sum += row_sum[i];
+                count += row_count[i];
+            }
+            if (count == 0) {
+                continue;
+            }
+            out_str(out, first ? "\n{\"start\":\"" : ",\n{\"start\":\"");
+            first = 0;
+            out_bucket_start(out, shared_data, t);
+            out_str(out, "\",\"count\":");
+            out_i64(out, count);
+            out_str(out, ",\"sum\":");
+            out_half_stars(out, sum);
+            out_str(out, ",\"average\":");
+            out_average(out, sum, count);
+            out_char(out, '}');
+        }
+        out_str(out, "\n]}");
+    } else {
+        out_str(out, "\n]");
+    }
+    
+    TopEntry *top;
+    double global_mean;
+    int window_first;
+    int top_count = select_top_movies(shared_data, opts, &top, &global_mean, &window_first);
+    out_top_json(shared_data, opts, top, top_count, window_first, out);
+    if (top_count >= 0) {
+        free(top);
+    }
+    
+    if (sim != NULL) {
+        out_str(out, ",\"similar\":{\"metric\":\"");
+        out_str(out, sim_metric_name(sim->metric));
+        out_str(out, "\",\"n\":");
+        out_i64(out, sim->top_n);
+        out_str(out, ",\"min_common\":");
+        out_i64(out, sim->min_common);
+        out_str(out, ",\"movies\":[");
+        first = 1;
+        for (int x = 0; x < sim->num_movies; x++) {
+            if (sim->num_neighbors[x] == 0) {
+                continue;
+            }
+            const SimNeighbor *nb = sim->neighbors + (size_t)x * sim->top_n;
+            out_str(out, first ? "\n{\"id\":" : ",\n{\"id\":");
+            first = 0;
+            out_i64(out, x + 1);
+            out_str(out, ",\"neighbors\":[");
+            for (int k = 0; k < sim->num_neighbors[x]; k++) {
+                out_str(out, k > 0 ? ",{\"id\":" : "{\"id\":");
+                out_i64(out, nb[k].movie);
+                out_str(out, ",\"common\":");
+                out_i64(out, nb[k].common);
+                out_str(out, ",\"score\":");
+                out_score(out, nb[k].score);
+                out_char(out, '}');
+            }
+            out_str(out, "]}");
+        }
+        out_str(out, "\n]}");
+    }
+    out_str(out, "}\n");
+}
+
+/*
+ * Hàm: write_results
+ * Mục đích: Ghi toàn bộ kết quả theo format vào buffer rồi ra fd bằng 1 lần write()
+ * sim: láng giềng của --similar (NULL nếu không có; csv không có phần này)
+ */
+void write_results(SharedData *shared_data, const TopOptions *opts, const SimIndex *sim,
+                   OutputFormat format, int fd) {
+    OutBuf out;
+    // ~100 bytes / movie -> đủ cho bảng 100k mà không phải realloc
+    out_init(&out, (size_t)shared_data->num_movies * 100 + 64 * 1024);
+    
+    if (format == FORMAT_CSV) {
+        write_results_csv(shared_data, &out);
+    } else if (format == FORMAT_JSON) {
+        write_results_json(shared_data, opts, sim, &out);
+    } else {
+        display_results(shared_data, &out);
+        display_user_results(shared_data, &out);
+        if (shared_data->num_time_buckets > 0) {
+            display_bucket_results(shared_data, &out);
+        }
+        display_top_movies(shared_data, opts, &out);
+        if (sim != NULL) {
+            display_similar_movies(shared_data, opts, sim, &out);
+        }
+    }
+    
+    fflush(stdout);  // Những gì đã printf phải ra trước kết quả
+    if (out_write(&out, fd) == -1) {
+        perror("write results failed");
+    }
+    out_free(&out);
+}
+
+
+// Trạng thái ghi kết quả của --spill giữa các lần spill_emit
+typedef struct {
+    SharedData *shared_data;
+    const TopOptions *opts;
+    OutputFormat format;
+    int fd;
+    OutBuf *out;
+    TopEntry *top;             // Heap top K, chọn dần qua các partition movie
+    int top_count;
+    double global_mean;
+    int shown;                 // Số movie / user có rating của kind hiện tại
+} SpillOutput;
 
 /*
- * Hàm: calculate_average
- * Mục đích: Đọc file và cập nhật shared memory CHO TỪNG MOVIE
- * 
- * ĐÂY LÀ PHẦN QUAN TRỌNG NHẤT:
- * - Đọc từng dòng
- * - Xác định movieID
- * - Cập nhật sum và count CHO MOVIE ĐÓ trong shared memory
+ * Hàm: spill_emit
+ * Mục đích: (--spill) Ghi các dòng của 1 partition đã tổng hợp (xem spill_aggregate),
+ * movie thì đưa vào heap top K; buffer đạt SPILL_OUT_FLUSH thì ghi ra fd
  */
-void calculate_average(const char *filename, SharedData *shared_data, int process_id) {
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
-        printf("[Child %d - PID %d] ERROR: Cannot open file %s\n", 
-               process_id, getpid(), filename);
-        exit(1);
+static int spill_emit(void *ctx, SpillKind kind, const SpillTable *table, long long base, int n) {
+    SpillOutput *so = ctx;
+    OutBuf *out = so->out;
+    AggTables part;
+    memset(&part, 0, sizeof(part));
+    if (kind == SPILL_MOVIES) {
+        part.sum = table->sum;
+        part.count = table->count;
+        for (int b = 0; b < NUM_BUCKETS; b++) {
+            part.hist[b] = table->hist[b];
+        }
+    } else {
+        part.user_sum = table->sum;
+        part.user_count = table->count;
     }
     
-    printf("[Child %d - PID %d] Started reading %s\n", 
-           process_id, getpid(), filename);
-    
-    int user_id, movie_id, timestamp;
-    double rating;  
-    int lines_read = 0;
-    
-    // Đọc từng dòng trong file
-    // Format: userID <tab> movieID <tab> rating <tab> timestamp
-    while (fscanf(file, "%d\t%d\t%lf\t%d", &user_id, &movie_id, &rating, &timestamp) == 4) {
-        lines_read++;
-        
-        // Validate movieID (phải từ 1 đến 1682)
-        if (movie_id < 1 || movie_id > MAX_MOVIES) {
-            printf("[Child %d] WARNING: Invalid movieID %d at line %d\n", 
-                   process_id, movie_id, lines_read);
+    for (int i = 0; i < n; i++) {
+        long long id = base + i + 1;
+        if (kind == SPILL_USERS) {
+            if (part.user_count[i] == 0) {
+                continue;
+            }
+            if (so->format == FORMAT_JSON) {
+                out_user_json(part, i, id, so->shown == 0, out);
+            } else if (so->shown < DISPLAY_FIRST_USERS) {
+                out_user_row(part, i, id, out);
+            }
+            so->shown++;
             continue;
         }
-        
-        // Validate rating (phải từ 1 đến 5)
-        if (rating < 1.0 || rating > 5.0) {
-            printf("[Child %d] WARNING: Invalid rating %.1f at line %d\n", 
-                   process_id, rating, lines_read);
+        if (part.count[i] == 0) {
             continue;
         }
-        
-        // ========================================
-        // QUAN TRỌNG: Acquire lock trước khi cập nhật
-        // Vì 2 child processes có thể cập nhật CÙNG movie đồng thời
-        // ========================================
-        acquire_lock(&shared_data->lock);
-        
-        // Index trong mảng = movieID - 1 (vì array bắt đầu từ 0)
-        int index = movie_id - 1;
-        
-        // Nếu lần đầu gặp movie này, khởi tạo
-        if (shared_data->movies[index].is_used == 0) {
-            shared_data->movies[index].movieID = movie_id;
-            shared_data->movies[index].sum_ratings = 0;
-            shared_data->movies[index].count = 0;
-            shared_data->movies[index].is_used = 1;
+        if (so->format == FORMAT_CSV) {
+            out_movie_csv(so->shared_data, part, i, id, out);
+        } else if (so->format == FORMAT_JSON) {
+            out_movie_json(so->shared_data, part, i, id, so->shown == 0, out);
+        } else if (so->shown < DISPLAY_FIRST_N) {
+            out_movie_row(so->shared_data, part, i, id, out);
         }
-        
-        // Cập nhật sum và count CHO MOVIE NÀY
-        shared_data->movies[index].sum_ratings += (int)rating;  
-        shared_data->movies[index].count++;
-        
-        // Release lock
-        release_lock(&shared_data->lock);
-        
-        // In progress mỗi 10000 dòng
-        if (lines_read % 10000 == 0) {
-            printf("[Child %d] Progress: %d lines processed...\n", 
-                   process_id, lines_read);
+        so->shown++;
+        TopEntry entry;
+        if (top_candidate(so->opts, so->global_mean, (int)id, part.sum[i], part.count[i],
+                          &entry)) {
+            topk_push(so->top, &so->top_count, so->opts->top_k, &entry);
         }
     }
-    
-    fclose(file);
-    printf("[Child %d - PID %d] Completed: Read %d lines from %s\n", 
-           process_id, getpid(), lines_read, filename);
+    if (out->len >= SPILL_OUT_FLUSH && out_write(out, so->fd) == -1) {
+        perror("write results failed");
+        return -1;
+    }
+    return 0;
 }
 
-
 /*
- * Hàm: display_results
- * Mục đích: Hiển thị average rating của TẤT CẢ MOVIES
+ * Hàm: write_spill_results
+ * Mục đích: (--spill) Tổng hợp lần lượt từng partition từ run file (spill_aggregate) rồi
+ * ghi kết quả theo format, giống hệt write_results (không có --bucket / --distinct / --similar)
+ * Bộ nhớ: 1 bảng partition + buffer đọc + buffer output (ghi ra fd mỗi SPILL_OUT_FLUSH)
+ * Top K được chọn dần bằng heap; mean chung (RANK_BAYES) có sẵn từ tổng của các worker
+ * Trả về 0 nếu thành công, -1 nếu lỗi
  */
-void display_results(SharedData *shared_data) {
-    printf("\n========== MOVIE AVERAGE RATINGS ==========\n");
-    printf("%-10s %-15s %-10s %-15s\n", "MovieID", "Total Ratings", "Count", "Average");
-    printf("=====================================================\n");
+int write_spill_results(SharedData *shared_data, const SpillLayout *layout,
+                        const TopOptions *opts, OutputFormat format, int fd) {
+    int limit[SPILL_KINDS] = {shared_data->num_movies, shared_data->num_users};
+    TopEntry *top = malloc((size_t)(opts->top_k > 0 ? opts->top_k : 1) * sizeof(TopEntry));
+    if (top == NULL) {
+        perror("malloc failed");
+        return -1;
+    }
     
-    int total_movies_with_ratings = 0;
-    int overall_sum = 0;
-    int overall_count = 0;
-    
-    // Duyệt qua TẤT CẢ 1682 movies
-    for (int i = 0; i < MAX_MOVIES; i++) {
-        if (shared_data->movies[i].is_used && shared_data->movies[i].count > 0) {
-            int movieID = shared_data->movies[i].movieID;
-            int sum = shared_data->movies[i].sum_ratings;
-            int count = shared_data->movies[i].count;
-            double average = (double)sum / count;  // Average của MOVIE NÀY
-            
-            // Hiển thị N movies đầu tiên 
-            if (total_movies_with_ratings < DISPLAY_FIRST_N) {
-                printf("%-10d %-15d %-10d %-15.4f\n", 
-                       movieID, sum, count, average);
-            }
-            
-            total_movies_with_ratings++;
-            overall_sum += sum;
-            overall_count += count;
-        }
+    Counter overall_sum = 0;
+    Counter overall_count = 0;
+    for (int w = 0; w < shared_data->num_workers; w++) {
+        overall_sum += worker_stats(shared_data)[w].spill_sum;
+        overall_count += worker_stats(shared_data)[w].spill_rows;
     }
+    OutBuf out;
+    SpillOutput so = {
+        .shared_data = shared_data,
+        .opts = opts,
+        .format = format,
+        .fd = fd,
+        .out = &out,
+        .top = top,
+        .top_count = 0,
+        .global_mean = overall_count > 0 ? average_stars(overall_sum, overall_count) : 0.0
+    };
+    int result = 0;
+    out_init(&out, SPILL_OUT_FLUSH + 64 * 1024);
+    fflush(stdout);  // Những gì đã printf phải ra trước kết quả
     
-    printf("=====================================================\n");
-    printf("Total movies with ratings: %d / %d\n", 
-           total_movies_with_ratings, MAX_MOVIES);
-    printf("Total ratings processed: %d\n", overall_count);
+    if (format == FORMAT_CSV) {
+        out_movie_csv_header(0, &out);
+    } else if (format == FORMAT_JSON) {
+        out_str(&out, "{\"movies\":[");
+    } else {
+        out_movie_header(shared_data, &out);
+    }
     
-    if (overall_count > 0) {
-        printf("Overall average rating: %.4f\n", (double)overall_sum / overall_count);
+    // csv chỉ có movie -> không cần đọc partition theo user
+    int kinds = (format == FORMAT_CSV) ? 1 : SPILL_KINDS;
+    for (int k = 0; k < kinds && result == 0; k++) {
+        if (k == SPILL_USERS) {
+            if (format == FORMAT_JSON) {
+                out_str(&out, "\n],\"users\":[");
+            } else {
+                out_user_header(&out);
+            }
+        }
+        so.shown = 0;
+        result = spill_aggregate(layout, (SpillKind)k, limit[k], spill_emit, &so);
+        if (format == FORMAT_TABLE) {
+            if (k == SPILL_MOVIES) {
+                out_movie_footer(shared_data, so.shown, overall_sum, overall_count, &out);
+            } else {
+                out_user_footer(shared_data, so.shown, &out);
+            }
+        }
     }
     
-if (total_movies_with_ratings > DISPLAY_FIRST_N) {
-    printf("(Showing first %d of %d movies)\n", DISPLAY_FIRST_N, total_movies_with_ratings);
+    if (result == 0) {
+        topk_sort(top, so.top_count);
+        if (format == FORMAT_JSON) {
+            out_str(&out, "\n]");
+            out_top_json(shared_data, opts, top, so.top_count, -1, &out);
+            out_str(&out, "}\n");
+        } else if (format == FORMAT_TABLE) {
+            out_top_table(shared_data, opts, top, so.top_count, so.global_mean, -1, &out);
+        }
+        if (out_write(&out, fd) == -1) {
+            perror("write results failed");
+            result = -1;
+        }
+    }
+    out_free(&out);
+    free(top);
+    return result;
+}
+
+
+// ctx của QueryBackend (--serve): bảng chính của analyzer + mặc định của TOP
+typedef struct {
+    SharedData *shared_data;
+    TopOptions defaults;
+} ServeContext;
+
+/*
+ * Hàm: serve_status / serve_movie / serve_distinct / serve_top
+ * Mục đích: QueryBackend của --serve trên bảng chính của analyzer
+ */
+static void serve_status(void *ctx, QueryStatus *status) {
+    const SharedData *shared_data = ((ServeContext *)ctx)->shared_data;
+    status->ready = shared_data->ready;
+    status->num_movies = shared_data->num_movies;
+    status->num_users = shared_data->num_users;
+    status->updates = shared_data->updates;
+    status->distinct = shared_data->hll_bits > 0;
+}
+
+static int serve_movie(void *ctx, int i, int64_t *sum, int64_t *count, int64_t *hist) {
+    SharedData *shared_data = ((ServeContext *)ctx)->shared_data;
+    return snapshot_movie(shared_data, shared_movies(shared_data), i, sum, count, hist);
 }
-    printf("=====================================================\n\n");
+
+static long long serve_distinct(void *ctx, int i) {
+    // Register chỉ tăng -> đọc không cần seqlock, ước lượng luôn là của 1 trạng thái hợp lệ
+    SharedData *shared_data = ((ServeContext *)ctx)->shared_data;
+    return movie_distinct(shared_data, shared_movies(shared_data), i);
 }
 
+static int serve_top(void *ctx, int top_k, int min_ratings, TopEntry **top) {
+    SharedData *shared_data = ((ServeContext *)ctx)->shared_data;
+    TopOptions opts = ((ServeContext *)ctx)->defaults;
+    double global_mean;
+    int window_first;
+    opts.top_k = top_k;
+    opts.min_ratings = min_ratings;
+    // Quét cả bảng: đọc lại nếu writer ghi xen vào giữa
+    for (int attempt = 0; attempt < SERVE_MAX_RETRIES; attempt++) {
+        unsigned int seq;
+        if (seq_read_begin(shared_data, &seq) != 0) {
+            break;
+        }
+        int top_count = select_top_movies(shared_data, &opts, top, &global_mean, &window_first);
+        if (top_count < 0 || !seq_read_retry(shared_data, seq)) {
+            return top_count;
+        }
+        free(*top);
+        *top = NULL;
+    }
+    return -1;
+}
 
 /*
- * Hàm: display_top_movies
- * Mục đích: Hiển thị top 50 movies có rating cao nhất (với ít nhất 50 ratings)
+ * Hàm: serve_queries
+ * Mục đích: (--serve) Attach READ-ONLY vào bảng của 1 analyzer đang chạy --follow và
+ * trả lời request qua Unix domain socket (query_server.c). Mỗi lookup chỉ đọc vài
+ * Counter dưới seqlock -> không lock, không làm chậm analyzer. Dừng khi nhận SIGINT/SIGTERM
  */
-void display_top_movies(SharedData *shared_data) {
-    printf("\n========== TOP %d HIGHEST RATED MOVIES ==========\n", TOP_N);
-    printf("(Minimum %d ratings required)\n", MIN_RATINGS);
-    printf("%-10s %-10s %-15s\n", "MovieID", "Count", "Average");
-    printf("=====================================================\n");
+int serve_queries(const char *socket_path, const char *shm_name, const TopOptions *defaults) {
+    ShmSegment seg;
+    SharedData *shared_data = attach_analyzer(&seg, shm_name);
+    if (shared_data == NULL) {
+        return 1;
+    }
     
-    typedef struct {
-        int movieID;
-        int count;
-        double average;
-    } TopMovie;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
     
-    TopMovie top[TOP_N];
-    int top_count = 0;
+    ServeContext serve = { shared_data, *defaults };
+    QueryBackend backend = {
+        .ctx = &serve,
+        .top_k = defaults->top_k,
+        .min_ratings = defaults->min_ratings,
+        .status = serve_status,
+        .movie = serve_movie,
+        .distinct = serve_distinct,
+        .top = serve_top
+    };
+    int result = query_server_run(socket_path, &backend, &stop_requested);
+    shm_segment_detach(&seg);
+    return result;
+}
+
+
+/*
+ * Hàm: parse_time
+ * Mục đích: Đọc --since / --until: Unix timestamp (giây) hoặc ngày YYYY-MM-DD (UTC)
+ * end_of_day = 1: ngày được hiểu là giây cuối cùng của ngày đó (--until)
+ * Trả về 0 nếu hợp lệ, -1 nếu không
+ */
+int parse_time(const char *arg, int end_of_day, long long *out) {
+    long long y;
+    int m, d, n = 0;
     
-    for (int i = 0; i < MAX_MOVIES; i++) {
-        if (shared_data->movies[i].is_used && shared_data->movies[i].count >= MIN_RATINGS) {
-            double avg = (double)shared_data->movies[i].sum_ratings / shared_data->movies[i].count;
-            
-            if (top_count < TOP_N) {
-                top[top_count].movieID = shared_data->movies[i].movieID;
-                top[top_count].count = shared_data->movies[i].count;
-                top[top_count].average = avg;
-                top_count++;
+    if (sscanf(arg, "%lld-%d-%d%n", &y, &m, &d, &n) == 3 && arg[n] == '\0') {
+        if (m < 1 || m > 12 || d < 1 || d > 31) {
+            return -1;
+        }
+        *out = days_from_civil(y, m, d) * SECONDS_PER_DAY + (end_of_day ? SECONDS_PER_DAY - 1 : 0);
+        return 0;
+    }
+    char *end;
+    *out = strtoll(arg, &end, 10);
+    return (end != arg && *end == '\0') ? 0 : -1;
+}
+
+
+/*
+ * Hàm: print_usage
+ * Mục đích: In hướng dẫn sử dụng
+ */
+void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-m lock|lockfree|hot] [-j N] [-p mmap|stdio] <file1> [file2 ...]\n", prog);
+    fprintf(stderr, "       %s -c <out.rcol> <file1> [file2 ...]\n", prog);
+    fprintf(stderr, "       %s -q <movieID>\n", prog);
+    fprintf(stderr, "       %s --serve <socket> [--shm-name NAME] [--top K] [--min-ratings M]\n", prog);
+    fprintf(stderr, "  Files may be gzip or zstd compressed (detected by content); multi-frame zstd files\n");
+    fprintf(stderr, "  are decompressed frame by frame in parallel by the workers\n");
+    fprintf(stderr, "  -m, --mode lock      All children update one table under a spinlock (default)\n");
+    fprintf(stderr, "  -m, --mode lockfree  Each child fills a private slab, parent merges\n");
+    fprintf(stderr, "  -m, --mode hot       Atomic adds into one table; movies found hot in each worker's\n");
+    fprintf(stderr, "                       first chunk get private counters merged at the end\n");
+    fprintf(stderr, "  -j, --jobs N         Number of child processes / threads (default %d, max %d)\n",
+            DEFAULT_WORKERS, MAX_WORKERS);
+    fprintf(stderr, "  -e, --engine process Fork N children sharing the table in shared memory (default)\n");
+    fprintf(stderr, "  -e, --engine thread  Run N pinned threads; lockfree uses NUMA-local tables\n");
+    fprintf(stderr, "                       merged as a tree\n");
+    fprintf(stderr, "      --no-pin         Do not pin threads to cores (--engine thread)\n");
+    fprintf(stderr, "  -p, --parser mmap    mmap the files and parse integers by hand (default)\n");
+    fprintf(stderr, "  -p, --parser stdio   Read lines with getline (same row grammar as mmap)\n");
+    fprintf(stderr, "  -p, --parser fscanf  Original fscanf loop, benchmark baseline only: looser\n");
+    fprintf(stderr, "                       grammar, stops the chunk at the first malformed row\n");
+    fprintf(stderr, "  -c, --convert OUT    Convert text files to one binary columnar file and exit\n");
+    fprintf(stderr, "      --top K          Number of top movies to show (default %d)\n", TOP_N);
+    fprintf(stderr, "      --min-ratings M  Minimum ratings for a movie to be ranked (default %d)\n",
+            MIN_RATINGS);
+    fprintf(stderr, "      --rank mean|bayes  Rank by plain average or Bayesian average\n");
+    fprintf(stderr, "      --prior W        Bayesian prior weight (default: min-ratings)\n");
+    fprintf(stderr, "  -f, --follow         Keep the segment alive and tail the text files for appended ratings\n");
+    fprintf(stderr, "      --poll-ms MS     Polling interval for --follow (default %d)\n", DEFAULT_POLL_MS);
+    fprintf(stderr, "      --checkpoint FILE Resume from FILE if it matches the inputs, save results to it\n");
+    fprintf(stderr, "  -q, --query ID       Print current stats of a movie from a running --follow analyzer\n");
+    fprintf(stderr, "      --serve SOCKET   Answer AVG id / HIST id / DISTINCT id / TOP [K [MIN]] / STATS lines on a Unix\n");
+    fprintf(stderr, "                       socket from a running --follow analyzer (seqlock, never blocks it)\n");
+    fprintf(stderr, "      --shm sysv|posix|memfd  Shared memory backend (default posix)\n");
+    fprintf(stderr, "      --shm-name NAME  POSIX segment name to create / query (default: unique per run,\n");
+    fprintf(stderr, "                       %s with --follow)\n", SHM_FOLLOW_NAME);
+    fprintf(stderr, "      --huge off|thp|hugetlb  Back the tables with transparent or reserved huge pages\n");
+    fprintf(stderr, "      --format F       Result format: table (default), csv or json (logs go to stderr)\n");
+    fprintf(stderr, "      --quiet          Do not print per-chunk progress from the workers\n");
+    fprintf(stderr, "      --report-csv F   Append this run's timing, peak RSS and lock contention to CSV F\n");
+    fprintf(stderr, "      --chunk-size N   Work queue chunk size in bytes, K/M suffix allowed (default 4M)\n");
+    fprintf(stderr, "      --bucket day|week|month  Also aggregate per movie per time bucket\n");
+    fprintf(stderr, "      --since T        Only count ratings with timestamp >= T (seconds or YYYY-MM-DD)\n");
+    fprintf(stderr, "      --until T        Only count ratings with timestamp <= T (YYYY-MM-DD = whole day)\n");
+    fprintf(stderr, "      --window N       Rank top movies over the last N buckets only (needs --bucket)\n");
+    fprintf(stderr, "      --distinct       Estimate distinct users per movie with a HyperLogLog sketch\n");
+    fprintf(stderr, "      --hll-bits P     2^P one-byte registers per movie, %d..%d (default %d, ~%.1f%% error;\n",
+            HLL_MIN_BITS, HLL_MAX_BITS, HLL_DEFAULT_BITS, 104.0 / sqrt(1 << HLL_DEFAULT_BITS));
+    fprintf(stderr, "                       implies --distinct)\n");
+    fprintf(stderr, "      --similar N      Also list the N most similar movies of each movie (users who\n");
+    fprintf(stderr, "                       rated X also rated Y; reads the input a second time)\n");
+    fprintf(stderr, "      --sim cosine|pearson  Similarity of two movies' rating vectors (default cosine;\n");
+    fprintf(stderr, "                       pearson subtracts each movie's mean first)\n");
+    fprintf(stderr, "      --sim-min-common M  Users two movies need in common to be compared (default %d)\n",
+            SIM_DEFAULT_MIN_COMMON);
+    fprintf(stderr, "      --spill DIR      Inputs larger than RAM: workers write ratings to per-partition run\n");
+    fprintf(stderr, "                       files in DIR, the parent aggregates one partition at a time\n");
+    fprintf(stderr, "                       (movies, users and top only; give --max-movie-id and\n");
+    fprintf(stderr, "                       --max-user-id to skip the ID scan)\n");
+    fprintf(stderr, "      --mem-limit MB   Memory for --spill buffers and partition tables (default %d)\n",
+            SPILL_DEFAULT_MEM_MB);
+    fprintf(stderr, "      --quarantine F   Write rejected rows to F (overwritten) as reason<TAB>file<TAB>\n");
+    fprintf(stderr, "                       position<TAB>row: byte offset for text, row index for .rcol\n");
+    fprintf(stderr, "      --max-movie-id N Size the movie table for IDs 1..N\n");
+    fprintf(stderr, "      --max-user-id N  Size the user table for IDs 1..N\n");
+    fprintf(stderr, "                       (the ID scan is skipped when both are given;\n");
+    fprintf(stderr, "                        with --follow scanned maxima get %dx headroom)\n",
+            FOLLOW_ID_HEADROOM);
+    fprintf(stderr, "Each file is split into newline-aligned chunks (--chunk-size) on a shared work\n");
+    fprintf(stderr, "queue; a worker that drains its own chunks steals from the others.\n");
+    fprintf(stderr, "Binary columnar (.rcol) inputs are detected automatically and chunked by rows;\n");
+    fprintf(stderr, "multi-frame zstd inputs are chunked by frame groups.\n");
+    fprintf(stderr, "Example: %s -m lockfree -j 4 movie-100k_1.txt movie-100k_2.txt\n", prog);
+}
+
+
+int main(int argc, char *argv[]) {
+    AggregateMode mode = MODE_LOCK;
+    int num_workers = DEFAULT_WORKERS;
+    ParserKind parser = PARSER_MMAP;
+    const char *convert_output = NULL;
+    IdBounds bounds = {0, 0, INT_MAX, INT_MIN};  // 0 = quét input để tìm
+    TopOptions top_opts = {TOP_N, MIN_RATINGS, RANK_MEAN, -1, 0};
+    int follow = 0;
+    int poll_ms = DEFAULT_POLL_MS;
+    const char *checkpoint_path = NULL;
+    long long chunk_size = DEFAULT_CHUNK_SIZE;
+    OutputFormat format = FORMAT_TABLE;
+    BucketKind bucket_kind = BUCKET_NONE;
+    int hll_bits = 0;  // --distinct: 0 = không ước lượng số user khác nhau
+    long long since = LLONG_MIN;
+    long long until = LLONG_MAX;
+    ShmBackend shm_backend = SHM_BACKEND_POSIX;
+    ShmHugeMode shm_huge = SHM_HUGE_OFF;
+    const char *shm_name = NULL;
+    int query_id = 0;  // --query: 0 = không
+    const char *serve_path = NULL;  // --serve: socket của query server
+    Engine engine = ENGINE_PROCESS;
+    int pin_threads = 1;
+    const char *report_csv = NULL;
+    int similar_n = 0;  // --similar: số láng giềng / movie (0 = không tính)
+    SimMetric sim_metric = SIM_COSINE;
+    int sim_min_common = SIM_DEFAULT_MIN_COMMON;
+    const char *spill_dir = NULL;  // --spill: thư mục run file (NULL = bảng trong shared memory)
+    long long mem_limit_mb = SPILL_DEFAULT_MEM_MB;
+    SpillLayout layout;
+    const char *quarantine_path = NULL;  // --quarantine: file ghi các dòng bị loại
+    
+    static const struct option long_options[] = {
+        {"mode", required_argument, NULL, 'm'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"parser", required_argument, NULL, 'p'},
+        {"convert", required_argument, NULL, 'c'},
+        {"max-movie-id", required_argument, NULL, 'M'},
+        {"max-user-id", required_argument, NULL, 'U'},
+        {"top", required_argument, NULL, 'K'},
+        {"min-ratings", required_argument, NULL, 'R'},
+        {"rank", required_argument, NULL, 'r'},
+        {"prior", required_argument, NULL, 'P'},
+        {"follow", no_argument, NULL, 'f'},
+        {"poll-ms", required_argument, NULL, 'I'},
+        {"query", required_argument, NULL, 'q'},
+        {"checkpoint", required_argument, NULL, 'C'},
+        {"chunk-size", required_argument, NULL, 'S'},
+        {"format", required_argument, NULL, 'F'},
+        {"quiet", no_argument, NULL, 'Q'},
+        {"bucket", required_argument, NULL, 'b'},
+        {"since", required_argument, NULL, 'a'},
+        {"until", required_argument, NULL, 'u'},
+        {"window", required_argument, NULL, 'w'},
+        {"shm", required_argument, NULL, 'z'},
+        {"shm-name", required_argument, NULL, 'n'},
+        {"huge", required_argument, NULL, 'H'},
+        {"engine", required_argument, NULL, 'e'},
+        {"no-pin", no_argument, NULL, 'N'},
+        {"report-csv", required_argument, NULL, 'O'},
+        {"serve", required_argument, NULL, 'D'},
+        {"distinct", no_argument, NULL, 'd'},
+        {"hll-bits", required_argument, NULL, 'L'},
+        {"similar", required_argument, NULL, 'y'},
+        {"sim", required_argument, NULL, 'x'},
+        {"sim-min-common", required_argument, NULL, 'G'},
+        {"spill", required_argument, NULL, 'X'},
+        {"mem-limit", required_argument, NULL, 'Y'},
+        {"quarantine", required_argument, NULL, 'B'},
+        {"help", no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    
+    int opt;
+    while ((opt = getopt_long(argc, argv, "m:j:p:c:e:fq:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'm':
+            if (strcmp(optarg, "lock") == 0) {
+                mode = MODE_LOCK;
+            } else if (strcmp(optarg, "lockfree") == 0) {
+                mode = MODE_LOCKFREE;
+            } else if (strcmp(optarg, "hot") == 0) {
+                mode = MODE_HOT;
             } else {
-                int min_idx = 0;
-                for (int j = 1; j < TOP_N; j++) {
-                    if (top[j].average < top[min_idx].average) {
-                        min_idx = j;
-                    }
-                }
-                
-                if (avg > top[min_idx].average) {
-                    top[min_idx].movieID = shared_data->movies[i].movieID;
-                    top[min_idx].count = shared_data->movies[i].count;
-                    top[min_idx].average = avg;
-                }
+                fprintf(stderr, "Unknown mode: %s\n", optarg);
+                print_usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'e':
+            if (strcmp(optarg, "process") == 0) {
+                engine = ENGINE_PROCESS;
+            } else if (strcmp(optarg, "thread") == 0) {
+                engine = ENGINE_THREAD;
+            } else {
+                fprintf(stderr, "Unknown engine: %s\n", optarg);
+                print_usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'N':
+            pin_threads = 0;
+            break;
+        case 'O':
+            report_csv = optarg;
+            break;
+        case 'D':
+            serve_path = optarg;
+            break;
+        case 'd':
+            if (hll_bits == 0) {
+                hll_bits = HLL_DEFAULT_BITS;
+            }
+            break;
+        case 'L':
+            hll_bits = atoi(optarg);
+            if (hll_bits < HLL_MIN_BITS || hll_bits > HLL_MAX_BITS) {
+                fprintf(stderr, "Invalid --hll-bits: %s (%d..%d)\n", optarg,
+                        HLL_MIN_BITS, HLL_MAX_BITS);
+                exit(1);
+            }
+            break;
+        case 'y':
+            similar_n = atoi(optarg);
+            if (similar_n < 1 || similar_n > SIM_MAX_NEIGHBORS) {
+                fprintf(stderr, "Invalid --similar: %s (1..%d)\n", optarg, SIM_MAX_NEIGHBORS);
+                exit(1);
+            }
+            break;
+        case 'x':
+            if (strcmp(optarg, "cosine") == 0) {
+                sim_metric = SIM_COSINE;
+            } else if (strcmp(optarg, "pearson") == 0) {
+                sim_metric = SIM_PEARSON;
+            } else {
+                fprintf(stderr, "Unknown similarity metric: %s\n", optarg);
+                print_usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'G':
+            sim_min_common = atoi(optarg);
+            if (sim_min_common < 1) {
+                fprintf(stderr, "Invalid --sim-min-common: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'X':
+            spill_dir = optarg;
+            break;
+        case 'Y':
+            mem_limit_mb = atoll(optarg);
+            if (mem_limit_mb < SPILL_MIN_MEM_MB) {
+                fprintf(stderr, "Invalid --mem-limit: %s (>= %d MB)\n", optarg, SPILL_MIN_MEM_MB);
+                exit(1);
+            }
+            break;
+        case 'B':
+            quarantine_path = optarg;
+            break;
+        case 'j':
+            num_workers = atoi(optarg);
+            if (num_workers < 1 || num_workers > MAX_WORKERS) {
+                fprintf(stderr, "Invalid number of jobs: %s (1..%d)\n", optarg, MAX_WORKERS);
+                exit(1);
+            }
+            break;
+        case 'p':
+            if (strcmp(optarg, "mmap") == 0) {
+                parser = PARSER_MMAP;
+            } else if (strcmp(optarg, "stdio") == 0) {
+                parser = PARSER_STDIO;
+            } else if (strcmp(optarg, "fscanf") == 0) {
+                parser = PARSER_FSCANF;
+            } else {
+                fprintf(stderr, "Unknown parser: %s\n", optarg);
+                print_usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'c':
+            convert_output = optarg;
+            break;
+        case 'M':
+            bounds.max_movie_id = atoi(optarg);
+            if (bounds.max_movie_id < 1 || bounds.max_movie_id > MAX_MOVIE_ID) {
+                fprintf(stderr, "Invalid max movie ID: %s (1..%d)\n", optarg, MAX_MOVIE_ID);
+                exit(1);
+            }
+            break;
+        case 'U':
+            bounds.max_user_id = atoi(optarg);
+            if (bounds.max_user_id < 1 || bounds.max_user_id > MAX_USER_ID) {
+                fprintf(stderr, "Invalid max user ID: %s (1..%d)\n", optarg, MAX_USER_ID);
+                exit(1);
+            }
+            break;
+        case 'K':
+            top_opts.top_k = atoi(optarg);
+            if (top_opts.top_k < 0) {
+                fprintf(stderr, "Invalid top K: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'R':
+            top_opts.min_ratings = atoi(optarg);
+            if (top_opts.min_ratings < 0) {
+                fprintf(stderr, "Invalid minimum ratings: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'r':
+            if (strcmp(optarg, "mean") == 0) {
+                top_opts.rank = RANK_MEAN;
+            } else if (strcmp(optarg, "bayes") == 0) {
+                top_opts.rank = RANK_BAYES;
+            } else {
+                fprintf(stderr, "Unknown rank: %s\n", optarg);
+                print_usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'P':
+            top_opts.prior = atoi(optarg);
+            if (top_opts.prior < 0) {
+                fprintf(stderr, "Invalid prior weight: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'f':
+            follow = 1;
+            break;
+        case 'I':
+            poll_ms = atoi(optarg);
+            if (poll_ms < 1) {
+                fprintf(stderr, "Invalid poll interval: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'q':
+            query_id = atoi(optarg);
+            break;
+        case 'z':
+            if (strcmp(optarg, "sysv") == 0) {
+                shm_backend = SHM_BACKEND_SYSV;
+            } else if (strcmp(optarg, "posix") == 0) {
+                shm_backend = SHM_BACKEND_POSIX;
+            } else if (strcmp(optarg, "memfd") == 0) {
+                shm_backend = SHM_BACKEND_MEMFD;
+            } else {
+                fprintf(stderr, "Unknown shared memory backend: %s\n", optarg);
+                print_usage(argv[0]);
+                exit(1);
             }
+            break;
+        case 'n':
+            if (optarg[0] != '/' || strlen(optarg) >= SHM_NAME_MAX || strchr(optarg + 1, '/')) {
+                fprintf(stderr, "Invalid shared memory name: %s (\"/name\", < %d chars)\n",
+                        optarg, SHM_NAME_MAX);
+                exit(1);
+            }
+            shm_name = optarg;
+            break;
+        case 'H':
+            if (strcmp(optarg, "off") == 0) {
+                shm_huge = SHM_HUGE_OFF;
+            } else if (strcmp(optarg, "thp") == 0) {
+                shm_huge = SHM_HUGE_THP;
+            } else if (strcmp(optarg, "hugetlb") == 0) {
+                shm_huge = SHM_HUGE_TLB;
+            } else {
+                fprintf(stderr, "Unknown huge page mode: %s\n", optarg);
+                print_usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'C':
+            checkpoint_path = optarg;
+            break;
+        case 'F':
+            if (strcmp(optarg, "table") == 0) {
+                format = FORMAT_TABLE;
+            } else if (strcmp(optarg, "csv") == 0) {
+                format = FORMAT_CSV;
+            } else if (strcmp(optarg, "json") == 0) {
+                format = FORMAT_JSON;
+            } else {
+                fprintf(stderr, "Unknown format: %s\n", optarg);
+                print_usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'Q':
+            quiet = 1;
+            break;
+        case 'b':
+            if (strcmp(optarg, "day") == 0) {
+                bucket_kind = BUCKET_DAY;
+            } else if (strcmp(optarg, "week") == 0) {
+                bucket_kind = BUCKET_WEEK;
+            } else if (strcmp(optarg, "month") == 0) {
+                bucket_kind = BUCKET_MONTH;
+            } else {
+                fprintf(stderr, "Unknown bucket: %s\n", optarg);
+                print_usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'a':
+            if (parse_time(optarg, 0, &since) == -1) {
+                fprintf(stderr, "Invalid time: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'u':
+            if (parse_time(optarg, 1, &until) == -1) {
+                fprintf(stderr, "Invalid time: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'w':
+            top_opts.window = atoi(optarg);
+            if (top_opts.window < 1) {
+                fprintf(stderr, "Invalid window: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'S': {
+            char *suffix;
+            chunk_size = strtoll(optarg, &suffix, 10);
+            if (*suffix == 'K' || *suffix == 'k') {
+                chunk_size <<= 10;
+                suffix++;
+            } else if (*suffix == 'M' || *suffix == 'm') {
+                chunk_size <<= 20;
+                suffix++;
+            }
+            if (*suffix != '\0' || chunk_size < MIN_CHUNK_SIZE) {
+                fprintf(stderr, "Invalid chunk size: %s (>= %d bytes)\n", optarg, MIN_CHUNK_SIZE);
+                exit(1);
+            }
+            break;
+        }
+        case 'h':
+            print_usage(argv[0]);
+            exit(0);
+        default:
+            print_usage(argv[0]);
+            exit(1);
         }
     }
     
-    // Sắp xếp
-    for (int i = 0; i < top_count - 1; i++) {
-        for (int j = i + 1; j < top_count; j++) {
-            if (top[i].average < top[j].average) {
-                TopMovie temp = top[i];
-                top[i] = top[j];
-                top[j] = temp;
-            }
+    if (query_id != 0) {
+        return query_movie(query_id, shm_name);
+    }
+    if (top_opts.prior < 0) {
+        top_opts.prior = top_opts.min_ratings;
+    }
+    if (serve_path != NULL) {
+        return serve_queries(serve_path, shm_name, &top_opts);
+    }
+    if (top_opts.window > 0 && bucket_kind == BUCKET_NONE) {
+        fprintf(stderr, "--window needs --bucket\n");
+        exit(1);
+    }
+    // Pass 2 đọc lại toàn bộ input: không có nghĩa với phần khôi phục / ghi thêm sau này
+    if (similar_n > 0 && (follow || checkpoint_path != NULL)) {
+        fprintf(stderr, "--similar cannot be combined with --follow or --checkpoint\n");
+        exit(1);
+    }
+    // --spill: bảng chỉ tồn tại từng partition lúc tổng hợp -> chỉ có movie, user, top
+    if (spill_dir != NULL) {
+        if (follow || checkpoint_path != NULL || bucket_kind != BUCKET_NONE || hll_bits > 0 ||
+            similar_n > 0) {
+            fprintf(stderr, "--spill cannot be combined with --follow, --checkpoint, --bucket, "
+                    "--distinct or --similar\n");
+            exit(1);
         }
+        mode = MODE_SPILL;
+        release_input = 1;
+    }
+    if (since > until) {
+        fprintf(stderr, "Empty time range: --since is after --until\n");
+        exit(1);
     }
     
-    // Hiển thị
-    for (int i = 0; i < top_count; i++) {
-        printf("%-10d %-10d %-15.4f\n", 
-               top[i].movieID, top[i].count, top[i].average);
+    // Kiểm tra arguments: cần ít nhất 1 file
+    if (argc - optind < 1) {
+        print_usage(argv[0]);
+        exit(1);
     }
     
-    printf("=====================================================\n");
-    printf("Total movies shown: %d\n", top_count);
-    printf("=====================================================\n\n");
-}
-
-
-int main(int argc, char *argv[]) {
-    // Kiểm tra arguments
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <file1> <file2>\n", argv[0]);
-        fprintf(stderr, "Example: %s movie-100k_1.txt movie-100k_2.txt\n", argv[0]);
+    // csv / json: stdout CHỈ chứa kết quả -> mọi log (printf) chuyển sang stderr,
+    // kết quả ghi vào bản sao của stdout gốc
+    int result_fd = STDOUT_FILENO;
+    if (format != FORMAT_TABLE) {
+        result_fd = dup(STDOUT_FILENO);
+        if (result_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            perror("dup failed");
+            exit(1);
+        }
+    }
+    
+    // Chế độ convert: text -> .rcol rồi thoát
+    if (convert_output != NULL) {
+        double convert_start = now_ms();
+        long long rows = rcol_convert((const char *const *)&argv[optind], argc - optind,
+                                      convert_output);
+        if (rows < 0) {
+            fprintf(stderr, "ERROR: Conversion to %s failed\n", convert_output);
+            exit(1);
+        }
+        printf("✓ Converted %lld ratings to %s in %.3f ms\n",
+               rows, convert_output, now_ms() - convert_start);
+        return 0;
+    }
+    
+    // Lấy size của từng file trước khi fork để chia đoạn
+    // Map luôn ở parent (pass quét movieID cần), các child kế thừa mapping qua fork
+    int num_files = argc - optind;
+    long long total_bytes = 0;
+    InputFile *files = malloc(num_files * sizeof(InputFile));
+    if (files == NULL) {
+        perror("malloc failed");
         exit(1);
     }
+    for (int f = 0; f < num_files; f++) {
+        struct stat st;
+        files[f].name = argv[optind + f];
+        if (stat(files[f].name, &st) == -1) {
+            fprintf(stderr, "ERROR: Cannot open file %s\n", files[f].name);
+            exit(1);
+        }
+        files[f].size = st.st_size;
+        files[f].map.data = NULL;
+        files[f].map.size = 0;
+        files[f].start = 0;
+        memset(&files[f].compressed, 0, sizeof(files[f].compressed));
+        files[f].columnar = rcol_is_columnar(files[f].name);
+        if (files[f].columnar) {
+            // File .rcol luôn được map, bất kể parser
+            if (map_file(files[f].name, &files[f].map) == -1 ||
+                rcol_open(&files[f].map, &files[f].cols) == -1) {
+                fprintf(stderr, "ERROR: Invalid columnar file %s\n", files[f].name);
+                exit(1);
+            }
+            files[f].size = files[f].map.size;
+        } else {
+            if (map_file(files[f].name, &files[f].map) == -1) {
+                fprintf(stderr, "ERROR: Cannot mmap file %s\n", files[f].name);
+                exit(1);
+            }
+            files[f].size = files[f].map.size;
+            if (compressed_open(&files[f].map, &files[f].compressed) == -1) {
+                fprintf(stderr, "ERROR: Cannot read compressed file %s\n", files[f].name);
+                exit(1);
+            }
+            if (files[f].compressed.kind != COMPRESS_NONE && (follow || checkpoint_path != NULL)) {
+                // Cả 2 ghi nhớ vị trí đã đọc theo byte của file text
+                fprintf(stderr, "ERROR: %s is %s-compressed; --follow and --checkpoint need "
+                        "plain text input\n", files[f].name,
+                        compress_name(files[f].compressed.kind));
+                exit(1);
+            }
+            if (follow && files[f].size > 0) {
+                // Dòng cuối chưa có '\n' có thể đang được ghi dở -> để follow đọc sau
+                files[f].size = complete_length(files[f].map.data, files[f].map.size);
+            }
+        }
+        total_bytes += files[f].size;
+    }
     
-    const char *file1 = argv[1];
-    const char *file2 = argv[2];
+    // Khôi phục checkpoint (--checkpoint): chỉ đọc phần input sau vị trí đã lưu
+    Checkpoint checkpoint;
+    int restored = 0;
+    double restore_start = now_ms();
+    if (checkpoint_path != NULL) {
+        if (checkpoint_load(checkpoint_path, &checkpoint) == -1) {
+            printf("No usable checkpoint at %s, reading all input\n", checkpoint_path);
+        } else if (!checkpoint_matches(&checkpoint, files, num_files, bucket_kind, since, until,
+                                       hll_bits)) {
+            printf("⚠️  Checkpoint %s does not match the inputs or options, reading all input\n",
+                   checkpoint_path);
+            checkpoint_close(&checkpoint);
+        } else {
+            restored = 1;
+            for (int f = 0; f < num_files; f++) {
+                files[f].start = checkpoint.files[f].consumed;
+                if (!files[f].columnar) {
+                    total_bytes -= files[f].start;
+                }
+            }
+        }
+    }
+    double restore_ms = now_ms() - restore_start;
     
     printf("========================================\n");
     printf("MOVIE RATING ANALYZER WITH SHARED MEMORY\n");
     printf("Lab 2 - Problem 1\n");
     printf("========================================\n");
     printf("[Parent - PID %d] Starting...\n", getpid());
-    printf("File 1: %s\n", file1);
-    printf("File 2: %s\n", file2);
+    for (int f = 0; f < num_files; f++) {
+        printf("File %d: %s (%lld bytes%s", f + 1, files[f].name, (long long)files[f].size,
+               files[f].columnar ? ", columnar" : "");
+        if (files[f].compressed.kind != COMPRESS_NONE) {
+            printf(", %s, %lld frame%s", compress_name(files[f].compressed.kind),
+                   files[f].compressed.num_frames, files[f].compressed.num_frames == 1 ? "" : "s");
+        }
+        printf(")\n");
+        if (files[f].start > 0) {
+            printf("        resuming at %s %lld\n", files[f].columnar ? "row" : "byte",
+                   (long long)files[f].start);
+        }
+    }
+    printf("Engine: %s\n", engine == ENGINE_THREAD ? "thread" : "process");
+    printf("Mode:   %s\n", mode_name(mode));
+    printf("Jobs:   %d\n", num_workers);
+    printf("Parser: %s\n", parser_name(parser));
+    if (since != LLONG_MIN || until != LLONG_MAX) {
+        printf("Time:   ");
+        if (since != LLONG_MIN) {
+            printf(">= %lld ", since);
+        }
+        if (until != LLONG_MAX) {
+            printf("<= %lld", until);
+        }
+        printf("\n");
+    }
     printf("========================================\n\n");
     
+    // ========================================
+    // BƯỚC 0: Quét userID, movieID lớn nhất -> kích thước bảng
+    // (bỏ qua nếu đã cho cả --max-movie-id và --max-user-id)
+    // ========================================
+    double scan_start = now_ms();
+    IdBounds scanned = {0, 0, INT_MAX, INT_MIN};
+    if (bounds.max_movie_id == 0 || bounds.max_user_id == 0 || bucket_kind != BUCKET_NONE) {
+        scanned = scan_max_ids_parallel(files, num_files, num_workers, bucket_kind != BUCKET_NONE);
+        if (follow) {
+            // Rating ghi thêm sau này có thể có ID mới lớn hơn -> chừa chỗ trước
+            scanned.max_movie_id = headroom_id(scanned.max_movie_id, MAX_MOVIE_ID);
+            scanned.max_user_id = headroom_id(scanned.max_user_id, MAX_USER_ID);
+        }
+        if (bounds.max_movie_id == 0) {
+            bounds.max_movie_id = scanned.max_movie_id;
+        }
+        if (bounds.max_user_id == 0) {
+            bounds.max_user_id = scanned.max_user_id;
+        }
+        // Không có dòng hợp lệ: vẫn tạo bảng 1 phần tử
+        if (bounds.max_movie_id == 0) {
+            bounds.max_movie_id = 1;
+        }
+        if (bounds.max_user_id == 0) {
+            bounds.max_user_id = 1;
+        }
+        printf("✓ Scanned inputs: max userID = %d, max movieID = %d\n",
+               bounds.max_user_id, bounds.max_movie_id);
+    }
+    if (restored) {
+        // Bảng phải chứa được toàn bộ dữ liệu trong checkpoint
+        if (checkpoint.header->num_movies > bounds.max_movie_id) {
+            bounds.max_movie_id = checkpoint.header->num_movies;
+        }
+        if (checkpoint.header->num_users > bounds.max_user_id) {
+            bounds.max_user_id = checkpoint.header->num_users;
+        }
+    }
+    
+    // --bucket: bảng bucket bao trùm [timestamp nhỏ nhất, lớn nhất] trong --since / --until
+    // (và các bucket của checkpoint). --follow chừa thêm bucket cho rating sau này
+    int num_time_buckets = 0;
+    long long bucket_base = 0;
+    if (bucket_kind != BUCKET_NONE) {
+        long long lo = (scanned.min_ts > since) ? scanned.min_ts : since;
+        long long hi = (scanned.max_ts < until) ? scanned.max_ts : until;
+        int have_ck_buckets = restored && checkpoint.header->num_time_buckets > 0;
+        if (lo > hi) {
+            // Không có rating mới trong khoảng: dùng khoảng của checkpoint (nếu có)
+            lo = hi = have_ck_buckets ? bucket_start_days(checkpoint.header->bucket_base,
+                                                          bucket_kind) * SECONDS_PER_DAY
+                                      : (since != LLONG_MIN) ? since : 0;
+        }
+        long long first_bucket = time_bucket(lo, bucket_kind);
+        long long last_bucket = time_bucket(hi, bucket_kind);
+        if (follow) {
+            last_bucket += (last_bucket - first_bucket + 1) * (FOLLOW_ID_HEADROOM - 1);
+            if (until != LLONG_MAX && last_bucket > time_bucket(until, bucket_kind)) {
+                last_bucket = time_bucket(until, bucket_kind);
+            }
+        }
+        if (have_ck_buckets) {
+            long long ck_first = checkpoint.header->bucket_base;
+            long long ck_last = ck_first + checkpoint.header->num_time_buckets - 1;
+            first_bucket = (ck_first < first_bucket) ? ck_first : first_bucket;
+            last_bucket = (ck_last > last_bucket) ? ck_last : last_bucket;
+        }
+        if (last_bucket - first_bucket + 1 > MAX_TIME_BUCKETS) {
+            fprintf(stderr, "ERROR: %lld %s buckets needed (max %d), use a coarser --bucket "
+                    "or narrow --since / --until\n", last_bucket - first_bucket + 1,
+                    bucket_name(bucket_kind), MAX_TIME_BUCKETS);
+            exit(1);
+        }
+        num_time_buckets = (int)(last_bucket - first_bucket + 1);
+        bucket_base = first_bucket;
+        long long y;
+        int m, d;
+        civil_from_days(bucket_start_days(bucket_base, bucket_kind), &y, &m, &d);
+        printf("✓ Time buckets: %d x %s from %04lld-%02d-%02d\n",
+               num_time_buckets, bucket_name(bucket_kind), y, m, d);
+    }
+    if (hll_bits > 0) {
+        printf("✓ Distinct users: HyperLogLog, %d registers / movie (~%.1f%% error, %.1f MB / table)\n",
+               1 << hll_bits, 104.0 / sqrt(1 << hll_bits),
+               ((double)stride_for(bounds.max_movie_id) * (1 << hll_bits)) / (1 << 20));
+    }
+    double scan_ms = now_ms() - scan_start;
+    
     // ========================================
     // BƯỚC 1: Tạo Shared Memory
-    // Size = toàn bộ struct SharedData (chứa 1682 movies)
+    // Size = bảng chính (movies + users + bucket thời gian) + 1 slab riêng cho mỗi child
+    // (MODE_LOCKFREE)
     // ========================================
-    int shmid = shmget(SHM_KEY, sizeof(SharedData), IPC_CREAT | 0666);
-    if (shmid < 0) {
-        perror("shmget failed");
+    // ENGINE_THREAD: bảng riêng của thread nằm trong bộ nhớ của process, không cần slab
+    int num_slabs = (mode == MODE_LOCKFREE && engine == ENGINE_PROCESS) ? num_workers : 0;
+    // MODE_SPILL: bảng nằm trong run file, segment chỉ có bảng 1 phần tử (không dùng) và
+    // work queue; num_movies / num_users vẫn là ID lớn nhất để validate
+    int table_movies = (mode == MODE_SPILL) ? 1 : bounds.max_movie_id;
+    int table_users = (mode == MODE_SPILL) ? 1 : bounds.max_user_id;
+    int num_chunks = build_chunks(files, num_files, chunk_size, NULL);
+    size_t queue_offset = shared_data_size(table_movies, table_users, num_time_buckets, hll_bits,
+                                           num_slabs);
+    size_t shm_size = queue_offset + work_queue_size(num_workers, num_chunks);
+    // POSIX: --follow giữ tên (mặc định SHM_FOLLOW_NAME) để --query attach được,
+    // chạy batch thì tên bị unlink ngay -> không còn gì để dọn nếu crash
+    if (shm_backend == SHM_BACKEND_POSIX && follow && shm_name == NULL) {
+        shm_name = SHM_FOLLOW_NAME;
+    }
+    if (shm_backend == SHM_BACKEND_MEMFD && follow) {
+        printf("⚠️  memfd segment has no name, --query cannot attach to it\n");
+    }
+    ShmSegment seg;
+    if (shm_segment_create(&seg, shm_backend, shm_huge, SHM_KEY, shm_name, shm_size) == -1) {
+        if (shm_backend == SHM_BACKEND_POSIX && shm_name != NULL) {
+            fprintf(stderr, "Another analyzer may be running; use --shm-name or "
+                    "remove a stale one with 'make clean-shm'\n");
+        }
         exit(1);
     }
-    printf("✓ Shared memory created (ID: %d, Size: %lu bytes)\n", 
-           shmid, sizeof(SharedData));
+    printf("✓ Shared memory created (%s", shm_backend_name(seg.backend));
+    if (seg.backend == SHM_BACKEND_SYSV) {
+        printf(" ID: %d", seg.shmid);
+    } else if (seg.name[0] != '\0') {
+        printf(" %s", seg.name);
+    }
+    printf(", Size: %zu bytes, huge pages: %s)\n", seg.size, shm_huge_name(seg.huge));
     
     // ========================================
     // BƯỚC 2: Attach shared memory vào address space
+    // (mọi backend đã map sẵn, child fork sau kế thừa mapping)
     // ========================================
-    SharedData *shared_data = (SharedData *)shmat(shmid, NULL, 0);
-    if (shared_data == (SharedData *)-1) {
-        perror("shmat failed");
-        exit(1);
-    }
+    SharedData *shared_data = (SharedData *)seg.addr;
     printf("✓ Shared memory attached at: %p\n\n", shared_data);
     
     // ========================================
     // BƯỚC 3: Khởi tạo shared memory (set all to 0)
     // ========================================
-    memset(shared_data, 0, sizeof(SharedData));
+    memset(shared_data, 0, shm_size);
     shared_data->lock = 0;
+    shared_data->num_movies = bounds.max_movie_id;
+    shared_data->num_users = bounds.max_user_id;
+    shared_data->num_slabs = num_slabs;
+    shared_data->movie_stride = stride_for(table_movies);
+    shared_data->user_stride = stride_for(table_users);
+    shared_data->table_ints = table_ints_for(table_movies, table_users, num_time_buckets, hll_bits);
+    shared_data->bucket_kind = bucket_kind;
+    shared_data->num_time_buckets = num_time_buckets;
+    shared_data->bucket_base = bucket_base;
+    shared_data->since = since;
+    shared_data->until = until;
+    shared_data->hll_bits = hll_bits;
+    shared_data->num_workers = num_workers;
+    shared_data->num_chunks = num_chunks;
+    shared_data->queue_offset = queue_offset;
+    init_work_queue(shared_data, files, num_files, chunk_size);
+    for (int w = 0; w < num_workers; w++) {
+        worker_stats(shared_data)[w].cpu = -1;
+        worker_stats(shared_data)[w].node = -1;
+    }
     printf("✓ Shared memory initialized\n\n");
     
-    // ========================================
-    // BƯỚC 4: Fork child process 1
-    // ========================================
-    printf("Creating child processes...\n");
-    pid_t pid1 = fork();
+    if (mode == MODE_SPILL) {
+        int ids[SPILL_KINDS] = {bounds.max_movie_id, bounds.max_user_id};
+        if (spill_layout_init(&layout, spill_dir, ids, num_workers,
+                              (size_t)mem_limit_mb << 20) == -1) {
+            shm_segment_destroy(&seg);
+            exit(1);
+        }
+        spill_layout = &layout;
+        printf("✓ Spill to %s: %d movie x %d IDs + %d user x %d IDs partitions, "
+               "%d-record buffers (--mem-limit %lld MB)\n\n", spill_dir,
+               layout.parts[SPILL_MOVIES], 1 << layout.shift[SPILL_MOVIES],
+               layout.parts[SPILL_USERS], 1 << layout.shift[SPILL_USERS],
+               layout.buffer_records, mem_limit_mb);
+    }
     
-    if (pid1 < 0) {
-        perror("fork failed for child 1");
-        exit(1);
+    // --quarantine: 1 fd O_APPEND cho mọi worker (child kế thừa qua fork)
+    if (quarantine_path != NULL) {
+        quarantine_fd = open(quarantine_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                             0644);
+        if (quarantine_fd < 0) {
+            fprintf(stderr, "Cannot open quarantine file %s: %s\n", quarantine_path,
+                    strerror(errno));
+            shm_segment_destroy(&seg);
+            exit(1);
+        }
     }
     
-    if (pid1 == 0) {
-        // CHILD PROCESS 1: Xử lý file 1
-        calculate_average(file1, shared_data, 1);
-        
-        // Detach shared memory
-        shmdt(shared_data);
-        exit(0);
+    long long restored_ratings = 0;
+    if (restored) {
+        restore_start = now_ms();
+        restore_checkpoint(shared_data, &checkpoint);
+        checkpoint_close(&checkpoint);
+        for (int i = 0; i < shared_data->num_movies; i++) {
+            restored_ratings += shared_movies(shared_data).count[i];
+        }
+        restore_ms += now_ms() - restore_start;
+        printf("✓ Restored checkpoint %s in %.3f ms\n\n", checkpoint_path, restore_ms);
     }
     
     // ========================================
-    // BƯỚC 5: Fork child process 2
+    // BƯỚC 4: Chạy N worker (child process hoặc thread)
+    // Các worker lấy chunk từ work queue (xem run_worker)
     // ========================================
-    pid_t pid2 = fork();
+    int failed;
+    double ingest_ms, merge_ms;
+    double ingest_start = now_ms();
+    if (engine == ENGINE_THREAD) {
+        // Merge cây chạy ngay trong các thread -> merge_ms tính từ lúc đọc xong
+        double ingest_end;
+        printf("Starting %d worker threads%s...\n", num_workers, pin_threads ? " (pinned)" : "");
+        fflush(stdout);
+        failed = run_threads(files, shared_data, mode, parser, pin_threads, &ingest_end) != 0;
+        ingest_ms = ingest_end - ingest_start;
+        merge_ms = now_ms() - ingest_end;
+    } else {
+        failed = run_processes(files, shared_data, &seg, mode, parser) != 0;
+        ingest_ms = now_ms() - ingest_start;
+        
+        // MODE_LOCKFREE: gộp các slab riêng vào bảng chính
+        double merge_start = now_ms();
+        if (mode == MODE_LOCKFREE) {
+            merge_partials(shared_data);
+        }
+        merge_ms = now_ms() - merge_start;
+    }
     
-    if (pid2 < 0) {
-        perror("fork failed for child 2");
-        exit(1);
+    // MODE_SPILL: merge = tổng hợp từng partition từ run file, ghi kết quả luôn
+    // (bảng đầy đủ không bao giờ nằm trong bộ nhớ)
+    if (mode == MODE_SPILL) {
+        double merge_start = now_ms();
+        if (!failed) {
+            failed = write_spill_results(shared_data, &layout, &top_opts, format, result_fd) != 0;
+        }
+        spill_remove_all(&layout);
+        merge_ms = now_ms() - merge_start;
     }
     
-    if (pid2 == 0) {
-        // CHILD PROCESS 2: Xử lý file 2
-        calculate_average(file2, shared_data, 2);
-        
-        // Detach shared memory
-        shmdt(shared_data);
-        exit(0);
+    // ========================================
+    // BƯỚC 4b (--similar): Pass 2 ghi mọi rating vào CSR theo user (kích thước hàng
+    // = user_count của pass 1), rồi tính top-N láng giềng song song (similarity.h)
+    // ========================================
+    double sim_ms = 0;
+    if (similar_n > 0 && !failed) {
+        double sim_start = now_ms();
+        AggTables movies = shared_movies(shared_data);
+        sim_index = sim_create(shared_data->num_movies, shared_data->num_users, movies.sum,
+                               movies.count, movies.user_count, sim_metric, similar_n,
+                               sim_min_common);
+        if (sim_index == NULL) {
+            failed = 1;
+        } else {
+            // Pass 2 dùng lại work queue; WorkerStats giữ số liệu của pass 1
+            WorkerStats *saved = malloc(num_workers * sizeof(WorkerStats));
+            if (saved == NULL) {
+                perror("malloc failed");
+                exit(1);
+            }
+            memcpy(saved, worker_stats(shared_data), num_workers * sizeof(WorkerStats));
+            init_work_queue(shared_data, files, num_files, chunk_size);
+            // Dòng bị loại đã được đếm / quarantine ở pass 1
+            int saved_quiet = quiet;
+            int saved_quarantine_fd = quarantine_fd;
+            quiet = 1;
+            quarantine_fd = -1;
+            printf("\n--similar: reading inputs again into a %lld-rating CSR...\n",
+                   (long long)sim_index->nnz);
+            if (engine == ENGINE_THREAD) {
+                double pass_end;
+                failed = run_threads(files, shared_data, MODE_CSR, parser, pin_threads,
+                                     &pass_end) != 0;
+            } else {
+                failed = run_processes(files, shared_data, &seg, MODE_CSR, parser) != 0;
+            }
+            quiet = saved_quiet;
+            quarantine_fd = saved_quarantine_fd;
+            memcpy(worker_stats(shared_data), saved, num_workers * sizeof(WorkerStats));
+            free(saved);
+            
+            if (!failed) {
+                sim_build_columns(sim_index);
+                failed = sim_run(sim_index, num_workers, engine == ENGINE_THREAD) != 0;
+            }
+            if (sim_index->dropped > 0) {
+                printf("⚠️  %lld ratings did not fit the CSR (input changed between passes)\n",
+                       (long long)sim_index->dropped);
+            }
+        }
+        sim_ms = now_ms() - sim_start;
+        printf("✓ Similar movies: top %d %s neighbors in %.3f ms\n\n", similar_n,
+               sim_metric_name(sim_metric), sim_ms);
     }
     
     // ========================================
-    // PARENT PROCESS: Chờ 2 child processes hoàn thành
+    // BƯỚC 5: Đọc kết quả từ shared memory và hiển thị
+    // LÚC NÀY shared_data đã chứa data từ TẤT CẢ FILES
+    // Mỗi movie có average từ TẤT CẢ ratings trong các files
     // ========================================
-    printf("\n[Parent] Waiting for child processes to complete...\n\n");
+    // --follow với csv / json: chỉ ghi kết quả cuối cùng (1 document) lúc dừng
+    if (!(follow && format != FORMAT_TABLE) && mode != MODE_SPILL) {
+        write_results(shared_data, &top_opts, sim_index, format, result_fd);
+    }
+    
+    // Throughput chỉ tính ratings đọc ở lần chạy này (không tính phần khôi phục)
+    long long total_ratings = -restored_ratings;
+    if (mode == MODE_SPILL) {
+        for (int w = 0; w < num_workers; w++) {
+            total_ratings += worker_stats(shared_data)[w].spill_rows;
+        }
+    } else {
+        for (int i = 0; i < shared_data->num_movies; i++) {
+            total_ratings += shared_movies(shared_data).count[i];
+        }
+    }
+    RunReport report = {engine, mode, parser, seg.backend, seg.huge, num_workers, scan_ms,
+                        ingest_ms, merge_ms, sim_ms, total_ratings, total_bytes, peak_rss_kb(),
+                        total_lock_contended(shared_data)};
+    display_timing(&report);
+    if (report_csv != NULL) {
+        append_report_csv(report_csv, &report);
+    }
+    display_worker_stats(shared_data, mode);
+    if (quarantine_path != NULL) {
+        printf("✓ Rejected rows written to %s\n\n", quarantine_path);
+    }
+#ifdef PROFILE
+    display_worker_profile(shared_data);
+#endif
+    shared_data->ready = 1;
     
-    int status;
-    waitpid(pid1, &status, 0);
-    printf("✓ Child 1 (PID %d) finished\n", pid1);
+    // Vị trí đã đọc xong của từng input (checkpoint + điểm bắt đầu của --follow)
+    off_t *consumed = malloc(num_files * sizeof(off_t));
+    if (consumed == NULL) {
+        perror("malloc failed");
+        exit(1);
+    }
+    for (int f = 0; f < num_files; f++) {
+        consumed[f] = input_limit(&files[f]);
+    }
     
-    waitpid(pid2, &status, 0);
-    printf("✓ Child 2 (PID %d) finished\n", pid2);
+    if (checkpoint_path != NULL && !failed) {
+        double save_start = now_ms();
+        if (save_checkpoint(shared_data, files, num_files, consumed, checkpoint_path) == 0) {
+            printf("✓ Checkpoint saved to %s in %.3f ms\n\n", checkpoint_path,
+                   now_ms() - save_start);
+        }
+    }
     
     // ========================================
-    // BƯỚC 6: Đọc kết quả từ shared memory và hiển thị
-    // LÚC NÀY shared_data đã chứa data từ CẢ 2 FILES
-    // Mỗi movie có average từ TẤT CẢ ratings trong cả 2 files
+    // BƯỚC 5b (--follow): Giữ bảng trong shared memory, đọc tiếp phần ghi thêm
+    // Sau batch không còn child nào -> parent cập nhật bảng chính một mình
     // ========================================
-    display_results(shared_data);
-    display_top_movies(shared_data);
+    if (follow && !failed) {
+        follow_inputs(shared_data, files, num_files, consumed, poll_ms, checkpoint_path);
+        if (format == FORMAT_TABLE) {
+            OutBuf out;
+            out_init(&out, 64 * 1024);
+            display_top_movies(shared_data, &top_opts, &out);
+            fflush(stdout);
+            out_write(&out, result_fd);
+            out_free(&out);
+        } else {
+            write_results(shared_data, &top_opts, NULL, format, result_fd);
+        }
+    }
+    free(consumed);
     
     // ========================================
-    // BƯỚC 7: Cleanup - Detach và xóa shared memory
+    // BƯỚC 6: Cleanup - Detach và xóa shared memory
     // ========================================
     printf("Cleaning up...\n");
     
-    if (shmdt(shared_data) == -1) {
-        perror("shmdt failed");
-    } else {
-        printf("✓ Shared memory detached\n");
+    sim_destroy(sim_index);
+    if (quarantine_fd >= 0) {
+        close(quarantine_fd);
+    }
+    if (shm_segment_destroy(&seg) == 0) {
+        printf("✓ Shared memory detached and deleted\n");
     }
     
-    if (shmctl(shmid, IPC_RMID, NULL) == -1) {
-        perror("shmctl failed");
-    } else {
-        printf("✓ Shared memory deleted\n");
+    for (int f = 0; f < num_files; f++) {
+        compressed_close(&files[f].compressed);
+        unmap_file(&files[f].map);
+    }
+    free(files);
+    
+    if (failed) {
+        printf("\n❌ Some child processes failed, results are incomplete\n");
+        return 1;
     }
     
     printf("\n========================================\n");
@@ -382,5 +4616,3 @@ int main(int argc, char *argv[]) {
     
     return 0;
 }
-
-
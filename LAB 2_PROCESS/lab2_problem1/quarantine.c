@@ -0,0 +1,187 @@
+/*
+ * quarantine.c
+ * Ghi dòng bị loại ra file quarantine bằng thread nền (xem quarantine.h)
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "quarantine.h"
+
+#define QUARANTINE_SOURCE_MAX 4096        // Tên file dài hơn bị cắt (1 dòng luôn vừa buffer)
+
+static const char *reject_names[REJECT_KINDS] = {"malformed", "user_id", "movie_id", "rating"};
+
+const char *reject_reason_name(RejectReason reason) {
+    return reject_names[reason];
+}
+
+/*
+ * Hàm: write_all
+ * Mục đích: write() tới khi hết n bytes (write có thể ghi thiếu / bị ngắt)
+ */
+static int write_all(int fd, const char *data, size_t n) {
+    while (n > 0) {
+        ssize_t done = write(fd, data, n);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write quarantine file failed");
+            return -1;
+        }
+        data += done;
+        n -= done;
+    }
+    return 0;
+}
+
+/*
+ * Hàm: quarantine_thread
+ * Mục đích: Thread nền: chờ buffer đầy được giao (pending), ghi ra fd, báo rảnh
+ */
+static void *quarantine_thread(void *arg) {
+    QuarantineWriter *q = arg;
+
+    pthread_mutex_lock(&q->mutex);
+    for (;;) {
+        while (q->pending == 0 && !q->stop) {
+            pthread_cond_wait(&q->cond, &q->mutex);
+        }
+        if (q->pending == 0) {
+            break;  // stop và không còn gì để ghi
+        }
+        // Worker không chạm buffer[!active] khi pending != 0 -> ghi ngoài lock
+        const char *data = q->buffer[!q->active];
+        size_t n = q->pending;
+        pthread_mutex_unlock(&q->mutex);
+        int result = write_all(q->fd, data, n);
+        pthread_mutex_lock(&q->mutex);
+        if (result == -1) {
+            q->failed = 1;
+        }
+        q->pending = 0;
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return NULL;
+}
+
+int quarantine_open(QuarantineWriter *q, int fd) {
+    memset(q, 0, sizeof(*q));
+    q->fd = fd;
+    q->buffer[0] = malloc(QUARANTINE_BUFFER);
+    q->buffer[1] = malloc(QUARANTINE_BUFFER);
+    if (q->buffer[0] == NULL || q->buffer[1] == NULL) {
+        perror("malloc quarantine buffers failed");
+        free(q->buffer[0]);
+        free(q->buffer[1]);
+        return -1;
+    }
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    return 0;
+}
+
+/*
+ * Hàm: quarantine_submit
+ * Mục đích: Giao buffer đang ghi cho thread nền (chờ nếu thread còn đang ghi buffer
+ * trước), đổi sang buffer kia. Không tạo được thread -> tự ghi
+ */
+static int quarantine_submit(QuarantineWriter *q) {
+    if (!q->started) {
+        if (pthread_create(&q->thread, NULL, quarantine_thread, q) != 0) {
+            int result = write_all(q->fd, q->buffer[q->active], q->fill);
+            q->fill = 0;
+            return result;
+        }
+        q->started = 1;
+    }
+
+    pthread_mutex_lock(&q->mutex);
+    while (q->pending != 0) {
+        pthread_cond_wait(&q->cond, &q->mutex);
+    }
+    q->pending = q->fill;
+    q->active = !q->active;
+    q->fill = 0;
+    int failed = q->failed;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    return failed ? -1 : 0;
+}
+
+int quarantine_add(QuarantineWriter *q, RejectReason reason, const char *source,
+                   long long position, const char *row, size_t len) {
+    const char *name = reject_names[reason];
+    size_t name_len = strlen(name);
+    size_t source_len = strlen(source);
+    char pos[24];
+    int pos_len = snprintf(pos, sizeof(pos), "%lld", position);
+
+    if (source_len > QUARANTINE_SOURCE_MAX) {
+        source_len = QUARANTINE_SOURCE_MAX;
+    }
+    if (len > QUARANTINE_ROW_MAX) {
+        len = QUARANTINE_ROW_MAX;
+    }
+    size_t need = name_len + source_len + pos_len + len + 4;
+    if (q->fill + need > QUARANTINE_BUFFER && quarantine_submit(q) == -1) {
+        return -1;
+    }
+
+    char *out = q->buffer[q->active] + q->fill;
+    memcpy(out, name, name_len);
+    out += name_len;
+    *out++ = '\t';
+    memcpy(out, source, source_len);
+    out += source_len;
+    *out++ = '\t';
+    memcpy(out, pos, pos_len);
+    out += pos_len;
+    *out++ = '\t';
+    memcpy(out, row, len);
+    out += len;
+    *out++ = '\n';
+    q->fill += need;
+    q->rows++;
+    return 0;
+}
+
+int quarantine_flush(QuarantineWriter *q) {
+    return q->fill > 0 ? quarantine_submit(q) : 0;
+}
+
+int quarantine_close(QuarantineWriter *q) {
+    int result = 0;
+
+    if (q->fill > 0) {
+        if (q->started) {
+            result = quarantine_submit(q);
+        } else {
+            result = write_all(q->fd, q->buffer[q->active], q->fill);
+            q->fill = 0;
+        }
+    }
+    if (q->started) {
+        pthread_mutex_lock(&q->mutex);
+        q->stop = 1;
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->mutex);
+        pthread_join(q->thread, NULL);
+    }
+    if (q->failed) {
+        result = -1;
+    }
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->cond);
+    free(q->buffer[0]);
+    free(q->buffer[1]);
+    memset(q, 0, sizeof(*q));
+    return result;
+}
@@ -0,0 +1,60 @@
+// quarantine.h
+// Dòng rating bị loại khi validate: lý do + ghi ra file quarantine (--quarantine FILE)
+// để sửa và nạp lại sau, thay vì in 1 WARNING / dòng trong hot loop
+// - Mỗi worker 1 QuarantineWriter riêng, 2 buffer: worker ghi vào 1 buffer, thread nền
+//   của worker write() buffer kia -> worker không bao giờ chờ disk trừ khi cả 2 đều đầy
+// - Thread nền chỉ được tạo khi buffer đầu tiên đầy (input sạch: không có thread nào)
+// - Mọi worker dùng chung 1 fd mở bằng O_APPEND, mỗi write() là nhiều dòng trọn vẹn
+//   -> dòng của các worker không bị cắt xen nhau
+// Mỗi dòng của file: lý do <tab> file <tab> vị trí <tab> dòng gốc
+// (vị trí = byte offset với file text, số thứ tự dòng với file .rcol, offset đã giải nén
+// với file gzip / zstd; -1 nếu header frame zstd trước đó không ghi content size)
+#ifndef QUARANTINE_H
+#define QUARANTINE_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define QUARANTINE_BUFFER (1 << 16)       // 64KB / buffer
+#define QUARANTINE_ROW_MAX 1024           // Dòng gốc dài hơn bị cắt bớt
+
+typedef enum {
+    REJECT_MALFORMED,                     // Không đủ 4 cột số
+    REJECT_USER_ID,                       // userID ngoài [1, num_users]
+    REJECT_MOVIE_ID,                      // movieID ngoài [1, num_movies]
+    REJECT_RATING,                        // Rating ngoài [0.5, 5]
+    REJECT_KINDS
+} RejectReason;
+
+typedef struct {
+    int fd;
+    char *buffer[2];
+    int active;                           // Worker đang ghi buffer[active]
+    size_t fill;                          // Bytes trong buffer[active]
+    size_t pending;                       // Bytes của buffer[!active] chờ ghi (0 = rảnh)
+    int started;                          // Thread nền đã chạy
+    int stop;
+    int failed;                           // write() lỗi (đã in)
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    long long rows;                       // Số dòng đã nhận
+} QuarantineWriter;
+
+// Tên lý do (cột đầu của file quarantine)
+const char *reject_reason_name(RejectReason reason);
+
+// Bộ ghi của 1 worker vào fd (đã mở O_APPEND). Trả về -1 nếu hết bộ nhớ
+int quarantine_open(QuarantineWriter *q, int fd);
+
+// Thêm 1 dòng bị loại (row: dòng gốc, không gồm '\n'). Trả về -1 nếu ghi lỗi
+int quarantine_add(QuarantineWriter *q, RejectReason reason, const char *source,
+                   long long position, const char *row, size_t len);
+
+// Giao phần đang có cho thread nền ngay (không chờ buffer đầy). Trả về -1 nếu ghi lỗi
+int quarantine_flush(QuarantineWriter *q);
+
+// Ghi hết phần còn lại, dừng thread nền, giải phóng. Trả về -1 nếu có lần ghi lỗi
+int quarantine_close(QuarantineWriter *q);
+
+#endif
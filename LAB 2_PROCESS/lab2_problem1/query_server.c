@@ -0,0 +1,307 @@
+/*
+ * query_server.c
+ * Unix socket server của --serve (xem query_server.h)
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "output.h"
+#include "query_server.h"
+
+// 1 kết nối: phần request chưa đủ dòng
+typedef struct {
+    int fd;
+    size_t len;
+    char line[SERVE_LINE_MAX];
+} ServeClient;
+
+/*
+ * Hàm: serve_movie_id
+ * Mục đích: movieID của request "AVG id" / "HIST id", 0 nếu thiếu / ngoài bảng
+ */
+static int serve_movie_id(const QueryStatus *status, const char *arg) {
+    int movie_id = (arg != NULL) ? atoi(arg) : 0;
+    return (movie_id >= 1 && movie_id <= status->num_movies) ? movie_id : 0;
+}
+
+/*
+ * Hàm: answer_query
+ * Mục đích: Trả lời 1 dòng request vào out. Mọi câu trả lời bắt đầu bằng
+ * "OK" hoặc "ERR <lý do>", mỗi câu 1 dòng, riêng TOP thêm n dòng "movieID count avg":
+ *   AVG id            -> OK id count average
+ *   HIST id           -> OK id c0.5 c1.0 ... c5.0
+ *   DISTINCT id       -> OK id số user khác nhau ước lượng (cần --distinct ở analyzer)
+ *   TOP [K [MIN]]     -> OK n, rồi n dòng (mặc định theo --top / --min-ratings ...)
+ *   STATS             -> OK movies N users U updates X
+ *   QUIT              -> đóng kết nối
+ * Trả về 1 nếu client muốn đóng kết nối
+ */
+static int answer_query(const QueryBackend *backend, char *line, OutBuf *out) {
+    char *save = NULL;
+    char *cmd = strtok_r(line, " \t\r", &save);
+    char *arg1 = strtok_r(NULL, " \t\r", &save);
+    char *arg2 = strtok_r(NULL, " \t\r", &save);
+    QueryStatus status;
+
+    if (cmd == NULL) {
+        return 0;  // Dòng trống: bỏ qua
+    }
+    if (strcasecmp(cmd, "QUIT") == 0) {
+        return 1;
+    }
+    backend->status(backend->ctx, &status);
+    if (!status.ready) {
+        out_str(out, "ERR analyzer is still loading\n");
+        return 0;
+    }
+
+    if (strcasecmp(cmd, "AVG") == 0 || strcasecmp(cmd, "HIST") == 0) {
+        int movie_id = serve_movie_id(&status, arg1);
+        int64_t sum, count, hist[SERVE_HIST_BUCKETS];
+        if (movie_id == 0) {
+            out_str(out, "ERR movieID out of range 1..");
+            out_i64(out, status.num_movies);
+            out_char(out, '\n');
+            return 0;
+        }
+        if (backend->movie(backend->ctx, movie_id - 1, &sum, &count, hist) != 0) {
+            out_str(out, "ERR busy, retry\n");
+            return 0;
+        }
+        out_str(out, "OK ");
+        out_i64(out, movie_id);
+        if (strcasecmp(cmd, "AVG") == 0) {
+            out_char(out, ' ');
+            out_i64(out, count);
+            out_char(out, ' ');
+            if (count > 0) {
+                out_ratio(out, sum, count * RATING_SCALE, 4);
+            } else {
+                out_str(out, "0.0000");
+            }
+        } else {
+            for (int b = 0; b < SERVE_HIST_BUCKETS; b++) {
+                out_char(out, ' ');
+                out_i64(out, hist[b]);
+            }
+        }
+        out_char(out, '\n');
+    } else if (strcasecmp(cmd, "DISTINCT") == 0) {
+        int movie_id = serve_movie_id(&status, arg1);
+        if (!status.distinct) {
+            out_str(out, "ERR analyzer was started without --distinct\n");
+        } else if (movie_id == 0) {
+            out_str(out, "ERR movieID out of range\n");
+        } else {
+            out_str(out, "OK ");
+            out_i64(out, movie_id);
+            out_char(out, ' ');
+            out_i64(out, backend->distinct(backend->ctx, movie_id - 1));
+            out_char(out, '\n');
+        }
+    } else if (strcasecmp(cmd, "TOP") == 0) {
+        int top_k = (arg1 != NULL) ? atoi(arg1) : backend->top_k;
+        int min_ratings = (arg2 != NULL) ? atoi(arg2) : backend->min_ratings;
+        TopEntry *top = NULL;
+        if (top_k < 1 || min_ratings < 0) {
+            out_str(out, "ERR usage: TOP [K [MIN_RATINGS]]\n");
+            return 0;
+        }
+        int top_count = backend->top(backend->ctx, top_k, min_ratings, &top);
+        if (top_count < 0) {
+            out_str(out, "ERR busy, retry\n");
+            free(top);
+            return 0;
+        }
+        out_str(out, "OK ");
+        out_i64(out, top_count);
+        out_char(out, '\n');
+        for (int r = 0; r < top_count; r++) {
+            out_i64(out, top[r].id);
+            out_char(out, ' ');
+            out_i64(out, top[r].count);
+            out_char(out, ' ');
+            out_double(out, top[r].average, 4);
+            out_char(out, '\n');
+        }
+        free(top);
+    } else if (strcasecmp(cmd, "STATS") == 0) {
+        out_str(out, "OK movies ");
+        out_i64(out, status.num_movies);
+        out_str(out, " users ");
+        out_i64(out, status.num_users);
+        out_str(out, " updates ");
+        out_i64(out, status.updates);
+        out_char(out, '\n');
+    } else {
+        out_str(out, "ERR unknown command (AVG id | HIST id | DISTINCT id | TOP [K [MIN]] | STATS | QUIT)\n");
+    }
+    return 0;
+}
+
+/*
+ * Hàm: listen_unix
+ * Mục đích: Tạo Unix domain socket lắng nghe tại path
+ * Socket cũ không còn ai lắng nghe (process trước bị kill) -> xóa rồi bind lại;
+ * lỗi bind khác (thư mục không có, không có quyền ...) -> báo lỗi ngay
+ * Trả về fd, -1 nếu lỗi (đã in lý do)
+ */
+static int listen_unix(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        if (errno != EADDRINUSE) {
+            perror("bind failed");
+            close(fd);
+            return -1;
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        int alive = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (alive) {
+            fprintf(stderr, "ERROR: Another server is listening on %s\n", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+            perror("bind failed");
+            close(fd);
+            return -1;
+        }
+    }
+    if (listen(fd, SERVE_MAX_CLIENTS) == -1) {
+        perror("listen failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Hàm: serve_client
+ * Mục đích: Đọc dữ liệu mới của client, trả lời mọi dòng đã đủ
+ * Trả về -1 nếu phải đóng kết nối (client đóng, QUIT, lỗi, dòng quá dài)
+ */
+static int serve_client(const QueryBackend *backend, ServeClient *client, OutBuf *out) {
+    ssize_t n = read(client->fd, client->line + client->len, sizeof(client->line) - client->len);
+    if (n <= 0) {
+        return (n < 0 && errno == EINTR) ? 0 : -1;
+    }
+    client->len += (size_t)n;
+
+    int close_client = 0;
+    char *start = client->line;
+    char *nl;
+    while (!close_client && (nl = memchr(start, '\n', client->len - (start - client->line)))) {
+        *nl = '\0';
+        close_client = answer_query(backend, start, out);
+        start = nl + 1;
+    }
+    client->len -= (size_t)(start - client->line);
+    memmove(client->line, start, client->len);
+    if (client->len == sizeof(client->line)) {
+        out_str(out, "ERR request too long\n");
+        close_client = 1;
+    }
+
+    // Trả lời của cả lần đọc trong 1 write()
+    if (out_write(out, client->fd) != 0) {
+        close_client = 1;
+    }
+    return close_client ? -1 : 0;
+}
+
+/*
+ * Hàm: query_server_run
+ * Mục đích: Vòng poll() cho socket lắng nghe và mọi kết nối, tới khi *stop != 0
+ */
+int query_server_run(const char *socket_path, const QueryBackend *backend,
+                     volatile sig_atomic_t *stop) {
+    int listen_fd = listen_unix(socket_path);
+    if (listen_fd < 0) {
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);  // Client đóng giữa chừng -> write lỗi EPIPE, không chết
+
+    struct pollfd fds[SERVE_MAX_CLIENTS + 1];
+    ServeClient clients[SERVE_MAX_CLIENTS];
+    int num_clients = 0;
+    OutBuf out;
+    out_init(&out, 4096);
+
+    QueryStatus status;
+    backend->status(backend->ctx, &status);
+    printf("[Serve] Listening on %s (%d movies, %d users), press Ctrl+C to stop\n",
+           socket_path, status.num_movies, status.num_users);
+    fflush(stdout);
+
+    while (!*stop) {
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        for (int c = 0; c < num_clients; c++) {
+            fds[c + 1].fd = clients[c].fd;
+            fds[c + 1].events = POLLIN;
+        }
+        if (poll(fds, num_clients + 1, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll failed");
+            break;
+        }
+
+        // Duyệt ngược: đóng client c thì đưa client cuối về chỗ c
+        for (int c = num_clients - 1; c >= 0; c--) {
+            if (fds[c + 1].revents != 0 && serve_client(backend, &clients[c], &out) != 0) {
+                close(clients[c].fd);
+                clients[c] = clients[--num_clients];
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd >= 0 && num_clients == SERVE_MAX_CLIENTS) {
+                static const char busy[] = "ERR too many clients\n";
+                write(fd, busy, sizeof(busy) - 1);
+                close(fd);
+            } else if (fd >= 0) {
+                clients[num_clients].fd = fd;
+                clients[num_clients].len = 0;
+                num_clients++;
+            }
+        }
+    }
+
+    for (int c = 0; c < num_clients; c++) {
+        close(clients[c].fd);
+    }
+    close(listen_fd);
+    unlink(socket_path);
+    out_free(&out);
+    printf("\n[Serve] Stopped\n");
+    return 0;
+}
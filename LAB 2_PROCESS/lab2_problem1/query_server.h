@@ -0,0 +1,48 @@
+// query_server.h
+// Server trả lời query (--serve) qua Unix domain socket, giao thức dòng văn bản
+// - 1 thread + poll() cho mọi kết nối, mỗi kết nối giữ phần request chưa đủ dòng,
+//   trả lời của cả 1 lần read() gửi trong 1 write()
+// - Dữ liệu lấy qua QueryBackend: module này không biết layout của shared memory,
+//   problem1.c đọc bảng của analyzer dưới seqlock và báo "busy" khi writer đang ghi
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include <signal.h>
+#include <stdint.h>
+
+#include "rating_parser.h"
+#include "topk.h"
+
+#define SERVE_MAX_CLIENTS 64              // Số kết nối đồng thời tối đa
+#define SERVE_LINE_MAX 256                // Độ dài tối đa 1 dòng request
+#define SERVE_HIST_BUCKETS (5 * RATING_SCALE)  // Histogram nửa sao 0.5, 1.0, ..., 5.0
+
+// Trạng thái hiện tại của analyzer (đọc lại mỗi request)
+typedef struct {
+    int ready;                            // 1 khi bảng đã có kết quả
+    int num_movies;                       // movieID hợp lệ: 1..num_movies
+    int num_users;
+    long long updates;                    // Số lần bảng được cập nhật ở --follow
+    int distinct;                         // 1 nếu analyzer chạy với --distinct
+} QueryStatus;
+
+// Nguồn dữ liệu của server (ctx truyền lại cho mọi callback)
+typedef struct {
+    void *ctx;
+    int top_k;                            // Mặc định của TOP (--top / --min-ratings)
+    int min_ratings;
+    void (*status)(void *ctx, QueryStatus *status);
+    // Bản sao nhất quán của movie index i (sum theo nửa sao). Trả về 0, -1 nếu bận
+    int (*movie)(void *ctx, int i, int64_t *sum, int64_t *count, int64_t *hist);
+    // Số user khác nhau ước lượng của movie index i (chỉ gọi khi status.distinct)
+    long long (*distinct)(void *ctx, int i);
+    // Top movies đã sắp xếp vào *top (caller free). Trả về số phần tử, -1 nếu bận / lỗi
+    int (*top)(void *ctx, int top_k, int min_ratings, TopEntry **top);
+} QueryBackend;
+
+// Lắng nghe tại socket_path và trả lời request tới khi *stop != 0 (caller đặt handler
+// SIGINT/SIGTERM). Trả về 0, 1 nếu không tạo được socket (đã in lý do)
+int query_server_run(const char *socket_path, const QueryBackend *backend,
+                     volatile sig_atomic_t *stop);
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ * rating_columnar.c
+ * Converter text -> .rcol và kiểm tra file .rcol khi đọc
+ * Reader không parse gì cả: các cột được map thẳng và dùng như mảng
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "rating_columnar.h"
+
+// Làm tròn lên bội số của 64 (mỗi cột bắt đầu ở đầu cache line)
+static uint64_t align64(uint64_t x) {
+    return (x + 63) & ~(uint64_t)63;
+}
+
+/*
+ * Hàm: rcol_layout
+ * Mục đích: Tính offset các cột cho capacity dòng, trả về tổng size file
+ */
+static uint64_t rcol_layout(uint64_t capacity, RcolHeader *h) {
+    h->user_offset = align64(sizeof(RcolHeader));
+    h->movie_offset = align64(h->user_offset + capacity * sizeof(uint32_t));
+    h->rating_offset = align64(h->movie_offset + capacity * sizeof(uint32_t));
+    h->timestamp_offset = align64(h->rating_offset + capacity * sizeof(uint8_t));
+    return h->timestamp_offset + capacity * sizeof(uint32_t);
+}
+
+/*
+ * Hàm: count_lines
+ * Mục đích: Đếm số dòng (kể cả dòng cuối không có '\n') -> cận trên số rows
+ */
+static uint64_t count_lines(const MappedFile *mf) {
+    uint64_t lines = 0;
+    const char *p = mf->data;
+    const char *end = mf->data + mf->size;
+
+    while (p < end) {
+        p = next_line(p, end);
+        lines++;
+    }
+    return lines;
+}
+
+int rcol_is_columnar(const char *filename) {
+    char magic[4];
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    ssize_t n = read(fd, magic, sizeof(magic));
+    close(fd);
+    return n == (ssize_t)sizeof(magic) && memcmp(magic, RCOL_MAGIC, 4) == 0;
+}
+
+int rcol_open(const MappedFile *mf, RcolView *view) {
+    RcolHeader h;
+
+    if (mf->data == NULL || mf->size < sizeof(RcolHeader)) {
+        return -1;
+    }
+    memcpy(&h, mf->data, sizeof(h));
+    if (memcmp(h.magic, RCOL_MAGIC, 4) != 0 || h.version != RCOL_VERSION) {
+        return -1;
+    }
+
+    // Cột cuối (timestamp) phải nằm trọn trong file
+    if (h.timestamp_offset > mf->size ||
+        h.num_rows > (mf->size - h.timestamp_offset) / sizeof(uint32_t) ||
+        h.user_offset % 4 != 0 || h.movie_offset % 4 != 0 || h.timestamp_offset % 4 != 0) {
+        return -1;
+    }
+
+    view->num_rows = h.num_rows;
+    view->user_id = (const uint32_t *)(mf->data + h.user_offset);
+    view->movie_id = (const uint32_t *)(mf->data + h.movie_offset);
+    view->rating = (const uint8_t *)(mf->data + h.rating_offset);
+    view->timestamp = (const uint32_t *)(mf->data + h.timestamp_offset);
+    return 0;
+}
+
+/*
+ * Hàm: rcol_max_ids
+ * Mục đích: Pass quét kích thước bảng cho file .rcol: chỉ đọc cột user_id, movie_id
+ * (và cột timestamp nếu cần khoảng thời gian)
+ */
+void rcol_max_ids(const RcolView *view, uint64_t row_start, uint64_t row_end,
+                  uint32_t user_limit, uint32_t movie_limit, uint32_t *max_user_id,
+                  uint32_t *max_movie_id, uint32_t *min_ts, uint32_t *max_ts) {
+    uint32_t max_user = 0;
+    uint32_t max_movie = 0;
+
+    for (uint64_t i = row_start; i < row_end; i++) {
+        uint32_t user = view->user_id[i];
+        uint32_t movie = view->movie_id[i];
+        if (user > max_user && user <= user_limit) {
+            max_user = user;
+        }
+        if (movie > max_movie && movie <= movie_limit) {
+            max_movie = movie;
+        }
+    }
+
+    if (min_ts != NULL) {
+        for (uint64_t i = row_start; i < row_end; i++) {
+            uint32_t ts = view->timestamp[i];
+            if (ts < *min_ts) {
+                *min_ts = ts;
+            }
+            if (ts > *max_ts) {
+                *max_ts = ts;
+            }
+        }
+    }
+
+    *max_user_id = max_user;
+    *max_movie_id = max_movie;
+}
+
+/*
+ * Hàm: rcol_convert
+ * Mục đích: Parse các file text và ghi thẳng vào file output đã map (MAP_SHARED)
+ * Bước 1: đếm dòng để biết capacity -> tính layout, ftruncate
+ * Bước 2: parse từng dòng, ghi vào các cột
+ * Dòng sai định dạng bị bỏ qua; validate range (movieID, rating) để dành cho reader
+ */
+long long rcol_convert(const char *const *inputs, int num_inputs, const char *output) {
+    MappedFile *maps = calloc(num_inputs, sizeof(MappedFile));
+    if (maps == NULL) {
+        return -1;
+    }
+
+    uint64_t capacity = 0;
+    for (int i = 0; i < num_inputs; i++) {
+        if (map_file(inputs[i], &maps[i]) == -1) {
+            fprintf(stderr, "ERROR: Cannot mmap file %s\n", inputs[i]);
+            for (int j = 0; j < i; j++) {
+                unmap_file(&maps[j]);
+            }
+            free(maps);
+            return -1;
+        }
+        capacity += count_lines(&maps[i]);
+    }
+
+    RcolHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, RCOL_MAGIC, 4);
+    h.version = RCOL_VERSION;
+    uint64_t file_size = rcol_layout(capacity, &h);
+
+    long long result = -1;
+    char *out = MAP_FAILED;
+    int fd = open(output, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, file_size) == -1) {
+        perror("Cannot create output file");
+        goto cleanup;
+    }
+    out = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (out == MAP_FAILED) {
+        perror("mmap output failed");
+        goto cleanup;
+    }
+
+    uint32_t *user_col = (uint32_t *)(out + h.user_offset);
+    uint32_t *movie_col = (uint32_t *)(out + h.movie_offset);
+    uint8_t *rating_col = (uint8_t *)(out + h.rating_offset);
+    uint32_t *ts_col = (uint32_t *)(out + h.timestamp_offset);
+    uint64_t n = 0;
+
+    for (int i = 0; i < num_inputs; i++) {
+        const char *p = maps[i].data;
+        const char *end = maps[i].data + maps[i].size;
+        RatingRow row;
+        int ok;
+
+        while (p < end) {
+            p = parse_rating_line(p, end, &row, &ok);
+            if (!ok) {
+                continue;
+            }
+            user_col[n] = (uint32_t)row.user_id;
+            movie_col[n] = (uint32_t)row.movie_id;
+            // Rating > 255 nửa sao chắc chắn không hợp lệ -> lưu 0 để reader loại bỏ
+            rating_col[n] = (row.rating <= 255) ? (uint8_t)row.rating : 0;
+            ts_col[n] = (uint32_t)row.timestamp;
+            n++;
+        }
+    }
+
+    // Ghi header sau cùng: file chưa hoàn tất thì không có magic hợp lệ
+    h.num_rows = n;
+    memcpy(out, &h, sizeof(h));
+    result = (long long)n;
+
+cleanup:
+    if (out != MAP_FAILED) {
+        munmap(out, file_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    for (int i = 0; i < num_inputs; i++) {
+        unmap_file(&maps[i]);
+    }
+    free(maps);
+    return result;
+}
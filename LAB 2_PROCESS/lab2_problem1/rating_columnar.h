@@ -0,0 +1,58 @@
+// rating_columnar.h
+// Định dạng nhị phân dạng cột cho file ratings (.rcol)
+//
+// Layout file (byte order theo máy ghi, little-endian trên x86):
+//   [RcolHeader 64 bytes]
+//   [user_id   : uint32 x capacity]
+//   [movie_id  : uint32 x capacity]
+//   [rating    : uint8  x capacity]   (đơn vị nửa sao, RATING_SCALE)
+//   [timestamp : uint32 x capacity]
+// Mỗi cột bắt đầu ở offset chia hết cho 64. Chỉ num_rows phần tử đầu có nghĩa
+// (capacity = số dòng của file text, có thể lớn hơn num_rows nếu có dòng lỗi)
+#ifndef RATING_COLUMNAR_H
+#define RATING_COLUMNAR_H
+
+#include <stdint.h>
+
+#include "rating_parser.h"
+
+#define RCOL_MAGIC "RCOL"
+#define RCOL_VERSION 2         // v2: rating theo nửa sao (v1 lưu phần nguyên)
+
+typedef struct {
+    char magic[4];              // "RCOL"
+    uint32_t version;           // RCOL_VERSION
+    uint64_t num_rows;          // Số dòng hợp lệ
+    uint64_t user_offset;       // Offset (bytes) của từng cột tính từ đầu file
+    uint64_t movie_offset;
+    uint64_t rating_offset;
+    uint64_t timestamp_offset;
+    uint8_t reserved[16];       // Đệm cho đủ 64 bytes
+} RcolHeader;
+
+// Con trỏ tới các cột bên trong 1 file .rcol đã map
+typedef struct {
+    uint64_t num_rows;
+    const uint32_t *user_id;
+    const uint32_t *movie_id;
+    const uint8_t *rating;
+    const uint32_t *timestamp;
+} RcolView;
+
+// Kiểm tra 4 byte đầu của file có phải RCOL_MAGIC không (1 = có, 0 = không)
+int rcol_is_columnar(const char *filename);
+
+// Kiểm tra header + kích thước cột và điền view. Trả về 0 nếu hợp lệ, -1 nếu lỗi
+int rcol_open(const MappedFile *mf, RcolView *view);
+
+// userID, movieID lớn nhất (không vượt quá user_limit / movie_limit) trong các dòng
+// [row_start, row_end)
+// min_ts / max_ts khác NULL: cập nhật thêm timestamp nhỏ / lớn nhất
+void rcol_max_ids(const RcolView *view, uint64_t row_start, uint64_t row_end,
+                  uint32_t user_limit, uint32_t movie_limit, uint32_t *max_user_id,
+                  uint32_t *max_movie_id, uint32_t *min_ts, uint32_t *max_ts);
+
+// Chuyển các file text sang 1 file .rcol. Trả về số dòng đã ghi, -1 nếu lỗi
+long long rcol_convert(const char *const *inputs, int num_inputs, const char *output);
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * rating_parser.c
+ * Map file ratings vào bộ nhớ để parse trực tiếp, không copy qua stdio buffer
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rating_parser.h"
+
+/*
+ * Hàm: map_file
+ * Mục đích: Map toàn bộ file read-only. Mapping MAP_SHARED nên nếu parent map
+ * trước khi fork thì các child dùng chung page cache, không cần map lại
+ */
+int map_file(const char *filename, MappedFile *mf) {
+    mf->data = NULL;
+    mf->size = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    // mmap không cho phép size = 0 -> file rỗng coi như buffer rỗng
+    if (st.st_size > 0) {
+        void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        // Đọc tuần tự -> kernel đọc trước (readahead) mạnh hơn
+        madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        mf->data = addr;
+        mf->size = st.st_size;
+    }
+
+    // Mapping vẫn còn hiệu lực sau khi đóng fd
+    close(fd);
+    return 0;
+}
+
+/*
+ * Hàm: unmap_file
+ * Mục đích: Giải phóng mapping của map_file()
+ */
+void unmap_file(MappedFile *mf) {
+    if (mf->data != NULL) {
+        munmap((void *)mf->data, mf->size);
+    }
+    mf->data = NULL;
+    mf->size = 0;
+}
+
+/*
+ * Hàm: scan_max_ids
+ * Mục đích: Pass quét đầu tiên để biết kích thước bảng movie/user trong shared memory
+ * Cùng quy tắc chia đoạn với lúc parse: bỏ dòng dở dang ở đầu, đọc dòng bắt đầu < end
+ * ID > user_limit / movie_limit bị bỏ qua (dòng đó sẽ bị loại khi validate)
+ */
+void scan_max_ids(const MappedFile *mf, size_t start, size_t end, int user_limit,
+                  int movie_limit, int *max_user_id, int *max_movie_id, int *min_ts,
+                  int *max_ts) {
+    const char *data = mf->data;
+    const char *file_end = data + mf->size;
+    const char *p = data + start;
+    const char *range_end = data + end;
+    int max_user = 0;
+    int max_movie = 0;
+
+    if (start < end && start > 0 && p[-1] != '\n') {
+        p = next_line(p, file_end);
+    }
+
+    if (min_ts != NULL) {
+        // Cần timestamp -> parse cả dòng (chậm hơn, chỉ dùng khi có --bucket)
+        RatingRow row;
+        int ok;
+        while (p < range_end) {
+            p = parse_rating_line(p, file_end, &row, &ok);
+            if (!ok) {
+                continue;
+            }
+            if (row.user_id > max_user && row.user_id <= user_limit) {
+                max_user = row.user_id;
+            }
+            if (row.movie_id > max_movie && row.movie_id <= movie_limit) {
+                max_movie = row.movie_id;
+            }
+            if (row.timestamp < *min_ts) {
+                *min_ts = row.timestamp;
+            }
+            if (row.timestamp > *max_ts) {
+                *max_ts = row.timestamp;
+            }
+        }
+    }
+
+    while (p < range_end) {
+        const char *line_end = next_line(p, file_end);
+        const char *q;
+        int user_id, movie_id;
+
+        q = parse_uint(p, line_end, &user_id);
+        if (q != NULL && user_id > max_user && user_id <= user_limit) {
+            max_user = user_id;
+        }
+        if (q != NULL && q < line_end && *q == '\t' &&
+            parse_uint(q + 1, line_end, &movie_id) != NULL &&
+            movie_id > max_movie && movie_id <= movie_limit) {
+            max_movie = movie_id;
+        }
+        p = line_end;
+    }
+
+    *max_user_id = max_user;
+    *max_movie_id = max_movie;
+}
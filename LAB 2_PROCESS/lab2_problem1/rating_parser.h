@@ -0,0 +1,133 @@
+// rating_parser.h
+// Đọc file ratings bằng mmap + parser số nguyên viết tay (thay cho fscanf)
+#ifndef RATING_PARSER_H
+#define RATING_PARSER_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Rating lưu dạng fixed-point theo đơn vị nửa sao: 3.5 -> 7, 4 -> 8
+// (MovieLens 10M+ có bước 0.5, cắt về số nguyên sẽ làm sai average)
+#define RATING_SCALE 2
+// Phần nguyên lớn hơn giá trị này bị bão hòa (chắc chắn không hợp lệ, tránh tràn)
+#define RATING_WHOLE_MAX 1000000
+
+// 1 dòng rating: userID <tab> movieID <tab> rating <tab> timestamp
+typedef struct {
+    int user_id;
+    int movie_id;
+    int rating;            // Rating theo nửa sao (làm tròn xuống bội số 0.5)
+    int timestamp;
+} RatingRow;
+
+// File được map read-only vào bộ nhớ
+typedef struct {
+    const char *data;      // NULL nếu file rỗng
+    size_t size;
+} MappedFile;
+
+// Map toàn bộ file (MAP_SHARED, PROT_READ). Trả về 0 nếu thành công, -1 nếu lỗi
+int map_file(const char *filename, MappedFile *mf);
+
+// Unmap file đã map bằng map_file()
+void unmap_file(MappedFile *mf);
+
+// Quét nhanh các dòng bắt đầu trong [start, end) của file text, tìm userID và
+// movieID lớn nhất không vượt quá user_limit / movie_limit (chỉ đọc cột 1, 2, không
+// validate cột khác)
+// min_ts / max_ts khác NULL: parse cả dòng để lấy timestamp nhỏ / lớn nhất
+// (giữ nguyên giá trị truyền vào nếu đoạn không có dòng hợp lệ)
+void scan_max_ids(const MappedFile *mf, size_t start, size_t end, int user_limit,
+                  int movie_limit, int *max_user_id, int *max_movie_id, int *min_ts,
+                  int *max_ts);
+
+/*
+ * Hàm: parse_uint
+ * Mục đích: Đọc 1 số nguyên không dấu (tối đa 10 chữ số) bắt đầu tại p
+ * Trả về vị trí ngay sau chữ số cuối, hoặc NULL nếu không có chữ số nào hoặc số
+ * lớn hơn INT_MAX (không để 4294967297 quay vòng thành 1)
+ */
+static inline const char *parse_uint(const char *p, const char *end, int *out) {
+    const char *start = p;
+    uint64_t value = 0;
+
+    // (unsigned)(c - '0') < 10 thay cho 2 phép so sánh '0' <= c <= '9'
+    while (p < end && (unsigned int)(*p - '0') < 10 && p - start < 10) {
+        value = value * 10 + (unsigned int)(*p - '0');
+        p++;
+    }
+
+    *out = (int)value;
+    return (p == start || value > INT_MAX) ? NULL : p;
+}
+
+/*
+ * Hàm: next_line
+ * Mục đích: Trả về vị trí đầu dòng kế tiếp (sau '\n'), hoặc end nếu hết buffer
+ * memchr của glibc dùng SIMD nên quét '\n' nhanh hơn vòng lặp từng byte
+ */
+static inline const char *next_line(const char *p, const char *end) {
+    const char *nl = memchr(p, '\n', end - p);
+    return (nl == NULL) ? end : nl + 1;
+}
+
+/*
+ * Hàm: parse_rating_line
+ * Mục đích: Parse 1 dòng bắt đầu tại p (p phải là đầu dòng)
+ * - *ok = 1 nếu đủ 4 cột hợp lệ, 0 nếu dòng sai định dạng (kể cả ký tự thừa sau
+ *   timestamp, khoảng trắng đầu cột, số mũ "1e0")
+ * - Luôn trả về vị trí đầu dòng kế tiếp -> dòng lỗi chỉ bị bỏ qua,
+ *   không làm dừng việc đọc cả file như fscanf
+ * Rating dạng "3" hoặc "3.5" -> 6 hoặc 7 nửa sao (chữ số thập phân đầu >= 5 thì
+ * thêm 1 nửa sao, các chữ số sau bỏ qua)
+ */
+static inline const char *parse_rating_line(const char *p, const char *end,
+                                            RatingRow *row, int *ok) {
+    const char *q = p;
+    int whole;
+    int half = 0;
+    *ok = 0;
+
+    if ((q = parse_uint(q, end, &row->user_id)) == NULL || q >= end || *q++ != '\t') {
+        return next_line(p, end);
+    }
+    if ((q = parse_uint(q, end, &row->movie_id)) == NULL || q >= end || *q++ != '\t') {
+        return next_line(p, end);
+    }
+    if ((q = parse_uint(q, end, &whole)) == NULL || q >= end) {
+        return next_line(p, end);
+    }
+    if (*q == '.') {
+        q++;
+        if (q < end && (unsigned int)(*q - '0') < 10) {
+            half = (*q >= '5');
+        }
+        while (q < end && (unsigned int)(*q - '0') < 10) {
+            q++;
+        }
+    }
+    if (whole < 0 || whole > RATING_WHOLE_MAX) {
+        whole = RATING_WHOLE_MAX;
+    }
+    row->rating = whole * RATING_SCALE + half;
+    if (q >= end || *q++ != '\t') {
+        return next_line(p, end);
+    }
+    if ((q = parse_uint(q, end, &row->timestamp)) == NULL) {
+        return next_line(p, end);
+    }
+    // Sau timestamp chỉ còn '\r' (file CRLF) rồi hết dòng: "100junk" là dòng sai
+    if (q < end && *q == '\r') {
+        q++;
+    }
+    if (q < end && *q != '\n') {
+        return next_line(q, end);
+    }
+
+    *ok = 1;
+    return (q < end) ? q + 1 : end;
+}
+
+#endif
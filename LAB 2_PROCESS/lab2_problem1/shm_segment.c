@@ -0,0 +1,280 @@
+/*
+ * shm_segment.c
+ * Các backend shared memory của problem1. Mọi backend đều cho 1 vùng MAP_SHARED
+ * nên child fork sau khi tạo dùng chung bảng mà không cần attach lại
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm_segment.h"
+
+#ifndef SHM_HUGETLB
+#define SHM_HUGETLB 04000
+#endif
+
+// Làm tròn lên bội số của hugepage (hugetlb chỉ map được cả page)
+static size_t round_huge(size_t size) {
+    return (size + SHM_HUGEPAGE_SIZE - 1) & ~(SHM_HUGEPAGE_SIZE - 1);
+}
+
+/*
+ * Hàm: advise_thp
+ * Mục đích: Đề nghị kernel dùng transparent hugepage cho vùng nhớ
+ * (shmem cần /sys/kernel/mm/transparent_hugepage/shmem_enabled = advise / always)
+ */
+static void advise_thp(ShmSegment *seg) {
+#ifdef MADV_HUGEPAGE
+    if (seg->huge == SHM_HUGE_THP) {
+        madvise(seg->addr, seg->size, MADV_HUGEPAGE);
+    }
+#endif
+}
+
+/*
+ * Hàm: create_sysv
+ * Mục đích: shmget + shmat. SHM_HUGETLB lỗi (chưa đặt trước hugepage) -> page thường + THP
+ */
+static int create_sysv(ShmSegment *seg, key_t key, size_t size) {
+    if (seg->huge == SHM_HUGE_TLB) {
+        seg->shmid = shmget(key, round_huge(size), IPC_CREAT | SHM_HUGETLB | 0666);
+        if (seg->shmid >= 0) {
+            seg->size = round_huge(size);
+        } else {
+            fprintf(stderr, "⚠️  SHM_HUGETLB unavailable (%s), using THP\n", strerror(errno));
+            seg->huge = SHM_HUGE_THP;
+        }
+    }
+    if (seg->shmid < 0) {
+        seg->shmid = shmget(key, size, IPC_CREAT | 0666);
+    }
+    if (seg->shmid < 0) {
+        perror("shmget failed");
+        return -1;
+    }
+
+    seg->addr = shmat(seg->shmid, NULL, 0);
+    if (seg->addr == (void *)-1) {
+        perror("shmat failed");
+        seg->addr = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Hàm: map_fd
+ * Mục đích: ftruncate fd tới size rồi map MAP_SHARED (fd đóng được ngay sau đó)
+ */
+static int map_fd(ShmSegment *seg, int fd, size_t size) {
+    if (ftruncate(fd, size) == -1) {
+        return -1;
+    }
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+    seg->addr = addr;
+    seg->size = size;
+    return 0;
+}
+
+/*
+ * Hàm: create_posix
+ * Mục đích: shm_open (O_EXCL -> không bao giờ dùng nhầm segment của lần chạy khác)
+ * Không giữ tên -> unlink ngay: crash cũng không để lại segment trong /dev/shm
+ */
+static int create_posix(ShmSegment *seg, const char *name, size_t size) {
+    if (seg->huge == SHM_HUGE_TLB) {
+        // /dev/shm là tmpfs, không map hugetlb được
+        fprintf(stderr, "⚠️  POSIX shm cannot use hugetlb pages, using THP\n");
+        seg->huge = SHM_HUGE_THP;
+    }
+    if (name != NULL) {
+        snprintf(seg->name, sizeof(seg->name), "%s", name);
+    } else {
+        snprintf(seg->name, sizeof(seg->name), "/problem1.%d", (int)getpid());
+    }
+
+    int fd = shm_open(seg->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "shm_open %s failed: %s\n", seg->name, strerror(errno));
+        seg->name[0] = '\0';
+        return -1;
+    }
+    int result = map_fd(seg, fd, size);
+    if (result == -1) {
+        perror("mmap shared memory failed");
+    }
+    close(fd);
+
+    if (result == -1 || name == NULL) {
+        shm_unlink(seg->name);
+        seg->name[0] = '\0';
+    }
+    return result;
+}
+
+/*
+ * Hàm: create_memfd
+ * Mục đích: memfd_create (MFD_HUGETLB nếu được) -> vùng nhớ không tên
+ */
+static int create_memfd(ShmSegment *seg, size_t size) {
+#ifdef MFD_HUGETLB
+    if (seg->huge == SHM_HUGE_TLB) {
+        int fd = memfd_create("problem1", MFD_CLOEXEC | MFD_HUGETLB);
+        if (fd >= 0) {
+            int result = map_fd(seg, fd, round_huge(size));
+            close(fd);
+            if (result == 0) {
+                return 0;
+            }
+        }
+        fprintf(stderr, "⚠️  MFD_HUGETLB unavailable (%s), using THP\n", strerror(errno));
+    }
+#endif
+    if (seg->huge == SHM_HUGE_TLB) {
+        seg->huge = SHM_HUGE_THP;
+    }
+
+    int fd = memfd_create("problem1", MFD_CLOEXEC);
+    if (fd < 0) {
+        perror("memfd_create failed");
+        return -1;
+    }
+    int result = map_fd(seg, fd, size);
+    if (result == -1) {
+        perror("mmap shared memory failed");
+    }
+    close(fd);
+    return result;
+}
+
+int shm_segment_create(ShmSegment *seg, ShmBackend backend, ShmHugeMode huge,
+                       key_t key, const char *name, size_t size) {
+    memset(seg, 0, sizeof(*seg));
+    seg->backend = backend;
+    seg->huge = huge;
+    seg->shmid = -1;
+    seg->size = size;
+
+    int result;
+    switch (backend) {
+    case SHM_BACKEND_POSIX:
+        result = create_posix(seg, name, size);
+        break;
+    case SHM_BACKEND_MEMFD:
+        result = create_memfd(seg, size);
+        break;
+    default:
+        result = create_sysv(seg, key, size);
+        break;
+    }
+    if (result == 0) {
+        advise_thp(seg);
+    }
+    return result;
+}
+
+int shm_segment_attach_readonly(ShmSegment *seg, key_t key, const char *name) {
+    memset(seg, 0, sizeof(*seg));
+    seg->shmid = -1;
+
+    if (name != NULL) {
+        int fd = shm_open(name, O_RDONLY, 0);
+        struct stat st;
+        if (fd < 0) {
+            return -1;
+        }
+        if (fstat(fd, &st) == -1 || st.st_size == 0) {
+            close(fd);
+            return -1;
+        }
+        void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            return -1;
+        }
+        seg->backend = SHM_BACKEND_POSIX;
+        seg->addr = addr;
+        seg->size = st.st_size;
+        return 0;
+    }
+
+    seg->backend = SHM_BACKEND_SYSV;
+    seg->shmid = shmget(key, 0, 0);
+    if (seg->shmid < 0) {
+        return -1;
+    }
+    seg->addr = shmat(seg->shmid, NULL, SHM_RDONLY);
+    if (seg->addr == (void *)-1) {
+        seg->addr = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void shm_segment_detach(ShmSegment *seg) {
+    if (seg->addr == NULL) {
+        return;
+    }
+    if (seg->backend == SHM_BACKEND_SYSV) {
+        shmdt(seg->addr);
+    } else {
+        munmap(seg->addr, seg->size);
+    }
+    seg->addr = NULL;
+}
+
+int shm_segment_destroy(ShmSegment *seg) {
+    int result = 0;
+
+    shm_segment_detach(seg);
+    if (seg->backend == SHM_BACKEND_SYSV && seg->shmid >= 0) {
+        if (shmctl(seg->shmid, IPC_RMID, NULL) == -1) {
+            perror("shmctl failed");
+            result = -1;
+        }
+        seg->shmid = -1;
+    }
+    if (seg->name[0] != '\0') {
+        if (shm_unlink(seg->name) == -1) {
+            perror("shm_unlink failed");
+            result = -1;
+        }
+        seg->name[0] = '\0';
+    }
+    // memfd / POSIX đã unlink: mất khi mapping cuối cùng bị bỏ
+    return result;
+}
+
+const char *shm_backend_name(ShmBackend backend) {
+    switch (backend) {
+    case SHM_BACKEND_POSIX:
+        return "posix";
+    case SHM_BACKEND_MEMFD:
+        return "memfd";
+    default:
+        return "sysv";
+    }
+}
+
+const char *shm_huge_name(ShmHugeMode huge) {
+    switch (huge) {
+    case SHM_HUGE_THP:
+        return "thp";
+    case SHM_HUGE_TLB:
+        return "hugetlb";
+    default:
+        return "off";
+    }
+}
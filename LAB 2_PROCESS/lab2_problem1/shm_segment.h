@@ -0,0 +1,60 @@
+// shm_segment.h
+// Tạo / attach / xóa vùng shared memory chứa bảng tổng hợp, chọn backend lúc chạy:
+// - SysV shmget với key cố định (bản gốc, --query tìm theo key)
+// - POSIX shm_open với tên riêng của mỗi lần chạy (unlink ngay sau khi map)
+// - memfd_create: không có tên, tự mất khi process cuối cùng thoát
+// Bảng lớn có thể dùng hugepage (MAP_HUGETLB / SHM_HUGETLB) hoặc THP (madvise)
+// để giảm TLB miss
+#ifndef SHM_SEGMENT_H
+#define SHM_SEGMENT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SHM_NAME_MAX 64
+#define SHM_HUGEPAGE_SIZE (2UL << 20)   // Hugepage mặc định trên x86-64
+
+typedef enum {
+    SHM_BACKEND_SYSV,       // shmget / shmat
+    SHM_BACKEND_POSIX,      // shm_open + mmap
+    SHM_BACKEND_MEMFD       // memfd_create + mmap
+} ShmBackend;
+
+typedef enum {
+    SHM_HUGE_OFF,           // Page thường
+    SHM_HUGE_THP,           // madvise(MADV_HUGEPAGE): kernel tự gộp page thành 2MB
+    SHM_HUGE_TLB            // Hugepage đặt trước (vm.nr_hugepages), lỗi -> THP
+} ShmHugeMode;
+
+typedef struct {
+    ShmBackend backend;
+    ShmHugeMode huge;       // Chế độ thực sự được dùng (có thể bị hạ từ TLB xuống THP)
+    void *addr;
+    size_t size;            // Size đã map (làm tròn lên hugepage nếu SHM_HUGE_TLB)
+    int shmid;              // SysV: ID segment (-1 nếu không dùng)
+    char name[SHM_NAME_MAX]; // POSIX: tên còn tồn tại ("" nếu đã unlink)
+} ShmSegment;
+
+// Tạo và map segment size bytes (đã điền 0), dùng chung với các child fork sau đó
+// - SysV: key (IPC_CREAT)
+// - POSIX: name != NULL -> tạo đúng tên đó (O_EXCL) và GIỮ tên để --query attach;
+//          name == NULL -> tên riêng theo PID, unlink ngay sau khi map
+// Trả về 0 nếu thành công, -1 nếu lỗi (đã in lý do)
+int shm_segment_create(ShmSegment *seg, ShmBackend backend, ShmHugeMode huge,
+                       key_t key, const char *name, size_t size);
+
+// Attach READ-ONLY segment đang tồn tại: name != NULL -> POSIX, ngược lại SysV key
+// Trả về 0 nếu thành công, -1 nếu không tìm thấy
+int shm_segment_attach_readonly(ShmSegment *seg, key_t key, const char *name);
+
+// Bỏ mapping (child trước khi thoát, --query) - không xóa segment
+void shm_segment_detach(ShmSegment *seg);
+
+// Bỏ mapping và xóa segment (IPC_RMID / shm_unlink). Trả về 0 nếu thành công
+int shm_segment_destroy(ShmSegment *seg);
+
+// Tên backend / chế độ hugepage (để in báo cáo)
+const char *shm_backend_name(ShmBackend backend);
+const char *shm_huge_name(ShmHugeMode huge);
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ * similarity.c
+ * CSR theo user / theo movie và tính top-N láng giềng item-item (xem similarity.h)
+ */
+
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "similarity.h"
+#include "topk.h"
+
+// Accumulator của 1 movie Y khi tính láng giềng của X (16 bytes: 4 movie / cache line)
+typedef struct {
+    double dot;                    // Tổng tích rating (đã trừ center) của các user chung
+    int32_t common;                // Số user chung (0 = chưa chạm)
+    int32_t pad;
+} SimAccum;
+
+// Làm tròn lên bội số của 64 bytes
+static size_t align64(size_t n) {
+    return (n + 63) & ~(size_t)63;
+}
+
+SimIndex *sim_create(int num_movies, int num_users, const int64_t *movie_sum,
+                     const int64_t *movie_count, const int64_t *user_count,
+                     SimMetric metric, int top_n, int min_common) {
+    int64_t nnz = 0;
+    for (int u = 0; u < num_users; u++) {
+        nnz += user_count[u];
+    }
+
+    // Layout: [SimIndex][user_ptr][user_fill][movie_ptr][movie_end][movie_center]
+    //         [movie_norm][num_neighbors][neighbors][user_items][movie_items]
+    size_t sizes[10] = {
+        sizeof(SimIndex),
+        (size_t)(num_users + 1) * sizeof(int64_t),
+        (size_t)num_users * sizeof(int64_t),
+        (size_t)(num_movies + 1) * sizeof(int64_t),
+        (size_t)num_movies * sizeof(int64_t),
+        (size_t)num_movies * sizeof(double),
+        (size_t)num_movies * sizeof(double),
+        (size_t)num_movies * sizeof(int32_t),
+        (size_t)num_movies * top_n * sizeof(SimNeighbor),
+        (size_t)nnz * sizeof(uint32_t)
+    };
+    size_t offsets[11];
+    offsets[0] = 0;
+    for (int i = 0; i < 10; i++) {
+        offsets[i + 1] = offsets[i] + align64(sizes[i]);
+    }
+    size_t total = offsets[10] + align64((size_t)nnz * sizeof(uint32_t));
+
+    char *base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap similarity index failed");
+        return NULL;
+    }
+    SimIndex *sim = (SimIndex *)base;
+    sim->metric = metric;
+    sim->top_n = top_n;
+    sim->min_common = min_common;
+    sim->num_movies = num_movies;
+    sim->num_users = num_users;
+    sim->nnz = nnz;
+    sim->mapping_size = total;
+    sim->user_ptr = (int64_t *)(base + offsets[1]);
+    sim->user_fill = (int64_t *)(base + offsets[2]);
+    sim->movie_ptr = (int64_t *)(base + offsets[3]);
+    sim->movie_end = (int64_t *)(base + offsets[4]);
+    sim->movie_center = (double *)(base + offsets[5]);
+    sim->movie_norm = (double *)(base + offsets[6]);
+    sim->num_neighbors = (int32_t *)(base + offsets[7]);
+    sim->neighbors = (SimNeighbor *)(base + offsets[8]);
+    sim->user_items = (uint32_t *)(base + offsets[9]);
+    sim->movie_items = (uint32_t *)(base + offsets[10]);
+
+    // Hàng của user u bắt đầu ở tổng số rating của các user trước nó
+    sim->user_ptr[0] = 0;
+    for (int u = 0; u < num_users; u++) {
+        sim->user_fill[u] = sim->user_ptr[u];
+        sim->user_ptr[u + 1] = sim->user_ptr[u] + user_count[u];
+    }
+    sim->movie_ptr[0] = 0;
+    for (int m = 0; m < num_movies; m++) {
+        sim->movie_ptr[m + 1] = sim->movie_ptr[m] + movie_count[m];
+        sim->movie_center[m] = (metric == SIM_PEARSON && movie_count[m] > 0)
+            ? (double)movie_sum[m] / movie_count[m] : 0.0;
+    }
+    return sim;
+}
+
+void sim_build_columns(SimIndex *sim) {
+    double *sq = sim->movie_norm;
+
+    for (int m = 0; m < sim->num_movies; m++) {
+        sim->movie_end[m] = sim->movie_ptr[m];
+        sq[m] = 0;
+    }
+    // Duyệt user tăng dần -> hàng của mỗi movie cũng tăng dần theo user
+    for (int u = 0; u < sim->num_users; u++) {
+        int64_t end = sim->user_fill[u] < sim->user_ptr[u + 1] ? sim->user_fill[u]
+                                                                : sim->user_ptr[u + 1];
+        for (int64_t p = sim->user_ptr[u]; p < end; p++) {
+            uint32_t item = sim->user_items[p];
+            int m = (int)(item >> SIM_RATING_BITS);
+            int rating = (int)(item & ((1u << SIM_RATING_BITS) - 1));
+            // Không vượt hàng của movie (pass 2 chỉ có thể ít hơn pass 1 nếu input đổi)
+            if (sim->movie_end[m] < sim->movie_ptr[m + 1]) {
+                sim->movie_items[sim->movie_end[m]++] =
+                    ((uint32_t)u << SIM_RATING_BITS) | (uint32_t)rating;
+                double v = rating - sim->movie_center[m];
+                sq[m] += v * v;
+            }
+        }
+    }
+    for (int m = 0; m < sim->num_movies; m++) {
+        sq[m] = sqrt(sq[m]);
+    }
+}
+
+/*
+ * Hàm: sim_movie
+ * Mục đích: Top-N láng giềng của movie index x
+ * acc (num_movies phần tử, toàn 0) được trả về toàn 0; touched: danh sách movie đã chạm
+ */
+static void sim_movie(SimIndex *sim, int x, SimAccum *acc, int32_t *touched, TopEntry *heap) {
+    const double *center = sim->movie_center;
+    const uint32_t mask = (1u << SIM_RATING_BITS) - 1;
+    int num_touched = 0;
+    int size = 0;
+
+    if (sim->movie_norm[x] > 0) {
+        for (int64_t p = sim->movie_ptr[x]; p < sim->movie_end[x]; p++) {
+            int u = (int)(sim->movie_items[p] >> SIM_RATING_BITS);
+            double vx = (double)(sim->movie_items[p] & mask) - center[x];
+            int64_t end = sim->user_fill[u] < sim->user_ptr[u + 1] ? sim->user_fill[u]
+                                                                    : sim->user_ptr[u + 1];
+            // Hàng của user nằm liên tiếp -> đọc tuần tự
+            for (int64_t q = sim->user_ptr[u]; q < end; q++) {
+                uint32_t item = sim->user_items[q];
+                int y = (int)(item >> SIM_RATING_BITS);
+                if (y == x) {
+                    continue;
+                }
+                SimAccum *a = &acc[y];
+                if (a->common == 0) {
+                    touched[num_touched++] = y;
+                }
+                a->common++;
+                a->dot += vx * ((double)(item & mask) - center[y]);
+            }
+        }
+    }
+
+    for (int t = 0; t < num_touched; t++) {
+        int y = touched[t];
+        SimAccum *a = &acc[y];
+        if (a->common >= sim->min_common && sim->movie_norm[y] > 0) {
+            TopEntry entry;
+            entry.id = y + 1;
+            entry.count = a->common;
+            entry.score = a->dot / (sim->movie_norm[x] * sim->movie_norm[y]);
+            entry.average = entry.score;
+            topk_push(heap, &size, sim->top_n, &entry);
+        }
+        a->dot = 0;
+        a->common = 0;
+    }
+
+    topk_sort(heap, size);
+    SimNeighbor *out = sim->neighbors + (size_t)x * sim->top_n;
+    for (int k = 0; k < size; k++) {
+        out[k].movie = heap[k].id;
+        out[k].common = (int32_t)heap[k].count;
+        out[k].score = (float)heap[k].score;
+    }
+    sim->num_neighbors[x] = size;
+}
+
+/*
+ * Hàm: sim_worker
+ * Mục đích: Lấy block SIM_BLOCK movie liên tiếp cho tới khi hết (movie nhiều rating
+ * tốn nhiều hơn -> chia động thay vì chia đều theo ID)
+ */
+static void *sim_worker(void *arg) {
+    SimIndex *sim = arg;
+    SimAccum *acc = calloc(sim->num_movies, sizeof(SimAccum));
+    int32_t *touched = malloc((size_t)sim->num_movies * sizeof(int32_t));
+    TopEntry *heap = malloc((size_t)sim->top_n * sizeof(TopEntry));
+    if (acc == NULL || touched == NULL || heap == NULL) {
+        perror("malloc failed");
+        exit(1);
+    }
+
+    for (;;) {
+        int first = __sync_fetch_and_add(&sim->next_block, SIM_BLOCK);
+        if (first >= sim->num_movies) {
+            break;
+        }
+        int last = first + SIM_BLOCK < sim->num_movies ? first + SIM_BLOCK : sim->num_movies;
+        for (int x = first; x < last; x++) {
+            sim_movie(sim, x, acc, touched, heap);
+        }
+    }
+
+    free(acc);
+    free(touched);
+    free(heap);
+    return NULL;
+}
+
+int sim_run(SimIndex *sim, int num_workers, int use_threads) {
+    int failed = 0;
+
+    sim->next_block = 0;
+    if (use_threads) {
+        pthread_t *threads = malloc(num_workers * sizeof(pthread_t));
+        if (threads == NULL) {
+            perror("malloc failed");
+            return -1;
+        }
+        int started = 0;
+        for (; started < num_workers; started++) {
+            if (pthread_create(&threads[started], NULL, sim_worker, sim) != 0) {
+                perror("pthread_create failed");
+                break;  // Các thread đã chạy vẫn lấy hết block
+            }
+        }
+        for (int t = 0; t < started; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        free(threads);
+        return started > 0 ? 0 : -1;
+    }
+
+    fflush(stdout);
+    pid_t *pids = malloc(num_workers * sizeof(pid_t));
+    if (pids == NULL) {
+        perror("malloc failed");
+        return -1;
+    }
+    for (int w = 0; w < num_workers; w++) {
+        pids[w] = fork();
+        if (pids[w] < 0) {
+            perror("fork failed");
+            exit(1);
+        }
+        if (pids[w] == 0) {
+            sim_worker(sim);
+            exit(0);
+        }
+    }
+    for (int w = 0; w < num_workers; w++) {
+        int status;
+        waitpid(pids[w], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "ERROR: Similarity child %d failed\n", w + 1);
+            failed = 1;
+        }
+    }
+    free(pids);
+    return failed ? -1 : 0;
+}
+
+void sim_destroy(SimIndex *sim) {
+    if (sim != NULL) {
+        munmap(sim, sim->mapping_size);
+    }
+}
+
+const char *sim_metric_name(SimMetric metric) {
+    return metric == SIM_PEARSON ? "pearson" : "cosine";
+}
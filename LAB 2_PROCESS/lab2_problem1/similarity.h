@@ -0,0 +1,89 @@
+// similarity.h
+// Độ tương tự item-item (--similar N): "user đã rate X cũng rate Y"
+// 1. Pass 2 của ingest ghi (movie, rating) của mỗi rating vào hàng của user trong CSR
+//    (kích thước hàng = user_count đã biết sau pass 1 -> không cần cấp phát lại)
+// 2. Chuyển vị sang CSR theo movie (danh sách user đã rate mỗi movie, tăng dần theo user)
+// 3. N worker lấy từng block movie: với movie X, duyệt user u của X rồi hàng của u,
+//    cộng tích vô hướng vào accumulator dày (16 bytes / movie, nằm gọn trong L2)
+//    -> top-N láng giềng theo cosine hoặc Pearson (cosine sau khi trừ mean của movie)
+// Tất cả nằm trong 1 vùng MAP_SHARED: child fork sau và thread đều dùng chung
+#ifndef SIMILARITY_H
+#define SIMILARITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIM_DEFAULT_MIN_COMMON 5   // Số user chung tối thiểu để 2 movie được so sánh
+#define SIM_BLOCK 16               // Số movie liên tiếp mỗi lần worker lấy việc
+#define SIM_MAX_NEIGHBORS 1000     // Giới hạn --similar N
+#define SIM_RATING_BITS 4          // Rating (1..10 nửa sao) ở 4 bit thấp của 1 phần tử CSR
+
+typedef enum {
+    SIM_COSINE,                    // Cosine trên rating gốc
+    SIM_PEARSON                    // Cosine trên rating đã trừ mean của movie
+} SimMetric;
+
+// 1 láng giềng của movie
+typedef struct {
+    int32_t movie;                 // movieID
+    int32_t common;                // Số user đã rate cả 2 movie
+    float score;                   // Độ tương tự
+} SimNeighbor;
+
+// Bắt đầu vùng nhớ dùng chung (các mảng nằm ngay sau, căn 64 bytes)
+typedef struct {
+    SimMetric metric;
+    int top_n;
+    int min_common;
+    int num_movies;
+    int num_users;
+    int64_t nnz;                   // Số rating dự kiến (= tổng user_count)
+    volatile int64_t dropped;      // Rating của pass 2 không còn chỗ (input đổi giữa 2 pass)
+    volatile int next_block;       // Movie đầu tiên của block chưa ai lấy
+    size_t mapping_size;
+    int64_t *user_ptr;             // [num_users + 1] hàng của user u: [user_ptr[u], user_fill[u])
+    int64_t *user_fill;            // [num_users] vị trí ghi tiếp theo của pass 2
+    uint32_t *user_items;          // [nnz] (movie index << 4) | rating
+    int64_t *movie_ptr;            // [num_movies + 1] hàng của movie m: [movie_ptr[m], movie_end[m])
+    int64_t *movie_end;            // [num_movies]
+    uint32_t *movie_items;         // [nnz] (user index << 4) | rating
+    double *movie_center;          // [num_movies] mean (nửa sao) nếu SIM_PEARSON, 0 nếu SIM_COSINE
+    double *movie_norm;            // [num_movies] độ dài vector rating (đã trừ center)
+    int32_t *num_neighbors;        // [num_movies]
+    SimNeighbor *neighbors;        // [num_movies * top_n] giảm dần theo score
+} SimIndex;
+
+// Tạo CSR rỗng theo kích thước hàng user_count / movie_count (bảng của pass 1)
+// movie_sum dùng để tính mean (SIM_PEARSON). Trả về NULL nếu lỗi (đã in lý do)
+SimIndex *sim_create(int num_movies, int num_users, const int64_t *movie_sum,
+                     const int64_t *movie_count, const int64_t *user_count,
+                     SimMetric metric, int top_n, int min_common);
+
+// Chuyển vị sang CSR theo movie và tính độ dài vector (sau pass 2, 1 process)
+void sim_build_columns(SimIndex *sim);
+
+// Tính top-N láng giềng của mọi movie bằng num_workers child process (use_threads = 0)
+// hoặc thread. Trả về 0 nếu thành công
+int sim_run(SimIndex *sim, int num_workers, int use_threads);
+
+// Bỏ vùng nhớ
+void sim_destroy(SimIndex *sim);
+
+// Tên metric (để in)
+const char *sim_metric_name(SimMetric metric);
+
+/*
+ * Hàm: sim_add
+ * Mục đích: (pass 2) Ghi 1 rating vào hàng của user (0-based index, rating nửa sao)
+ * Nhiều worker ghi cùng lúc: lấy chỗ bằng atomic add trên con trỏ ghi của user
+ */
+static inline void sim_add(SimIndex *sim, int user, int movie, int rating) {
+    int64_t pos = __sync_fetch_and_add(&sim->user_fill[user], 1);
+    if (pos < sim->user_ptr[user + 1]) {
+        sim->user_items[pos] = ((uint32_t)movie << SIM_RATING_BITS) | (uint32_t)rating;
+    } else {
+        __sync_fetch_and_add(&sim->dropped, 1);
+    }
+}
+
+#endif
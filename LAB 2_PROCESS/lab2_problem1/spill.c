@@ -0,0 +1,300 @@
+/*
+ * spill.c
+ * Run file theo partition cho --spill (xem spill.h)
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "spill.h"
+
+#define SPILL_MAX_BUFFER (1 << 16)        // Buffer lớn hơn 256KB / partition không ghi nhanh hơn
+
+static const char spill_kind_char[SPILL_KINDS] = {'m', 'u'};
+
+// Số mảng int64_t của bảng partition: sum, count (+ histogram với movie)
+static size_t spill_table_arrays(SpillKind kind) {
+    return (kind == SPILL_MOVIES) ? 2 + SPILL_HIST_BUCKETS : 2;
+}
+
+int spill_layout_init(SpillLayout *layout, const char *dir, const int ids[SPILL_KINDS],
+                      int num_workers, size_t mem_bytes) {
+    struct stat st;
+
+    memset(layout, 0, sizeof(*layout));
+    if (strlen(dir) >= sizeof(layout->dir)) {
+        fprintf(stderr, "Spill directory path too long: %s\n", dir);
+        return -1;
+    }
+    if (stat(dir, &st) == -1 || !S_ISDIR(st.st_mode) || access(dir, W_OK | X_OK) == -1) {
+        fprintf(stderr, "Spill directory %s is not a writable directory\n", dir);
+        return -1;
+    }
+    strcpy(layout->dir, dir);
+    layout->tag = (int)getpid();
+    layout->num_workers = num_workers;
+
+    // Bảng của 1 partition dùng tối đa nửa bộ nhớ; không rộng hơn số ID thật
+    size_t total_parts = 0;
+    for (int k = 0; k < SPILL_KINDS; k++) {
+        int shift = SPILL_MIN_SHIFT;
+        while (shift < SPILL_MAX_SHIFT &&
+               ((size_t)2 << shift) * spill_table_arrays(k) * sizeof(int64_t) <= mem_bytes / 2 &&
+               ((long long)1 << shift) < ids[k]) {
+            shift++;
+        }
+        layout->shift[k] = shift;
+        layout->parts[k] = (int)(((long long)ids[k] + (1LL << shift) - 1) >> shift);
+        if (layout->parts[k] < 1) {
+            layout->parts[k] = 1;
+        }
+        total_parts += layout->parts[k];
+    }
+
+    // Nửa còn lại cho buffer: num_workers x mọi partition
+    size_t records = mem_bytes / 2 / sizeof(uint32_t) / ((size_t)num_workers * total_parts);
+    if (records > SPILL_MAX_BUFFER) {
+        records = SPILL_MAX_BUFFER;
+    }
+    if (records < SPILL_MIN_BUFFER) {
+        records = SPILL_MIN_BUFFER;
+        printf("⚠️  --mem-limit too small for %d workers x %zu partitions, using %d-record "
+               "buffers\n", num_workers, total_parts, SPILL_MIN_BUFFER);
+    }
+    layout->buffer_records = (int)records;
+    return 0;
+}
+
+void spill_path(const SpillLayout *layout, SpillKind kind, int part, int worker, char *path) {
+    snprintf(path, SPILL_PATH_MAX, "%s/problem1-%d-%c%05d-w%03d.run", layout->dir, layout->tag,
+             spill_kind_char[kind], part, worker);
+}
+
+int spill_writer_open(SpillWriter *writer, const SpillLayout *layout, int worker) {
+    memset(writer, 0, sizeof(*writer));
+    writer->layout = layout;
+    writer->worker = worker;
+    for (int k = 0; k < SPILL_KINDS; k++) {
+        int parts = layout->parts[k];
+        writer->buffer[k] = malloc((size_t)parts * layout->buffer_records * sizeof(uint32_t));
+        writer->fill[k] = calloc(parts, sizeof(int));
+        writer->fd[k] = malloc(parts * sizeof(int));
+        if (writer->buffer[k] == NULL || writer->fill[k] == NULL || writer->fd[k] == NULL) {
+            perror("malloc spill buffers failed");
+            return -1;
+        }
+        for (int p = 0; p < parts; p++) {
+            writer->fd[k][p] = -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Hàm: write_all
+ * Mục đích: write() tới khi hết n bytes (write có thể ghi thiếu / bị ngắt)
+ */
+static int write_all(int fd, const void *data, size_t n) {
+    const char *p = data;
+    while (n > 0) {
+        ssize_t done = write(fd, p, n);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += done;
+        n -= done;
+    }
+    return 0;
+}
+
+int spill_flush(SpillWriter *writer, SpillKind kind, int part) {
+    const SpillLayout *layout = writer->layout;
+    int n = writer->fill[kind][part];
+
+    if (n == 0) {
+        return 0;
+    }
+    if (writer->fd[kind][part] == -1) {
+        char path[SPILL_PATH_MAX];
+        spill_path(layout, kind, part, writer->worker, path);
+        writer->fd[kind][part] = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (writer->fd[kind][part] == -1) {
+            fprintf(stderr, "Cannot create run file %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+    const uint32_t *records = writer->buffer[kind] + (size_t)part * layout->buffer_records;
+    if (write_all(writer->fd[kind][part], records, (size_t)n * sizeof(uint32_t)) == -1) {
+        perror("write run file failed");
+        return -1;
+    }
+    writer->fill[kind][part] = 0;
+    return 0;
+}
+
+int spill_writer_close(SpillWriter *writer) {
+    int result = 0;
+
+    for (int k = 0; k < SPILL_KINDS; k++) {
+        if (writer->fd[k] == NULL) {
+            continue;
+        }
+        for (int p = 0; p < writer->layout->parts[k]; p++) {
+            if (writer->fill[k] != NULL && writer->buffer[k] != NULL &&
+                spill_flush(writer, k, p) == -1) {
+                result = -1;
+            }
+            if (writer->fd[k][p] != -1 && close(writer->fd[k][p]) == -1) {
+                perror("close run file failed");
+                result = -1;
+            }
+        }
+    }
+    for (int k = 0; k < SPILL_KINDS; k++) {
+        free(writer->buffer[k]);
+        free(writer->fill[k]);
+        free(writer->fd[k]);
+    }
+    memset(writer, 0, sizeof(*writer));
+    return result;
+}
+
+long long spill_read_partition(const SpillLayout *layout, SpillKind kind, int part,
+                               uint32_t *buffer, SpillVisit visit, void *ctx) {
+    const size_t capacity = SPILL_READ_RECORDS * sizeof(uint32_t);
+    long long total = 0;
+
+    for (int w = 1; w <= layout->num_workers; w++) {
+        char path[SPILL_PATH_MAX];
+        spill_path(layout, kind, part, w, path);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            if (errno == ENOENT) {
+                continue;  // Worker này không có rating nào trong partition
+            }
+            fprintf(stderr, "Cannot open run file %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        size_t have = 0;  // Bytes đang có trong buffer (có thể dư nửa bản ghi)
+        for (;;) {
+            ssize_t n = read(fd, (char *)buffer + have, capacity - have);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("read run file failed");
+                close(fd);
+                return -1;
+            }
+            have += n;
+            size_t records = have / sizeof(uint32_t);
+            if (records > 0 && (n == 0 || have == capacity)) {
+                visit(ctx, buffer, records);
+                total += records;
+                have -= records * sizeof(uint32_t);
+                memmove(buffer, buffer + records, have);
+            }
+            if (n == 0) {
+                break;
+            }
+        }
+        // Đã đọc xong: không giữ page của run file trong page cache
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+        unlink(path);
+        if (have != 0) {
+            fprintf(stderr, "Run file %s is truncated\n", path);
+            return -1;
+        }
+    }
+    return total;
+}
+
+/*
+ * Hàm: spill_visit_movies / spill_visit_users
+ * Mục đích: Cộng 1 đoạn bản ghi của run file vào bảng dày của partition
+ */
+static void spill_visit_movies(void *ctx, const uint32_t *records, size_t n) {
+    SpillTable *table = ctx;
+    for (size_t r = 0; r < n; r++) {
+        uint32_t i = records[r] >> SPILL_RATING_BITS;
+        int rating = (int)(records[r] & ((1u << SPILL_RATING_BITS) - 1));
+        table->sum[i] += rating;
+        table->count[i]++;
+        table->hist[rating - 1][i]++;
+    }
+}
+
+static void spill_visit_users(void *ctx, const uint32_t *records, size_t n) {
+    SpillTable *table = ctx;
+    for (size_t r = 0; r < n; r++) {
+        uint32_t u = records[r] >> SPILL_RATING_BITS;
+        table->sum[u] += records[r] & ((1u << SPILL_RATING_BITS) - 1);
+        table->count[u]++;
+    }
+}
+
+int spill_aggregate(const SpillLayout *layout, SpillKind kind, int limit, SpillEmit emit,
+                    void *ctx) {
+    int width = 1 << layout->shift[kind];
+    size_t block_bytes = spill_table_arrays(kind) * width * sizeof(int64_t);
+    uint32_t *buffer = malloc(SPILL_READ_RECORDS * sizeof(uint32_t));
+    int64_t *block = malloc(block_bytes);
+    if (buffer == NULL || block == NULL) {
+        perror("malloc spill table failed");
+        free(buffer);
+        free(block);
+        return -1;
+    }
+
+    SpillTable table;
+    memset(&table, 0, sizeof(table));
+    table.sum = block;
+    table.count = block + width;
+    if (kind == SPILL_MOVIES) {
+        for (int b = 0; b < SPILL_HIST_BUCKETS; b++) {
+            table.hist[b] = block + (size_t)(2 + b) * width;
+        }
+    }
+
+    int result = 0;
+    for (int p = 0; p < layout->parts[kind] && result == 0; p++) {
+        memset(block, 0, block_bytes);
+        if (spill_read_partition(layout, kind, p, buffer,
+                                 kind == SPILL_MOVIES ? spill_visit_movies : spill_visit_users,
+                                 &table) < 0) {
+            result = -1;
+            break;
+        }
+        long long base = (long long)p << layout->shift[kind];
+        int n = (int)(limit - base < width ? limit - base : width);
+        result = emit(ctx, kind, &table, base, n);
+    }
+    free(block);
+    free(buffer);
+    return result;
+}
+
+void spill_remove_all(const SpillLayout *layout) {
+    for (int k = 0; k < SPILL_KINDS; k++) {
+        for (int p = 0; p < layout->parts[k]; p++) {
+            for (int w = 1; w <= layout->num_workers; w++) {
+                char path[SPILL_PATH_MAX];
+                spill_path(layout, k, p, w, path);
+                unlink(path);
+            }
+        }
+    }
+}
@@ -0,0 +1,132 @@
+// spill.h
+// Tổng hợp ngoài bộ nhớ (--spill DIR) cho input lớn hơn RAM: bảng không cần nằm hết
+// trong shared memory
+// 1. Mỗi rating thành 2 bản ghi 4 bytes (offset trong partition << 4 | rating nửa sao):
+//    1 theo movie, 1 theo user. Partition = khoảng 2^shift ID liên tiếp (hash = ID >> shift)
+//    Worker gom bản ghi vào buffer nhỏ của từng partition, đầy thì write() vào run file
+//    riêng của worker -> không lock, bộ nhớ = số partition x buffer
+// 2. Parent tổng hợp lần lượt từng partition: đọc tuần tự run file của mọi worker vào
+//    1 bảng dày 2^shift phần tử -> ID tăng dần, không cần sort, bộ nhớ = 1 bảng
+// Kích thước buffer và partition chia từ --mem-limit, không phụ thuộc kích thước input
+// 3. spill_aggregate gọi emit với bảng của từng partition theo thứ tự ID, caller định
+//    dạng kết quả (không giữ lại bảng sau khi emit trả về)
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rating_parser.h"
+
+#define SPILL_RATING_BITS 4               // Rating (1..10 nửa sao) ở 4 bit thấp của bản ghi
+#define SPILL_MAX_SHIFT (32 - SPILL_RATING_BITS)
+#define SPILL_MIN_SHIFT 6                 // Partition ít nhất 64 ID
+#define SPILL_MIN_BUFFER 1024             // Số bản ghi tối thiểu của 1 buffer (4KB)
+#define SPILL_READ_RECORDS (1 << 18)      // Buffer đọc run file của parent (1MB)
+#define SPILL_DEFAULT_MEM_MB 256
+#define SPILL_MIN_MEM_MB 16
+#define SPILL_PATH_MAX 4096
+#define SPILL_HIST_BUCKETS (5 * RATING_SCALE)  // Histogram nửa sao 0.5, 1.0, ..., 5.0
+
+typedef enum {
+    SPILL_MOVIES,                         // Bản ghi theo movie (index = movieID - 1)
+    SPILL_USERS,                          // Bản ghi theo user (index = userID - 1)
+    SPILL_KINDS
+} SpillKind;
+
+// Cách chia partition, parent tính trước khi fork (child / thread chỉ đọc)
+typedef struct {
+    char dir[SPILL_PATH_MAX - 64];        // Chừa chỗ cho tên run file
+    int tag;                              // PID parent: tên run file không trùng giữa các lần chạy
+    int num_workers;
+    int shift[SPILL_KINDS];               // Partition p của kind: ID index [p << shift, (p + 1) << shift)
+    int parts[SPILL_KINDS];               // Số partition
+    int buffer_records;                   // Số bản ghi trong buffer của 1 partition / worker
+} SpillLayout;
+
+// Bộ ghi của 1 worker (bộ nhớ riêng của child / thread)
+typedef struct {
+    const SpillLayout *layout;
+    int worker;                           // 1..num_workers
+    uint32_t *buffer[SPILL_KINDS];        // [parts * buffer_records]
+    int *fill[SPILL_KINDS];               // [parts] số bản ghi đang chờ trong buffer
+    int *fd[SPILL_KINDS];                 // [parts] run file (-1 = chưa mở)
+    long long rows;                       // Số rating đã ghi
+    long long sum;                        // Tổng rating (nửa sao) -> mean chung cho --rank bayes
+} SpillWriter;
+
+// Chia partition: ids[kind] = số ID. Nửa mem_bytes cho bảng partition của spill_aggregate,
+// nửa cho buffer của các worker
+// Trả về -1 nếu dir không ghi được (đã in lý do)
+int spill_layout_init(SpillLayout *layout, const char *dir, const int ids[SPILL_KINDS],
+                      int num_workers, size_t mem_bytes);
+
+// Tên run file của (kind, partition, worker)
+void spill_path(const SpillLayout *layout, SpillKind kind, int part, int worker, char *path);
+
+// Cấp phát buffer của worker. Trả về -1 nếu hết bộ nhớ
+int spill_writer_open(SpillWriter *writer, const SpillLayout *layout, int worker);
+
+// Ghi buffer của 1 partition ra run file (mở nếu chưa có). Trả về -1 nếu lỗi (đã in)
+int spill_flush(SpillWriter *writer, SpillKind kind, int part);
+
+// Ghi hết buffer, đóng run file, giải phóng. Trả về -1 nếu lỗi
+int spill_writer_close(SpillWriter *writer);
+
+// Gọi visit cho từng đoạn bản ghi của partition (run file của mọi worker, đọc tuần tự
+// qua buffer SPILL_READ_RECORDS bản ghi), xóa run file đã đọc
+// Trả về số bản ghi, -1 nếu lỗi đọc
+typedef void (*SpillVisit)(void *ctx, const uint32_t *records, size_t n);
+long long spill_read_partition(const SpillLayout *layout, SpillKind kind, int part,
+                               uint32_t *buffer, SpillVisit visit, void *ctx);
+
+// Bảng dày của 1 partition lúc tổng hợp: phần tử i là ID index base + i
+typedef struct {
+    int64_t *sum;                         // Tổng rating (nửa sao)
+    int64_t *count;                       // Số rating
+    int64_t *hist[SPILL_HIST_BUCKETS];    // Số rating theo nửa sao (NULL với SPILL_USERS)
+} SpillTable;
+
+// Nhận bảng của partition (n ID từ index base). Trả về -1 để dừng (đã in lỗi)
+typedef int (*SpillEmit)(void *ctx, SpillKind kind, const SpillTable *table, long long base,
+                         int n);
+
+// Tổng hợp lần lượt từng partition của kind (ID index 0..limit-1) vào 1 bảng dày rồi gọi
+// emit. Bộ nhớ: 1 bảng partition + buffer đọc. Trả về 0, -1 nếu lỗi (đã in)
+int spill_aggregate(const SpillLayout *layout, SpillKind kind, int limit, SpillEmit emit,
+                    void *ctx);
+
+// Xóa mọi run file còn lại (khi lỗi giữa chừng)
+void spill_remove_all(const SpillLayout *layout);
+
+/*
+ * Hàm: spill_put
+ * Mục đích: Thêm 1 bản ghi (index 0-based) vào buffer partition của nó
+ */
+static inline int spill_put(SpillWriter *writer, SpillKind kind, int index, int rating) {
+    int shift = writer->layout->shift[kind];
+    int part = index >> shift;
+    int slot = writer->fill[kind][part]++;
+    writer->buffer[kind][(size_t)part * writer->layout->buffer_records + slot] =
+        ((uint32_t)(index & ((1 << shift) - 1)) << SPILL_RATING_BITS) | (uint32_t)rating;
+    if (slot + 1 == writer->layout->buffer_records) {
+        return spill_flush(writer, kind, part);
+    }
+    return 0;
+}
+
+/*
+ * Hàm: spill_add
+ * Mục đích: Ghi 1 rating (user, movie là index 0-based, rating nửa sao) vào 2 partition
+ * Trả về -1 nếu ghi run file lỗi
+ */
+static inline int spill_add(SpillWriter *writer, int user, int movie, int rating) {
+    writer->rows++;
+    writer->sum += rating;
+    if (spill_put(writer, SPILL_MOVIES, movie, rating) == -1) {
+        return -1;
+    }
+    return spill_put(writer, SPILL_USERS, user, rating);
+}
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ * table_merge.c
+ * Merge bằng SIMD: build mặc định không bật -O nên không trông chờ compiler
+ * tự vector hóa. x86-64 luôn có SSE2 (2 bộ đếm / lệnh); AVX2 (4 bộ đếm / lệnh)
+ * được biên dịch riêng bằng target attribute và chỉ dùng khi CPU hỗ trợ
+ */
+
+#include "table_merge.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TABLE_MERGE_X86 1
+#endif
+
+/*
+ * Hàm: add_scalar
+ * Mục đích: Bản dự phòng (CPU không phải x86) và phần dư cuối mảng
+ */
+static void add_scalar(int64_t *dst, const int64_t *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] += src[i];
+    }
+}
+
+#ifdef TABLE_MERGE_X86
+/*
+ * Hàm: add_sse2
+ * Mục đích: 2 bộ đếm / lệnh. loadu/storeu -> không yêu cầu căn 16 bytes
+ */
+__attribute__((target("sse2")))
+static void add_sse2(int64_t *dst, const int64_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi64(a, b));
+    }
+    add_scalar(dst + i, src + i, n - i);
+}
+
+/*
+ * Hàm: add_avx2
+ * Mục đích: 4 bộ đếm / lệnh, mỗi vòng 2 lệnh = đúng 1 cache line (64 bytes)
+ */
+__attribute__((target("avx2")))
+static void add_avx2(int64_t *dst, const int64_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(dst + i + 4));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(src + i + 4));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_add_epi64(a0, b0));
+        _mm256_storeu_si256((__m256i *)(dst + i + 4), _mm256_add_epi64(a1, b1));
+    }
+    add_scalar(dst + i, src + i, n - i);
+}
+#endif
+
+/*
+ * Hàm: max_scalar
+ * Mục đích: Max từng byte, bản dự phòng và phần dư cuối mảng
+ */
+static void max_scalar(uint8_t *dst, const uint8_t *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (src[i] > dst[i]) {
+            dst[i] = src[i];
+        }
+    }
+}
+
+#ifdef TABLE_MERGE_X86
+/*
+ * Hàm: max_sse2
+ * Mục đích: 16 register / lệnh (pmaxub)
+ */
+__attribute__((target("sse2")))
+static void max_sse2(uint8_t *dst, const uint8_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_max_epu8(a, b));
+    }
+    max_scalar(dst + i, src + i, n - i);
+}
+
+/*
+ * Hàm: max_avx2
+ * Mục đích: 32 register / lệnh, mỗi vòng 2 lệnh = 1 cache line
+ */
+__attribute__((target("avx2")))
+static void max_avx2(uint8_t *dst, const uint8_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(dst + i + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_max_epu8(a0, b0));
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), _mm256_max_epu8(a1, b1));
+    }
+    max_scalar(dst + i, src + i, n - i);
+}
+#endif
+
+void table_add_i64(int64_t *dst, const int64_t *src, size_t n) {
+#ifdef TABLE_MERGE_X86
+    if (__builtin_cpu_supports("avx2")) {
+        add_avx2(dst, src, n);
+    } else {
+        add_sse2(dst, src, n);
+    }
+#else
+    add_scalar(dst, src, n);
+#endif
+}
+
+void table_max_u8(uint8_t *dst, const uint8_t *src, size_t n) {
+#ifdef TABLE_MERGE_X86
+    if (__builtin_cpu_supports("avx2")) {
+        max_avx2(dst, src, n);
+    } else {
+        max_sse2(dst, src, n);
+    }
+#else
+    max_scalar(dst, src, n);
+#endif
+}
@@ -0,0 +1,16 @@
+// table_merge.h
+// Cộng 2 mảng bộ đếm 64-bit (merge slab riêng của child vào bảng chính)
+// và max từng byte của 2 mảng register HyperLogLog
+#ifndef TABLE_MERGE_H
+#define TABLE_MERGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// dst[i] += src[i] với i = 0..n-1. Chọn AVX2 / SSE2 / vòng lặp thường lúc chạy
+void table_add_i64(int64_t *dst, const int64_t *src, size_t n);
+
+// dst[i] = max(dst[i], src[i]) với i = 0..n-1 (gộp sketch HLL). Chọn AVX2 / SSE2 lúc chạy
+void table_max_u8(uint8_t *dst, const uint8_t *src, size_t n);
+
+#endif
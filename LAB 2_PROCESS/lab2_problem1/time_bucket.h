@@ -0,0 +1,109 @@
+// time_bucket.h
+// Chia timestamp (giây UTC) thành bucket ngày / tuần / tháng
+// Ngày <-> (năm, tháng, ngày) theo lịch Gregory bằng thuật toán days_from_civil /
+// civil_from_days (Howard Hinnant): chỉ dùng phép nguyên, không gọi gmtime()
+#ifndef TIME_BUCKET_H
+#define TIME_BUCKET_H
+
+#define SECONDS_PER_DAY 86400
+
+typedef enum {
+    BUCKET_NONE,           // Không tổng hợp theo thời gian
+    BUCKET_DAY,
+    BUCKET_WEEK,           // Tuần bắt đầu từ thứ Hai
+    BUCKET_MONTH
+} BucketKind;
+
+// Chia lấy phần nguyên làm tròn xuống (đúng cả với số âm)
+static inline long long floor_div(long long a, long long b) {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+/*
+ * Hàm: days_from_civil
+ * Mục đích: Số ngày kể từ 1970-01-01 của ngày y-m-d
+ */
+static inline long long days_from_civil(long long y, int m, int d) {
+    y -= (m <= 2);
+    long long era = floor_div(y, 400);
+    long long yoe = y - era * 400;                                  // [0, 399]
+    long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1; // [0, 365]
+    long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;          // [0, 146096]
+    return era * 146097 + doe - 719468;
+}
+
+/*
+ * Hàm: civil_from_days
+ * Mục đích: Ngược lại của days_from_civil
+ */
+static inline void civil_from_days(long long days, long long *y, int *m, int *d) {
+    days += 719468;
+    long long era = floor_div(days, 146097);
+    long long doe = days - era * 146097;                                 // [0, 146096]
+    long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365; // [0, 399]
+    long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);             // [0, 365]
+    long long mp = (5 * doy + 2) / 153;                                  // [0, 11]
+    *d = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *m = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *y = yoe + era * 400 + (*m <= 2);
+}
+
+/*
+ * Hàm: time_bucket
+ * Mục đích: Số thứ tự tuyệt đối của bucket chứa timestamp
+ * (ngày / tuần kể từ 1970, tháng = năm * 12 + tháng - 1)
+ */
+static inline long long time_bucket(long long timestamp, BucketKind kind) {
+    long long days = floor_div(timestamp, SECONDS_PER_DAY);
+    long long y;
+    int m, d;
+
+    switch (kind) {
+    case BUCKET_DAY:
+        return days;
+    case BUCKET_WEEK:
+        // 1970-01-01 là thứ Năm -> +3 để tuần bắt đầu từ thứ Hai
+        return floor_div(days + 3, 7);
+    case BUCKET_MONTH:
+        civil_from_days(days, &y, &m, &d);
+        return y * 12 + (m - 1);
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Hàm: bucket_start_days
+ * Mục đích: Ngày đầu tiên (số ngày kể từ 1970) của bucket tuyệt đối
+ */
+static inline long long bucket_start_days(long long bucket, BucketKind kind) {
+    switch (kind) {
+    case BUCKET_WEEK:
+        return bucket * 7 - 3;
+    case BUCKET_MONTH: {
+        long long year = floor_div(bucket, 12);
+        return days_from_civil(year, (int)(bucket - year * 12) + 1, 1);
+    }
+    default:
+        return bucket;
+    }
+}
+
+/*
+ * Hàm: bucket_name
+ * Mục đích: Tên của kiểu bucket (như trên command line)
+ */
+static inline const char *bucket_name(BucketKind kind) {
+    switch (kind) {
+    case BUCKET_DAY:
+        return "day";
+    case BUCKET_WEEK:
+        return "week";
+    case BUCKET_MONTH:
+        return "month";
+    default:
+        return "none";
+    }
+}
+
+#endif
@@ -0,0 +1,87 @@
+// topk.h
+// Chọn top-K bằng binary min-heap kích thước K: O(N log K) thay vì O(N * K)
+#ifndef TOPK_H
+#define TOPK_H
+
+// 1 ứng viên trong top-K
+typedef struct {
+    int id;                // movieID
+    long long count;       // Số ratings
+    double average;        // Average rating (để hiển thị)
+    double score;          // Giá trị dùng để xếp hạng (average hoặc Bayesian)
+} TopEntry;
+
+/*
+ * Hàm: topk_worse
+ * Mục đích: a xếp hạng thấp hơn b? (score nhỏ hơn, bằng nhau thì ID lớn hơn)
+ * Thứ tự toàn phần -> kết quả không phụ thuộc thứ tự duyệt
+ */
+static inline int topk_worse(const TopEntry *a, const TopEntry *b) {
+    return a->score < b->score || (a->score == b->score && a->id > b->id);
+}
+
+// Đẩy phần tử ở vị trí i xuống đúng chỗ trong min-heap (gốc = phần tử tệ nhất)
+static inline void topk_sift_down(TopEntry *heap, int size, int i) {
+    for (;;) {
+        int left = 2 * i + 1;
+        int right = left + 1;
+        int worst = i;
+
+        if (left < size && topk_worse(&heap[left], &heap[worst])) {
+            worst = left;
+        }
+        if (right < size && topk_worse(&heap[right], &heap[worst])) {
+            worst = right;
+        }
+        if (worst == i) {
+            return;
+        }
+        TopEntry tmp = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = tmp;
+        i = worst;
+    }
+}
+
+/*
+ * Hàm: topk_push
+ * Mục đích: Xét 1 ứng viên. Heap chưa đủ k -> thêm vào; đủ rồi thì chỉ thay gốc
+ * (phần tử tệ nhất) khi ứng viên tốt hơn. *size là số phần tử hiện có
+ */
+static inline void topk_push(TopEntry *heap, int *size, int k, const TopEntry *item) {
+    if (*size < k) {
+        // Thêm vào cuối rồi đẩy lên
+        int i = (*size)++;
+        heap[i] = *item;
+        while (i > 0) {
+            int parent = (i - 1) / 2;
+            if (!topk_worse(&heap[i], &heap[parent])) {
+                break;
+            }
+            TopEntry tmp = heap[i];
+            heap[i] = heap[parent];
+            heap[parent] = tmp;
+            i = parent;
+        }
+    } else if (k > 0 && topk_worse(&heap[0], item)) {
+        heap[0] = *item;
+        topk_sift_down(heap, *size, 0);
+    }
+}
+
+/*
+ * Hàm: topk_sort
+ * Mục đích: Heapsort tại chỗ -> heap[0] là phần tử tốt nhất (giảm dần theo score)
+ * Heap bị phá sau khi gọi
+ */
+static inline void topk_sort(TopEntry *heap, int size) {
+    for (int n = size; n > 1; n--) {
+        // Gốc là phần tử tệ nhất còn lại -> đưa về cuối
+        TopEntry tmp = heap[0];
+        heap[0] = heap[n - 1];
+        heap[n - 1] = tmp;
+        topk_sift_down(heap, n - 1, 0);
+    }
+}
+
+#endif
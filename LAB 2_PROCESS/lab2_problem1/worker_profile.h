@@ -0,0 +1,90 @@
+// worker_profile.h
+// Bộ đếm hot loop của worker (make profile / CFLAGS += -DPROFILE): số dòng đã parse,
+// bị loại, lần lấy lock và số vòng spin, bytes đã đọc, thời gian parse / cập nhật bảng
+// - Mỗi worker đếm vào biến __thread riêng (không tranh cache line), hết mỗi chunk chép
+//   sang ô WorkerProfile của mình trong shared memory (1 cache line riêng / worker)
+// - Parent in bảng sau khi mọi worker kết thúc (waitpid / pthread_join)
+// - Thời gian đo bằng tick rẻ (rdtsc trên x86, ~20 cycle; nơi khác clock_gettime) quanh
+//   MỖI lần cập nhật bảng và mỗi chunk; đổi ra ns theo tỉ lệ với busy time của chunk
+//   -> không cần hiệu chỉnh tần số TSC. Parse = busy - cập nhật bảng
+// Không có -DPROFILE: mọi macro PROF_* rỗng -> hot loop giống hệt bản thường
+#ifndef WORKER_PROFILE_H
+#define WORKER_PROFILE_H
+
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define WORKER_PROFILE_TSC 1
+#endif
+
+// Ô bộ đếm của 1 worker
+typedef struct {
+    long long rows_parsed;         // Dòng đã đọc (kể cả dòng sai định dạng)
+    long long rows_rejected;       // Dòng bị loại: sai định dạng, ID / rating ngoài bảng
+    long long rows_updated;        // Số lần cập nhật bảng
+    long long lock_acquires;       // Số lần acquire_lock (MODE_LOCK)
+    long long lock_spins;          // Số vòng test-and-set thất bại khi chờ lock
+    long long bytes_read;          // Bytes input của các chunk đã xử lý
+    long long busy_ns;             // Tổng thời gian xử lý chunk
+    long long busy_ticks;          // Cùng khoảng đó, theo tick
+    long long update_ticks;        // Tick trong update_tables
+} __attribute__((aligned(64))) WorkerProfile;
+
+#ifdef PROFILE
+
+// Bộ đếm của worker hiện tại
+static __thread WorkerProfile prof_counters;
+
+/*
+ * Hàm: prof_ticks
+ * Mục đích: Bộ đếm thời gian rẻ nhất có (đơn vị tùy máy, chỉ dùng để lấy tỉ lệ)
+ */
+static inline long long prof_ticks(void) {
+#ifdef WORKER_PROFILE_TSC
+    return (long long)__rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+#define PROF_RESET() memset(&prof_counters, 0, sizeof(prof_counters))
+#define PROF_ADD(field, n) (prof_counters.field += (n))
+#define PROF_PUBLISH(slot) (*(slot) = prof_counters)
+
+// Chạy call, cộng số tick đã tốn vào field
+#define PROF_TIME(field, call)                                                        \
+    do {                                                                              \
+        long long prof_start = prof_ticks();                                          \
+        call;                                                                         \
+        prof_counters.field += prof_ticks() - prof_start;                             \
+    } while (0)
+
+#else
+
+#define PROF_RESET() ((void)0)
+#define PROF_ADD(field, n) ((void)0)
+#define PROF_PUBLISH(slot) ((void)0)
+#define PROF_TIME(field, call) call
+
+#endif
+
+// Cập nhật bảng bằng call (đếm và đo thời gian)
+#define PROF_UPDATE(call)                                                             \
+    do {                                                                              \
+        PROF_ADD(rows_updated, 1);                                                    \
+        PROF_TIME(update_ticks, call);                                                \
+    } while (0)
+
+/*
+ * Hàm: prof_update_ns
+ * Mục đích: Thời gian cập nhật bảng (ns) = busy_ns x phần tick nằm trong update_tables
+ */
+static inline double prof_update_ns(const WorkerProfile *p) {
+    return p->busy_ticks > 0 ? (double)p->busy_ns * p->update_ticks / p->busy_ticks : 0.0;
+}
+
+#endif